@@ -0,0 +1,100 @@
+Import("env")
+
+#
+# Check the Timer1 interrupt routine after every build.
+#
+# Disassembles SyncBitBanger::serialDriverInterruptRoutine() from the firmware
+# and reports its size and how the pins are accessed. With LINE_PINS_FIXED the
+# data and clock pin writes must have compiled to single sbi/cbi instructions
+# (see lib/send-receive-engine/PinPolicy.h), otherwise the build fails.
+#
+# With LINE_PINS_FIXED and custom_isr_compare_env naming an environment built
+# the same way but without LINE_PINS_FIXED, that environment is built too and the
+# build fails unless the fixed pin routine is smaller than its runtime pin one.
+# Both routines come from a linked (LTO) firmware, so they are compared like for
+# like.
+#
+# Set custom_isr_max_instructions in the environment to also fail the build when
+# the routine grows past that many instructions.
+#
+
+import os
+import re
+import subprocess
+
+ISR_NAME = "SyncBitBanger::serialDriverInterruptRoutine()"
+
+# rxd high, rxd low, two clocks high, two clocks low
+MIN_FIXED_PIN_BIT_OPS = 6
+
+
+def disassemble_function(objdump, elf, name):
+    out = subprocess.run([objdump, "-d", "-C", "--no-show-raw-insn", elf],
+                         capture_output=True, text=True, check=True).stdout
+    lines = []
+    inside = False
+    for line in out.splitlines():
+        if line.endswith("<" + name + ">:"):
+            inside = True
+            continue
+        if inside:
+            if not line.strip():
+                break
+            lines.append(line)
+    return lines
+
+
+def build_compare_env(env, name):
+    # The firmware of the environment to compare with, built if it is out of date.
+    project = env.subst("$PROJECT_DIR")
+    cmd = [env.subst("$PYTHONEXE"), "-m", "platformio", "run", "-d", project, "-e", name]
+    result = subprocess.run(cmd, capture_output=True, text=True)
+    if result.returncode != 0:
+        print(result.stdout + result.stderr)
+        return None
+    elf = os.path.join(env.subst("$PROJECT_BUILD_DIR"), name, env.subst("${PROGNAME}.elf"))
+    return elf if os.path.isfile(elf) else None
+
+
+def check_isr(source, target, env):
+    elf = str(target[0])
+    objdump = env.subst("$CC").replace("gcc", "objdump")
+    defines = [d if isinstance(d, str) else d[0] for d in env.get("CPPDEFINES", [])]
+    fixed_pins = "LINE_PINS_FIXED" in defines
+
+    lines = disassemble_function(objdump, elf, ISR_NAME)
+    if not lines:
+        print("isr_size_check: %s not found in %s" % (ISR_NAME, elf))
+        return
+
+    ops = [l.split("\t")[1].strip() if "\t" in l else "" for l in lines]
+    bit_ops = len([o for o in ops if re.match(r"^(sbi|cbi|sbis|sbic)$", o)])
+    indirect = len([o for o in ops if re.match(r"^(ld|ldd|st|std)$", o)])
+
+    print("isr_size_check: %s is %d instructions, %d sbi/cbi/sbis/sbic, %d indirect ld/st (%s pins)"
+          % (ISR_NAME, len(ops), bit_ops, indirect, "fixed" if fixed_pins else "runtime"))
+
+    if fixed_pins and bit_ops < MIN_FIXED_PIN_BIT_OPS:
+        print("isr_size_check: FAILED - expected at least %d single bit port instructions with LINE_PINS_FIXED"
+              % MIN_FIXED_PIN_BIT_OPS)
+        env.Exit(1)
+
+    compare_env = env.GetProjectOption("custom_isr_compare_env", "")
+    if fixed_pins and compare_env:
+        compare_elf = build_compare_env(env, compare_env)
+        runtime_lines = disassemble_function(objdump, compare_elf, ISR_NAME) if compare_elf else []
+        if not runtime_lines:
+            print("isr_size_check: FAILED - could not build %s to compare with" % compare_env)
+            env.Exit(1)
+        print("isr_size_check: %d instructions with runtime pins (%s)" % (len(runtime_lines), compare_env))
+        if len(ops) >= len(runtime_lines):
+            print("isr_size_check: FAILED - fixed pins did not make the routine smaller")
+            env.Exit(1)
+
+    budget = env.GetProjectOption("custom_isr_max_instructions", "")
+    if budget and len(ops) > int(budget):
+        print("isr_size_check: FAILED - %d instructions is over the budget of %s" % (len(ops), budget))
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", check_isr)
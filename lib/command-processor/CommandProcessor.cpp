@@ -2,6 +2,7 @@
 #include <stdio.h>
 
 #include <Arduino.h>
+#include <avr/sleep.h>
 
 #include "CommandProcessor.h"
 
@@ -16,6 +17,7 @@ CommandProcessor::CommandProcessor(
     this->syncControl = syncCntrl;
 
     this->lastDataReceivedTime = millis();
+    this->turnaroundMs = REPLY_TURNAROUND_MS;
     //Serial.println(F("CommandProcessor constructor complete."));
 }
 
@@ -39,6 +41,30 @@ uint8_t CommandProcessor::getNewCommandMode() {
     return this->newCommandMode;
 }
 
+/*
+ * At 9600 bps a poll of a station that is not there is given 27ms, where it
+ * used to be RECEIVE_TIMEOUT. Without a line to take the bit rate from the
+ * wait is RECEIVE_TIMEOUT.
+ */
+void CommandProcessor::setReplyDeadline(ReplyDeadline *deadline, uint8_t replyClass,
+                                        unsigned int fixedMs) {
+    long bitRate = this->syncControl ? this->syncControl->getBitRate() : 0;
+
+    if ( fixedMs > 0 || bitRate <= 0 ) {
+        deadline->startMs = fixedMs > 0 ? fixedMs : RECEIVE_TIMEOUT;
+        deadline->totalMs = deadline->startMs;
+        deadline->silenceBytes = 0;
+        return;
+    }
+
+    unsigned long byteUs = 8000000L / bitRate;
+    unsigned long maxBytes = replyClass == REPLY_CONTROL ? REPLY_CONTROL_BYTES : DATABUFF_MAX_DATA;
+
+    deadline->startMs = turnaroundMs + (REPLY_LEAD_BYTES * byteUs) / 1000 + 1;
+    deadline->totalMs = deadline->startMs + (2 * maxBytes * byteUs) / 1000;
+    deadline->silenceBytes = REPLY_SILENCE_BYTES;
+}
+
 void CommandProcessor::injectSerial(Serial_ *serialInstance) {
     this->useSerial = serialInstance;
 }
@@ -47,17 +73,55 @@ unsigned long CommandProcessor::getAndProcessCommand() {
     return 0;
 }
 
+int CommandProcessor::serialReadAvailable(uint8_t *dest, int maxLen) {
+    int len = this->useSerial->available();
+
+    if ( len <= 0 )
+        return 0;
+    if ( len > maxLen )
+        len = maxLen;
+    return this->useSerial->readBytes(dest, len);
+}
+
+int CommandProcessor::serialReadBytes(uint8_t *dest, int len, unsigned long timeoutMs) {
+    int got = 0;
+    unsigned long lastData = millis();
+
+    while ( got < len ) {
+        int n = serialReadAvailable(dest + got, len - got);
+        if ( n > 0 ) {
+            got += n;
+            lastData = millis();
+        } else if ( millis() - lastData >= timeoutMs ) {
+            break;
+        } else {
+            serialIdle();
+        }
+    }
+    return got;
+}
+
 void CommandProcessor::sendDebugToHost(char * str) {}
 void CommandProcessor::sendDebugToHost(const char * str) {}
 
 CommandProcessorBinary::CommandProcessorBinary(
     SendEngine * sEng,
     ReceiveEngine * rEng,
-    SyncControl * syncCntrl  ) : CommandProcessor(sEng, rEng, syncControl) {
+    SyncControl * syncCntrl  ) : CommandProcessor(sEng, rEng, syncCntrl) {
+    nakRetries = 0;
+    readTimeout = 0;
+    nextReadTimeout = -1;
+    commandReadTimeout = 0;
+    nextAck = BSC_CONTROL_ACK1;
+    responseLength = 0;
+    pollListLength = 0;
+    pollListNext = 0;
+    pollListReset = false;
     //Serial.println(F("CommandProcessorBinary constructor complete."));
 }
 
 CommandProcessorBinary::~CommandProcessorBinary() {
+    flushResponses();
 }
 
 void CommandProcessorBinary::sendDebugToHost(char * str) {
@@ -69,6 +133,46 @@ void CommandProcessorBinary::sendDebugToHost(const char * str) {
 }
 
 
+/*
+ * Add a record (code, length, data) to the response buffer. If the data will
+ * not fit, the buffer is written out with the header at the end of it and the
+ * data follows in a second write.
+ */
+void CommandProcessorBinary::queueResponse(int msgCode, int len, const void * data) {
+    queueResponseHeader(msgCode, len);
+    queueResponseData(data, len);
+}
+
+// A record header, for data that is queued in more than one piece.
+void CommandProcessorBinary::queueResponseHeader(int msgCode, int len) {
+    if ( responseLength + 3 > RESPONSE_BUFFER_SIZE )
+        flushResponses();
+
+    responseBuffer[responseLength++] = msgCode;
+    responseBuffer[responseLength++] = len>>8 & 0xff;
+    responseBuffer[responseLength++] = len & 0xff;
+}
+
+void CommandProcessorBinary::queueResponseData(const void * data, int len) {
+    if ( len <= 0 )
+        return;
+
+    if ( responseLength + len <= RESPONSE_BUFFER_SIZE ) {
+        memcpy(responseBuffer + responseLength, data, len);
+        responseLength += len;
+    } else {
+        flushResponses();
+        this->useSerial->write((const uint8_t *)data, len);
+    }
+}
+
+void CommandProcessorBinary::flushResponses(void) {
+    if ( responseLength == 0 )
+        return;
+    this->useSerial->write(responseBuffer, responseLength);
+    responseLength = 0;
+}
+
 void CommandProcessorBinary::putCommand(int code, int length) {
     this->commandCode = code;
     this->commandDataLength = length;
@@ -79,20 +183,31 @@ void CommandProcessorBinary::putCommand(int code, int length) {
 
 
 
+/*
+ * Wait for the next command from the host, working through the poll list (if
+ * one is loaded) meanwhile. Once the command code has arrived, the rest of the
+ * header must follow within RECEIVE_TIMEOUT or the command is taken as
+ * CMD_UNKNOWN.
+ */
 void CommandProcessorBinary::getCommand() {
-    int cmd;
-    int cmdlen;
+    uint8_t header[3];
 
-    cmd = this->serialRead();
+    while ( serialReadAvailable(header, 1) < 1 ) {
+        if ( pollListLength > 0 )
+            pollNext();
+        else
+            serialIdle();
+    }
     this->lastDataReceivedTime = millis();
-    if ( cmd >= 0 ) {
-        cmdlen = this->serialRead();
-        cmdlen <<= 8;
-        cmdlen |= this->serialRead();
+
+    if ( serialReadBytes(header + 1, 2, RECEIVE_TIMEOUT) < 2 ) {
+        this->commandCode = CMD_UNKNOWN;
+        this->commandDataLength = 0;
+        return;
     }
 
-    this->commandCode = cmd;
-    this->commandDataLength = cmdlen;
+    this->commandCode = header[0];
+    this->commandDataLength = header[1] << 8 | header[2];
 }
 
 int CommandProcessorBinary::getCommandCode() {
@@ -104,39 +219,760 @@ int CommandProcessorBinary::getCommandDataLength() {
 }
 
 
-void CommandProcessorBinary::copyCommandDataToSender() {
-    int i;
-    int data;
-    int cmdlen = this->commandDataLength;
+/*
+ * Load the send buffer with the command data, taking it from the host in lots
+ * of up to SERIAL_INGEST_CHUNK bytes. Returns false if the host stopped sending
+ * for RECEIVE_TIMEOUT before it was all there.
+ */
+bool CommandProcessorBinary::copyCommandDataToSender() {
+    uint8_t chunk[SERIAL_INGEST_CHUNK];
+    int remaining = this->commandDataLength;
 
     this->sendEngine->clearBuffer();
     this->sendEngine->addByte(BSC_CONTROL_PAD);
     this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
     this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
     this->sendEngine->addByte(BSC_CONTROL_SYN);
-    for (i = 0; i < cmdlen; i++) {
-        data = this->serialRead();
-        if (data >= 0) {
-            // sprintf(printbuff, "     Adding byte %d to send-buffer", data);
-            // sendDebug(printbuff);
-            sendEngine->addByte(data);
+    while ( remaining > 0 ) {
+        int len = serialReadBytes(chunk, min(remaining, SERIAL_INGEST_CHUNK), RECEIVE_TIMEOUT);
+        for ( int x = 0; x < len; x++ )
+            sendEngine->addByte(chunk[x]);
+        if ( len < min(remaining, SERIAL_INGEST_CHUNK) ) {
+            this->sendEngine->clearBuffer();
+            return false;
         }
+        remaining -= len;
     }
     sendEngine->addByte(BSC_CONTROL_PAD);
+    return true;
 }
 
 
+/*
+ * Send the command data to the line as it arrives from the host, rather than
+ * reading it all into the send buffer first, so it is not limited to
+ * DATABUFF_MAX_DATA bytes.
+ *
+ * The host may only send as many bytes as it has been given credit for. Credit
+ * is granted with records of ...
+ *
+ *   cmd|0xA0  00 02  creditHi creditLo
+ *
+ * and never covers more than the free space in the send stream ring, so the
+ * host cannot overrun it. The line is started once STREAM_START_THRESHOLD bytes
+ * are queued (or all of them, if fewer) so that it is not then starved. When
+ * all the data has gone out the final record is ...
+ *
+ *   cmd|0x80  00 02  underrunsHi underrunsLo
+ *
+ * with the error bit set if the ring ever ran dry mid block (idle characters
+ * will have been sent, or the block ended with DLE ENQ, see
+ * SendEngine::nextStreamByte()), or the timeout bit if the host stopped
+ * sending for RECEIVE_TIMEOUT while holding credit.
+ */
+void CommandProcessorBinary::streamCommandDataToSender() {
+    uint8_t chunk[SERIAL_INGEST_CHUNK];
+    int respCode = CMD_WRITE_STREAM | CMD_RESPONSE_MASK;
+    unsigned int remaining = this->commandDataLength;
+    unsigned int credit = 0;
+    bool sending = false;
+    bool trailerQueued = false;
+    unsigned long lastActivity = millis();
+
+    this->sendEngine->clearBuffer();
+    this->sendEngine->addByte(BSC_CONTROL_PAD);
+    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
+    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
+    this->sendEngine->addByte(BSC_CONTROL_SYN);
+    sendEngine->startStream();
+
+    while ( true ) {
+        bool received = false;
+        int len;
+
+        while ( credit > 0 &&
+                (len = serialReadAvailable(chunk, min(credit, (unsigned int)SERIAL_INGEST_CHUNK))) > 0 ) {
+            for ( int x = 0; x < len; x++ )
+                sendEngine->putStream(chunk[x]);
+            credit -= len;
+            remaining -= len;
+            received = true;
+        }
+        if ( received )
+            lastActivity = millis();
+
+        if ( remaining == 0 && !trailerQueued && sendEngine->putStream(BSC_CONTROL_PAD) ) {
+            sendEngine->endStream();
+            trailerQueued = true;
+        }
+
+        // Only what is not already covered by credit can be granted.
+        unsigned int room = sendEngine->getStreamFree();
+        if ( remaining > credit && room > credit ) {
+            unsigned int grant = min(room - credit, remaining - credit);
+            if ( credit == 0 || grant >= STREAM_CREDIT_STEP ) {
+                sendResponse(respCode | CMD_RESPONSE_MORE, grant);
+                credit += grant;
+                lastActivity = millis();
+            }
+        }
+
+        if ( !sending &&
+             ( trailerQueued || sendEngine->getStreamCount() >= STREAM_START_THRESHOLD ) ) {
+            sendEngine->startSending();
+            sendEngine->stopSendingOnIdle();
+            sending = true;
+        }
+
+        if ( sending && trailerQueued && sendEngine->xmitState == SEND_STATE_OFF )
+            break;
+
+        if ( remaining > 0 && millis() - lastActivity > RECEIVE_TIMEOUT ) {
+            sendEngine->stopSending();
+            sendEngine->clearBuffer();
+            respCode |= CMD_RESPONSE_TIMEOUT;
+            break;
+        }
+
+        if ( !received )
+            serialIdle();
+    }
+
+    unsigned int underruns = sendEngine->getStreamUnderruns();
+    if ( underruns > 0 )
+        respCode |= ERROR_BIT;
+    sendResponse(respCode, underruns);
+}
+
+// A frame that failed the BCC check or was given up part way.
+static bool frameInError(DataBuffer *frame) {
+    return frame->getBccStatus() == FRAME_BCC_BAD || frame->getBccStatus() == FRAME_ABORTED;
+}
+
+/*
+ * Forward the frame being received to the host as it arrives, rather than
+ * waiting for it to complete. The frame is sent as any number of records
+ * flagged with CMD_RESPONSE_MORE, each up to STREAM_CHUNK_SIZE bytes, followed
+ * by a final status record ...
+ *
+ *   cmd|0x80 (|0x10 on timeout)  00 04  terminator bccStatus lenHi lenLo
+ *
+ * The terminator is the control character that ended the text (ETX, ETB, ENQ
+ * ...) or 0 if there was none, bccStatus is the FRAME_BCC_xxx result or
+ * FRAME_ABORTED (the error bit is also set if it is either) and len is the total number of frame bytes sent.
+ * As only the bytes not yet forwarded are held by the ReceiveEngine, the frame
+ * is not limited to DATABUFF_MAX_DATA bytes. It times out as receiveFrame()
+ * does (see setReplyDeadline() and ReceiveEngine::replyTimedOut()), counting
+ * from the last data forwarded so that a frame longer than a text block is not
+ * cut off part way.
+ */
+void CommandProcessorBinary::streamReceivedFrame(int cmd) {
+    uint8_t chunk[STREAM_CHUNK_SIZE];
+    uint8_t status[4];
+    int pending = 0;
+    int taken;
+    unsigned int total = 0;
+    uint8_t terminator = 0;
+    uint8_t bccStatus = FRAME_BCC_UNCHECKED;
+    int respCode = cmd | CMD_RESPONSE_MASK;
+    unsigned long lastActivity = millis();
+    unsigned long pendingSince = lastActivity;
+    ReplyDeadline deadline;
+
+    setReplyDeadline(&deadline, REPLY_TEXT, commandReadTimeout);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while ( true ) {
+        receiveEngine->drain();
+
+        if ( receiveEngine->isFrameComplete() ) {
+            DataBuffer * frame = receiveEngine->getSavedFrame();
+            terminator = receiveEngine->getSavedFrameTerminator();
+            bccStatus = frame->getBccStatus();
+            if ( frameInError(frame) )
+                respCode |= ERROR_BIT;
+            if ( pending > 0 ) {
+                sendResponse(respCode | CMD_RESPONSE_MORE, pending, chunk);
+                total += pending;
+                pending = 0;
+            }
+            uint8_t * data = (uint8_t *)frame->getData();
+            for ( int x = 0; x < frame->getLength(); x += STREAM_CHUNK_SIZE ) {
+                int len = min(frame->getLength() - x, STREAM_CHUNK_SIZE);
+                sendResponse(respCode | CMD_RESPONSE_MORE, len, data + x);
+                total += len;
+            }
+            break;
+        }
+
+        taken = receiveEngine->takeReceivedData(chunk + pending, STREAM_CHUNK_SIZE - pending);
+        if ( taken > 0 ) {
+            if ( pending == 0 )
+                pendingSince = millis();
+            pending += taken;
+            lastActivity = millis();
+        }
+
+        if ( pending == STREAM_CHUNK_SIZE ||
+             ( pending > 0 && millis() - pendingSince >= STREAM_FLUSH_MS ) ) {
+            sendResponse(respCode | CMD_RESPONSE_MORE, pending, chunk);
+            total += pending;
+            pending = 0;
+        }
+
+        if ( receiveEngine->replyTimedOut(&deadline, millis() - lastActivity) ) {
+            if ( pending > 0 ) {
+                sendResponse(respCode | CMD_RESPONSE_MORE, pending, chunk);
+                total += pending;
+            }
+            respCode |= CMD_RESPONSE_TIMEOUT;
+            break;
+        }
+
+        // Nothing new, so sleep until the next interrupt as
+        // ReceiveEngine::waitReceivedFrameComplete() does. Interrupts are held
+        // off from the check to the sleep so a byte arriving in between still
+        // wakes it.
+        if ( taken == 0 ) {
+            noInterrupts();
+            if ( !receiveEngine->isFrameComplete() && receiveEngine->getFrameLength() == 0 ) {
+                sleep_enable();
+                interrupts();
+                sleep_cpu();
+                sleep_disable();
+            } else {
+                interrupts();
+            }
+        }
+    }
+
+    status[0] = terminator;
+    status[1] = bccStatus;
+    status[2] = (total >> 8) & 0xff;
+    status[3] = total & 0xff;
+    sendResponse(respCode, sizeof(status), status);
+}
+
+/*
+ * Change a setting. The command data is the option followed by its value ...
+ *
+ *   CONFIG_AUTO_BCC     0/1   SendEngine adds the BCC to written blocks
+ *   CONFIG_NAK_RETRIES  n     NAK a frame with a bad BCC and read it again, up to n times
+ *   CONFIG_BIT_RATE     n     Line bit rate lineBitRates[n], see configureBitRate()
+ *   CONFIG_READ_TIMEOUT n     Wait n x 100ms for a reply. 0 (the default) works it out
+ *                             from the bit rate, see setReplyDeadline()
+ *   CONFIG_NEXT_TIMEOUT n     As CONFIG_READ_TIMEOUT, for the next command only
+ *   CONFIG_TURNAROUND   n     Time in ms a device takes to start its reply
+ *   CONFIG_ABORT_MARK   n     Give up a frame after n bytes of mark, 0 never (see
+ *                             ReceiveEngine::setAbortMarkBytes())
+ *
+ * The response has the error bit set if the option or value is not valid.
+ */
+void CommandProcessorBinary::configure() {
+    int option = -1;
+    int value = -1;
+    int respCode = CMD_CONFIG | CMD_RESPONSE_MASK;
+
+    if ( this->commandDataLength >= 1 )
+        option = this->serialRead();
+    if ( this->commandDataLength >= 2 )
+        value = this->serialRead();
+    for ( int x = 2; x < this->commandDataLength; x++ )
+        this->serialRead();
+
+    switch ( option ) {
+        case CONFIG_AUTO_BCC:
+            if ( value < 0 ) {
+                respCode |= ERROR_BIT;
+                break;
+            }
+            sendEngine->setAutoBcc( value ? true : false );
+            break;
+
+        case CONFIG_NAK_RETRIES:
+            if ( value < 0 ) {
+                respCode |= ERROR_BIT;
+                break;
+            }
+            nakRetries = value;
+            break;
+
+        case CONFIG_BIT_RATE:
+            configureBitRate(value);
+            return;
+
+        case CONFIG_READ_TIMEOUT:
+        case CONFIG_NEXT_TIMEOUT:
+        case CONFIG_TURNAROUND:
+            if ( value < 0 ) {
+                respCode |= ERROR_BIT;
+                break;
+            }
+            if ( option == CONFIG_READ_TIMEOUT )
+                readTimeout = value * 100;
+            else if ( option == CONFIG_NEXT_TIMEOUT )
+                nextReadTimeout = value * 100;
+            else
+                turnaroundMs = value;
+            break;
+
+        case CONFIG_ABORT_MARK:
+            if ( value < 0 || value == 1 ) {
+                respCode |= ERROR_BIT;
+                break;
+            }
+            receiveEngine->setAbortMarkBytes(value);
+            break;
+
+        default:
+            respCode |= ERROR_BIT;
+            break;
+    }
+    sendResponse(respCode);
+}
+
+static uint8_t * putWord(uint8_t *p, unsigned int value) {
+    *p++ = value >> 8 & 0xff;
+    *p++ = value & 0xff;
+    return p;
+}
+
+static uint8_t * putLong(uint8_t *p, unsigned long value) {
+    p = putWord(p, value >> 16);
+    return putWord(p, value);
+}
+
+/*
+ * Change the line bit rate. The response data is what the line runs at now ...
+ *
+ *   bit rate (4 bytes)  bit period in ns (4 bytes)  error in ppm (4 bytes, signed)
+ *
+ * or, with the error bit, the LINE_RATE_xxx reason it was refused (the line is
+ * not idle, the interrupt routine would not keep up ...).
+ */
+void CommandProcessorBinary::configureBitRate(int index) {
+    int respCode = CMD_CONFIG | CMD_RESPONSE_MASK;
+    LineRateInfo info;
+    uint8_t data[12];
+    int result;
+
+    if ( index < 0 || index >= LINE_BIT_RATE_COUNT )
+        result = LINE_RATE_UNSUPPORTED;
+    else
+        result = syncControl->setBitRate(lineBitRates[index], &info);
+
+    if ( result != LINE_RATE_OK ) {
+        data[0] = result;
+        sendResponse(respCode | ERROR_BIT, 1, data);
+        return;
+    }
+
+    uint8_t *p = putLong(data, info.bitRate);
+    p = putLong(p, info.bitPeriodNs);
+    putLong(p, info.errorPpm);
+    sendResponse(respCode, sizeof(data), data);
+}
+
+/*
+ * The line statistics (see LineStats), as big endian words and longs ...
+ *
+ *   interrupts (4)  late (4)  missed (4)  period cycles (2)
+ *   phase 0 min avg max cycles (2 each) ... phase 3
+ *   bits sent per second (4)  bits received per second (4)
+ *
+ * A data byte of 1 clears them once read. The error bit is set, with no data,
+ * if the line does not keep statistics.
+ */
+void CommandProcessorBinary::sendStats() {
+    LineStats stats;
+    uint8_t data[14 + LINE_STATS_PHASES * 6 + 8];
+    bool clear = false;
+
+    if ( this->commandDataLength >= 1 )
+        clear = this->serialRead() ? true : false;
+    discardCommandData(this->commandDataLength - 1);
+
+    if ( !syncControl->getStats(&stats, clear) ) {
+        sendResponse(CMD_STATS | CMD_RESPONSE_MASK | ERROR_BIT);
+        return;
+    }
+
+    uint8_t *p = putLong(data, stats.interrupts);
+    p = putLong(p, stats.lateInterrupts);
+    p = putLong(p, stats.missedInterrupts);
+    p = putWord(p, stats.periodCycles);
+    for ( int x = 0; x < LINE_STATS_PHASES; x++ ) {
+        p = putWord(p, stats.phaseCyclesMin[x]);
+        p = putWord(p, stats.phaseCyclesAvg[x]);
+        p = putWord(p, stats.phaseCyclesMax[x]);
+    }
+    p = putLong(p, stats.bitsSentPerSecond);
+    putLong(p, stats.bitsReceivedPerSecond);
+    sendResponse(CMD_STATS | CMD_RESPONSE_MASK, sizeof(data), data);
+}
+
+/*
+ * Poll and select frames kept on the dongle (see ControlFrameCache.h), so the
+ * host sends an index rather than the whole frame ...
+ *
+ *   CMD_CACHE  00 04  index type cu dv   Load entry index, type CONTROL_FRAME_xxx
+ *   CMD_CACHE  00 01  index              Send it and read the reply
+ *   CMD_CACHE  00 00                     Send EOT
+ *
+ * Loading and EOT have an empty response. Sending has the reply as for
+ * CMD_WRITE_READ ... the frame, with the error bit if it is in error, or
+ * CMD_RESPONSE_TIMEOUT. The error bit with no data means the index or type
+ * is not valid.
+ */
+void CommandProcessorBinary::cacheCommand() {
+    int respCode = CMD_CACHE | CMD_RESPONSE_MASK;
+    uint8_t data[4];
+    int len = this->commandDataLength;
+
+    if ( len != 0 && len != 1 && len != 4 ) {
+        discardCommandData(len);
+        sendResponse(respCode | ERROR_BIT);
+        return;
+    }
+    if ( serialReadBytes(data, len, RECEIVE_TIMEOUT) < len ) {
+        sendResponse(respCode | CMD_RESPONSE_TIMEOUT);
+        return;
+    }
+
+    if ( len == 4 ) {
+        sendResponse(respCode | ( frameCache.load(data[0], data[1], data[2], data[3]) ? 0 : ERROR_BIT ));
+        return;
+    }
+
+    sendEngine->clearBuffer();
+    if ( len == 0 ) {
+        sendEngine->queueFrameRef(ControlFrameCache::eotFrame, CONTROL_EOT_FRAME_LEN);
+        sendEngine->waitForSendIdle();
+        sendResponse(respCode);
+        return;
+    }
+
+    const uint8_t * frame = frameCache.getFrame(data[0]);
+    if ( frame == NULL ) {
+        sendResponse(respCode | ERROR_BIT);
+        return;
+    }
+    sendEngine->queueFrameRef(frame, CONTROL_FRAME_LEN);
+    sendEngine->waitForSendIdle();
+
+    receiveEngine->startReceiving();
+    DataBuffer * reply = receiveFrame(frameCache.getType(data[0]) == CONTROL_FRAME_POLL ?
+                                      REPLY_TEXT : REPLY_CONTROL);
+    if ( reply == NULL ) {
+        sendResponse(respCode | CMD_RESPONSE_TIMEOUT);
+    } else {
+        sendResponse(respCode | ( frameInError(reply) ? ERROR_BIT : 0 ),
+                     reply->getLength(), reply->getData());
+    }
+}
+
+/*
+ * Wait for the frame being received. A frame that fails the BCC check is NAKed
+ * straight away, for the station to send it again, up to nakRetries times.
+ * Returns the frame, or NULL on timeout.
+ */
+DataBuffer * CommandProcessorBinary::receiveFrame(uint8_t replyClass) {
+    int retries = nakRetries;
+    ReplyDeadline deadline;
+
+    setReplyDeadline(&deadline, replyClass, commandReadTimeout);
+    while ( true ) {
+        if ( receiveEngine->waitReceivedFrameComplete(&deadline) < 0 )
+            return NULL;
+
+        DataBuffer * frame = receiveEngine->getSavedFrame();
+        if ( !frameInError(frame) || retries-- <= 0 )
+            return frame;
+
+        sendDebug("BCC check failed ... sending NAK");
+        sendNak();
+    }
+}
+
+// PAD LEADING_PAD LEADING_PAD SYN SYN data... PAD, waiting for it to go.
+void CommandProcessorBinary::sendControlFrame(const uint8_t * data, int len) {
+    sendEngine->clearBuffer();
+    sendEngine->addByte(BSC_CONTROL_PAD);
+    sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
+    sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
+    sendEngine->addByte(BSC_CONTROL_SYN);
+    sendEngine->addByte(BSC_CONTROL_SYN);
+    for ( int x = 0; x < len; x++ )
+        sendEngine->addByte(data[x]);
+    sendEngine->addByte(BSC_CONTROL_PAD);
+
+    sendEngine->startSending();
+    sendEngine->stopSendingOnIdle();
+    sendEngine->waitForSendIdle();
+}
+
+// As sendControlFrame(), behind anything already on its way (see
+// SendEngine::queueFrame()) and without waiting.
+bool CommandProcessorBinary::queueControlFrame(const uint8_t * data, int len) {
+    uint8_t frame[SEND_QUEUE_FRAME_MAX];
+    int pos = 0;
+
+    if ( len > SEND_QUEUE_FRAME_MAX - 6 )
+        return false;
+    frame[pos++] = BSC_CONTROL_PAD;
+    frame[pos++] = BSC_CONTROL_LEADING_PAD;
+    frame[pos++] = BSC_CONTROL_LEADING_PAD;
+    frame[pos++] = BSC_CONTROL_SYN;
+    frame[pos++] = BSC_CONTROL_SYN;
+    memcpy(frame + pos, data, len);
+    pos += len;
+    frame[pos++] = BSC_CONTROL_PAD;
+    return sendEngine->queueFrame(frame, pos);
+}
+
+void CommandProcessorBinary::sendNak() {
+    static const uint8_t nak[] = { BSC_CONTROL_NAK };
+
+    sendControlFrame(nak, sizeof(nak));
+    receiveEngine->startReceiving();
+}
+
+// DLE ACK1 and DLE ACK0 in turn.
+void CommandProcessorBinary::sendAck() {
+    uint8_t ack[] = { BSC_CONTROL_DLE, nextAck };
+
+    sendControlFrame(ack, sizeof(ack));
+    nextAck = ( nextAck == BSC_CONTROL_ACK1 ) ? BSC_CONTROL_ACK0 : BSC_CONTROL_ACK1;
+}
+
+/*
+ * Read a transmission of one or more blocks (CMD_READ_MULTI). Each good text
+ * block is acknowledged here, before it is passed on to the host as ...
+ *
+ *   CMD_READ_MULTI|0x80|CMD_RESPONSE_MORE  lenHi lenLo  frame...
+ *
+ * and the station goes on with the next block. The last record is the frame
+ * that was not text, normally the EOT after the last block ...
+ *
+ *   CMD_READ_MULTI|0x80  lenHi lenLo  frame...
+ *
+ * or a block still failing the BCC check after nakRetries NAKs, with the error
+ * bit and not acknowledged, or CMD_RESPONSE_TIMEOUT with no data. ACK parity
+ * carries on from there, so the host can pick up the transmission with another
+ * CMD_READ_MULTI with no data.
+ */
+void CommandProcessorBinary::readBlocks() {
+    while ( true ) {
+        DataBuffer * frame = receiveFrame();
+        if ( frame == NULL ) {
+            receiveEngine->getDataBuffer();
+            sendResponse(CMD_READ_MULTI | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+            return;
+        }
+
+        uint8_t terminator = receiveEngine->getSavedFrameTerminator();
+        bool bad = frameInError(frame);
+        if ( bad || ( terminator != BSC_CONTROL_ETB && terminator != BSC_CONTROL_ETX ) ) {
+            if ( terminator == BSC_CONTROL_EOT )
+                nextAck = BSC_CONTROL_ACK1;
+            sendResponse(CMD_READ_MULTI | CMD_RESPONSE_MASK | ( bad ? ERROR_BIT : 0 ),
+                         frame->getLength(), frame->getData());
+            return;
+        }
+
+        // The frame stays put until more have been received, so the next
+        // block can be on its way while this one goes to the host.
+        sendAck();
+        receiveEngine->startReceiving();
+        sendResponse(CMD_READ_MULTI | CMD_RESPONSE_MASK | CMD_RESPONSE_MORE,
+                     frame->getLength(), frame->getData());
+    }
+}
+
+/*
+ * Load the poll list ...
+ *
+ *   CMD_POLL_LIST  lenHi lenLo  cu dev1 dev2 ...
+ *
+ * From then on, whenever there is no command from the host, the devices are
+ * polled in turn with the CU poll address. Only what is not EOT is reported,
+ * as a record with the device address ahead of the frame ...
+ *
+ *   CMD_POLL_LIST|0x80  lenHi lenLo  dev frame...
+ *
+ * with the error bit if the frame failed the BCC check or was cut short
+ * (FRAME_ABORTED), or just the device address with CMD_RESPONSE_TIMEOUT if it
+ * did not answer in time (see CONFIG_READ_TIMEOUT, normally a few tens of ms
+ * for a device that is not there). Text is acknowledged here (ACK1, ACK0 ...)
+ * until the device sends EOT. After anything else, or a timeout, the line is
+ * reset with EOT before the next poll.
+ *
+ * Polling carries on between host commands, a poll at a time, so a host that
+ * wants a select/write conversation of several commands should stop it first
+ * by sending the command with no data. The response has the error bit set if
+ * there is a CU address but no devices, or more than POLL_LIST_MAX of them.
+ */
+void CommandProcessorBinary::loadPollList() {
+    uint8_t list[POLL_LIST_MAX + 1];
+    int len = this->commandDataLength;
+
+    pollListLength = 0;
+    pollListNext = 0;
+    pollListReset = true;
+
+    if ( len == 1 || len > (int)sizeof(list) ) {
+        discardCommandData(len);
+        sendResponse(CMD_POLL_LIST | CMD_RESPONSE_MASK | ERROR_BIT);
+        return;
+    }
+    if ( serialReadBytes(list, len, RECEIVE_TIMEOUT) < len ) {
+        sendResponse(CMD_POLL_LIST | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+        return;
+    }
+
+    if ( len > 0 ) {
+        pollListCu = list[0];
+        memcpy(pollList, list + 1, len - 1);
+        pollListLength = len - 1;
+    }
+    sendResponse(CMD_POLL_LIST | CMD_RESPONSE_MASK);
+}
+
+// Poll the next device on the poll list and deal with what it sends.
+void CommandProcessorBinary::pollNext() {
+    static const uint8_t eot[] = { BSC_CONTROL_EOT };
+    uint8_t dev = pollList[pollListNext];
+    uint8_t poll[] = { pollListCu, pollListCu, dev, dev, BSC_CONTROL_ENQ };
+
+    if ( ++pollListNext >= pollListLength )
+        pollListNext = 0;
+    commandReadTimeout = readTimeout;
+
+    // EOT and the poll go out back to back.
+    sendEngine->clearBuffer();
+    if ( pollListReset ) {
+        queueControlFrame(eot, sizeof(eot));
+        pollListReset = false;
+    }
+    queueControlFrame(poll, sizeof(poll));
+    sendEngine->waitForSendIdle();
+    receiveEngine->startReceiving();
+    nextAck = BSC_CONTROL_ACK1;
+
+    while ( true ) {
+        DataBuffer * frame = receiveFrame(REPLY_TEXT);
+        if ( frame == NULL ) {
+            sendResponse(CMD_POLL_LIST | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT, 1, &dev);
+            pollListReset = true;
+            return;
+        }
+
+        uint8_t terminator = receiveEngine->getSavedFrameTerminator();
+        if ( terminator == BSC_CONTROL_EOT )
+            return;
+
+        bool bad = frameInError(frame);
+        queueResponseHeader(CMD_POLL_LIST | CMD_RESPONSE_MASK | ( bad ? ERROR_BIT : 0 ),
+                            frame->getLength() + 1);
+        queueResponseData(&dev, 1);
+        queueResponseData(frame->getData(), frame->getLength());
+        flushResponses();
+
+        if ( bad || ( terminator != BSC_CONTROL_ETX && terminator != BSC_CONTROL_ETB ) ) {
+            pollListReset = true;
+            return;
+        }
+
+        // Acknowledge the text, and the device goes on with the next block or EOT.
+        sendAck();
+        receiveEngine->startReceiving();
+    }
+}
+
 int freeRam () {
+#ifdef __AVR__
   extern int __heap_start, *__brkval;
   int v;
   return (int) &v - (__brkval == 0 ? (int) &__heap_start : (int) __brkval);
+#else
+  return 0;   // No fixed heap/stack split to measure on the native build.
+#endif
 }
 
 void CommandProcessorBinary::process() {
-
     getCommand();
     // this->sendResponse(0x8C, freeRam());
 
+    if ( this->commandCode == CMD_SEQUENCED )
+        processSequenced();
+    else
+        execute();
+
+    // Whatever the command did to the line, polling starts again from EOT.
+    pollListReset = true;
+}
+
+/*
+ * A command wrapped with a sequence number, so that the host can have several
+ * on their way at once and still tell which responses are for which ...
+ *
+ *   CMD_SEQUENCED  lenHi lenLo  seq  cmd cmdLenHi cmdLenLo  data...
+ *
+ * The command's responses are sent as usual, after a tag record ...
+ *
+ *   CMD_SEQUENCED|0x80  00 01  seq
+ *
+ * What the host sends next waits in the USB serial buffer while a command
+ * runs, so the next command is there to start as soon as this one is done. A
+ * host using sequenced commands must not change command mode while it has any
+ * on their way.
+ *
+ * If the inner command length does not agree with the outer one, the data is
+ * discarded and the response is CMD_SEQUENCED with the error bit.
+ */
+void CommandProcessorBinary::processSequenced() {
+    uint8_t header[4];
+    int outerLength = this->commandDataLength;
+    int got;
+
+    got = serialReadBytes(header, min(outerLength, (int)sizeof(header)), RECEIVE_TIMEOUT);
+    if ( got < (int)sizeof(header) ||
+         header[1] == CMD_SEQUENCED ||
+         (header[2] << 8 | header[3]) != outerLength - (int)sizeof(header) ) {
+        if ( got == min(outerLength, (int)sizeof(header)) )
+            discardCommandData(outerLength - got);
+        sendResponse(CMD_SEQUENCED | CMD_RESPONSE_MASK | ERROR_BIT);
+        return;
+    }
+
+    this->commandCode = header[1];
+    this->commandDataLength = outerLength - sizeof(header);
+    queueResponse(CMD_SEQUENCED | CMD_RESPONSE_MASK, 1, &header[0]);
+
+    execute();
+}
+
+// Skip command data that is not going to be used.
+void CommandProcessorBinary::discardCommandData(int len) {
+    uint8_t chunk[SERIAL_INGEST_CHUNK];
+
+    while ( len > 0 ) {
+        int got = serialReadBytes(chunk, min(len, SERIAL_INGEST_CHUNK), RECEIVE_TIMEOUT);
+        if ( got == 0 )
+            break;
+        len -= got;
+    }
+}
+
+void CommandProcessorBinary::execute() {
+    DataBuffer * frame;
+
+    // A CONFIG_NEXT_TIMEOUT is for the command after it.
+    commandReadTimeout = readTimeout;
+    if ( this->commandCode != CMD_CONFIG && nextReadTimeout >= 0 ) {
+        commandReadTimeout = nextReadTimeout;
+        nextReadTimeout = -1;
+    }
+
     switch(this->commandCode) {
         case CMD_RESET:
             // sendDebug("RESET command starting");
@@ -162,7 +998,10 @@ void CommandProcessorBinary::process() {
             break;
 
         case CMD_WRITE:
-            copyCommandDataToSender();
+            if ( !copyCommandDataToSender() ) {
+                sendResponse(CMD_WRITE | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+                break;
+            }
 
             sendEngine->startSending();
             sendEngine->stopSendingOnIdle();
@@ -176,7 +1015,10 @@ void CommandProcessorBinary::process() {
             break;
 
         case CMD_WRITE_READ:
-            copyCommandDataToSender();
+            if ( !copyCommandDataToSender() ) {
+                sendResponse(CMD_WRITE_READ | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+                break;
+            }
 
             sendEngine->startSending();
             sendEngine->stopSendingOnIdle();
@@ -190,26 +1032,86 @@ void CommandProcessorBinary::process() {
             receiveEngine->startReceiving();
             sendDebug("Reading response ...");
 
-            if ( receiveEngine->waitReceivedFrameComplete(RECEIVE_TIMEOUT) < 0 ) {
+            frame = receiveFrame();
+            if ( frame == NULL ) {
                 receiveEngine->getDataBuffer();
                 sendResponse(CMD_WRITE_READ | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
             } else {
-                DataBuffer * frame = receiveEngine->getSavedFrame();
-                sendResponse(CMD_WRITE_READ | CMD_RESPONSE_MASK,
+                sendResponse(CMD_WRITE_READ | CMD_RESPONSE_MASK |
+                    ( frameInError(frame) ? ERROR_BIT : 0 ),
                     frame->getLength(), frame->getData());
             }
             break;
 
-        case CMD_READ:
+        case CMD_READ_STREAM:
+            // With data, this is a write followed by the streamed read.
+            if ( this->commandDataLength > 0 ) {
+                if ( !copyCommandDataToSender() ) {
+                    sendResponse(CMD_READ_STREAM | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+                    break;
+                }
+
+                sendEngine->startSending();
+                sendEngine->stopSendingOnIdle();
+                sendEngine->waitForSendIdle();
+            }
+
+            receiveEngine->startReceiving();
+            streamReceivedFrame(CMD_READ_STREAM);
+            break;
+
+        case CMD_WRITE_STREAM:
+            streamCommandDataToSender();
+            break;
+
+        case CMD_CONFIG:
+            configure();
+            break;
+
+        case CMD_POLL_LIST:
+            loadPollList();
+            break;
+
+        case CMD_STATS:
+            sendStats();
+            break;
+
+        case CMD_CACHE:
+            cacheCommand();
+            break;
+
+        case CMD_READ_MULTI:
+            // With data, this is a write (normally a poll) starting a new
+            // transmission, followed by the read.
+            if ( this->commandDataLength > 0 ) {
+                if ( !copyCommandDataToSender() ) {
+                    sendResponse(CMD_READ_MULTI | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
+                    break;
+                }
+
+                sendEngine->startSending();
+                sendEngine->stopSendingOnIdle();
+                sendEngine->waitForSendIdle();
+                nextAck = BSC_CONTROL_ACK1;
+            }
+
             receiveEngine->startReceiving();
+            readBlocks();
+            break;
+
+        case CMD_READ:
+            // The reply to an earlier CMD_WRITE may be in already.
+            if ( receiveEngine->getQueuedFrames() == 0 )
+                receiveEngine->startReceiving();
             sendDebug("Reading response ...");
 
-            if ( receiveEngine->waitReceivedFrameComplete(RECEIVE_TIMEOUT) < 0 ) {
+            frame = receiveFrame();
+            if ( frame == NULL ) {
                 receiveEngine->getDataBuffer();
                 sendResponse(CMD_READ | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT);
             } else {
-                DataBuffer * frame = receiveEngine->getSavedFrame();
-                sendResponse(CMD_READ | CMD_RESPONSE_MASK,
+                sendResponse(CMD_READ | CMD_RESPONSE_MASK |
+                    ( frameInError(frame) ? ERROR_BIT : 0 ),
                     frame->getLength(), frame->getData());
             }
             break;
@@ -231,11 +1133,12 @@ unsigned long CommandProcessorBinary::getAndProcessCommand() {
 CommandProcessorText::CommandProcessorText(
     SendEngine * sEng,
     ReceiveEngine * rEng,
-    SyncControl * syncCntrl  ) : CommandProcessor(sEng, rEng, syncControl) {
+    SyncControl * syncCntrl  ) : CommandProcessor(sEng, rEng, syncCntrl) {
     addressCuPoll = 0x40;
     addressCuSelect = 0x60;
     addressDevice = 0x40;
     addressSet = true;
+    cacheAddresses();
 }
 
 CommandProcessorText::~CommandProcessorText() {
@@ -300,6 +1203,12 @@ int CommandProcessorText::readCommand() {
     if ( !strcmp(command,"MEM") )
         return TXT_CMD_MEM;
 
+    if ( !strcmp(command,"RATE") )
+        return TXT_CMD_RATE;
+
+    if ( !strcmp(command,"STATS") )
+        return TXT_CMD_STATS;
+
     if ( !strcmp(command,"HELP") || !strcmp(command,"?") )
         return TXT_CMD_HELP;
 
@@ -341,6 +1250,21 @@ int CommandProcessorText::getCommandParamHexadecimal() {
     return hexValue;
 }
 
+long CommandProcessorText::getCommandParamDecimal() {
+    char * parmStr = strtok(NULL, ",");
+    long value = 0;
+
+    if ( parmStr == NULL )
+        return -1;
+    for ( ; *parmStr == ' '; parmStr++ )
+        ;
+    if ( !isdigit(*parmStr) )
+        return -1;
+    for ( ; isdigit(*parmStr); parmStr++ )
+        value = value * 10 + (*parmStr - '0');
+    return value;
+}
+
 unsigned long CommandProcessorText::getAndProcessCommand() {
     int command;
     int parm1, parm2, parm3;
@@ -363,6 +1287,7 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
                 addressCuPoll = parm1;
                 addressCuSelect = parm2;
                 addressDevice = parm3;
+                cacheAddresses();
             }
             this->addressSet = true;
             break;
@@ -373,7 +1298,7 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
             } else {
                 execReset();
                 execPoll();
-                execRead();
+                execRead(REPLY_TEXT);
             }
             break;
 
@@ -385,7 +1310,7 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
                 execSelect();
                 delay(50);
                 execWrite();
-                execRead();
+                execRead(REPLY_CONTROL);
                 delay(50);
             }
             break;
@@ -394,6 +1319,88 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
             this->useSerial->print(F("Memory has "));
             this->useSerial->print(freeRam());
             this->useSerial->println(F(" bytes."));
+            this->useSerial->print(F("Buffer pool: large "));
+            this->useSerial->print(dataBufferPool.getLargeInUse());
+            this->useSerial->print(F(" in use, max "));
+            this->useSerial->print(dataBufferPool.getLargeHighWater());
+            this->useSerial->print(F(" of "));
+            this->useSerial->print(DATABUFF_POOL_LARGE_BLOCKS);
+            this->useSerial->print(F(", small "));
+            this->useSerial->print(dataBufferPool.getSmallInUse());
+            this->useSerial->print(F(" in use, max "));
+            this->useSerial->print(dataBufferPool.getSmallHighWater());
+            this->useSerial->print(F(" of "));
+            this->useSerial->print(DATABUFF_POOL_SMALL_BLOCKS);
+            this->useSerial->print(F(", "));
+            this->useSerial->print(dataBufferPool.getFailures());
+            this->useSerial->println(F(" failures."));
+            break;
+
+        case TXT_CMD_RATE: {
+                LineRateInfo info;
+                long rate = getCommandParamDecimal();
+                int result = this->syncControl->setBitRate(rate, &info);
+
+                if ( result == LINE_RATE_OK ) {
+                    this->useSerial->print(F("Bit rate "));
+                    this->useSerial->print(info.bitRate);
+                    this->useSerial->print(F(" bps, bit period "));
+                    this->useSerial->print(info.bitPeriodNs);
+                    this->useSerial->print(F(" ns, error "));
+                    this->useSerial->print(info.errorPpm);
+                    this->useSerial->println(F(" ppm."));
+                } else if ( result == LINE_RATE_BUSY ) {
+                    this->useSerial->println(F("ERROR: Line is busy."));
+                } else if ( result == LINE_RATE_TOO_FAST ) {
+                    this->useSerial->println(F("ERROR: Rate is too fast for the interrupt routine."));
+                } else {
+                    this->useSerial->print(F("ERROR: Rate must be one of"));
+                    for ( int x = 0; x < LINE_BIT_RATE_COUNT; x++ ) {
+                        this->useSerial->print(' ');
+                        this->useSerial->print(lineBitRates[x]);
+                    }
+                    this->useSerial->println('.');
+                }
+            }
+            break;
+
+        case TXT_CMD_STATS: {
+                LineStats stats;
+
+                // STATS 1 clears them once shown.
+                if ( !this->syncControl->getStats(&stats, getCommandParamDecimal() > 0) ) {
+                    this->useSerial->println(F("ERROR: No statistics for this line."));
+                    break;
+                }
+                this->useSerial->print(F("Interrupts "));
+                this->useSerial->print(stats.interrupts);
+                this->useSerial->print(F(", late "));
+                this->useSerial->print(stats.lateInterrupts);
+                this->useSerial->print(F(", missed "));
+                this->useSerial->print(stats.missedInterrupts);
+                this->useSerial->print(F(", every "));
+                this->useSerial->print(stats.periodCycles);
+                this->useSerial->println(F(" cycles."));
+                for ( int x = 0; x < LINE_STATS_PHASES; x++ ) {
+                    this->useSerial->print(F("Phase "));
+                    this->useSerial->print(x);
+                    this->useSerial->print(F(" cycles min "));
+                    this->useSerial->print(stats.phaseCyclesMin[x]);
+                    this->useSerial->print(F(", avg "));
+                    this->useSerial->print(stats.phaseCyclesAvg[x]);
+                    this->useSerial->print(F(", max "));
+                    this->useSerial->println(stats.phaseCyclesMax[x]);
+                }
+                this->useSerial->print(F("Sent "));
+                this->useSerial->print(stats.bitsSentPerSecond);
+                this->useSerial->print(F(" bps ("));
+                this->useSerial->print(stats.bitsSentPerSecond / 8);
+                this->useSerial->print(F(" bytes/s), received "));
+                this->useSerial->print(stats.bitsReceivedPerSecond);
+                this->useSerial->print(F(" bps ("));
+                this->useSerial->print(stats.bitsReceivedPerSecond / 8);
+                this->useSerial->println(F(" bytes/s)."));
+            }
             break;
 
         case TXT_CMD_RESET:
@@ -416,6 +1423,8 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
             this->useSerial->println(F("WRITE"));
             this->useSerial->println(F("RESET"));
             this->useSerial->println(F("MEM"));
+            this->useSerial->println(F("RATE bps"));
+            this->useSerial->println(F("STATS [1 to clear]"));
             this->useSerial->println(F("BIN\n"));
             break;
 
@@ -428,76 +1437,43 @@ unsigned long CommandProcessorText::getAndProcessCommand() {
 
 
 
+void CommandProcessorText::cacheAddresses(void) {
+    frameCache.load(TXT_CACHE_POLL, CONTROL_FRAME_POLL, addressCuPoll, addressDevice);
+    frameCache.load(TXT_CACHE_SELECT, CONTROL_FRAME_SELECT, addressCuSelect, addressDevice);
+}
+
+void CommandProcessorText::sendCachedFrame(const uint8_t *frame, uint8_t len) {
+    this->sendEngine->clearBuffer();
+    this->sendEngine->queueFrameRef(frame, len);
+    this->sendEngine->waitForSendIdle();
+}
+
 void CommandProcessorText::execReset() {
     // Reset the line ... puts the tributary stations in control mode and listening for
     // a select/poll.
-    this->sendEngine->clearBuffer();
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-    this->sendEngine->addByte(BSC_CONTROL_EOT);
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-
-    sendEngine->startSending();
-    sendEngine->stopSendingOnIdle();
-    sendEngine->waitForSendIdle();
-
+    sendCachedFrame(ControlFrameCache::eotFrame, CONTROL_EOT_FRAME_LEN);
     sendResponse("Sent EOT to tributary stations");
 }
 
 void CommandProcessorText::execPoll() {
     // Send a poll to the device
-    this->sendEngine->clearBuffer();
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-
-    this->sendEngine->addByte(this->addressCuPoll);
-    this->sendEngine->addByte(this->addressCuPoll);
-    this->sendEngine->addByte(this->addressDevice);
-    this->sendEngine->addByte(this->addressDevice);
-
-    this->sendEngine->addByte(BSC_CONTROL_ENQ);
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-
-    sendEngine->startSending();
-    sendEngine->stopSendingOnIdle();
-    sendEngine->waitForSendIdle();
-
+    sendCachedFrame(frameCache.getFrame(TXT_CACHE_POLL), CONTROL_FRAME_LEN);
     sendResponse("Sent poll to specific station/device");
 }
 
 void CommandProcessorText::execSelect() {
     // Send a select to the device
-    this->sendEngine->clearBuffer();
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-    this->sendEngine->addByte(BSC_CONTROL_SYN);
-
-    this->sendEngine->addByte(this->addressCuSelect);
-    this->sendEngine->addByte(this->addressCuSelect);
-    this->sendEngine->addByte(this->addressDevice);
-    this->sendEngine->addByte(this->addressDevice);
-
-    this->sendEngine->addByte(BSC_CONTROL_ENQ);
-    this->sendEngine->addByte(BSC_CONTROL_PAD);
-
-    sendEngine->startSending();
-    sendEngine->stopSendingOnIdle();
-    sendEngine->waitForSendIdle();
-
+    sendCachedFrame(frameCache.getFrame(TXT_CACHE_SELECT), CONTROL_FRAME_LEN);
     sendResponse("Sent select to station/device");
 }
 
 void CommandProcessorText::execWrite() {
-    // Send a select to the device
+    // Send a select to the device, keeping whatever auto BCC setting the
+    // host chose with CONFIG_AUTO_BCC.
+    bool autoBcc = this->sendEngine->getAutoBcc();
+
     this->sendEngine->clearBuffer();
+    this->sendEngine->setAutoBcc(true);
     this->sendEngine->addByte(BSC_CONTROL_PAD);
     this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
     this->sendEngine->addByte(BSC_CONTROL_LEADING_PAD);
@@ -535,11 +1511,10 @@ void CommandProcessorText::execWrite() {
     this->sendEngine->addByte(0x13);        // IC
 
     this->sendEngine->addByte(BSC_CONTROL_DLE);
-    this->sendEngine->addByte(BSC_CONTROL_ETX);
-    this->sendEngine->addByte(0x6C);        // BCC
-    this->sendEngine->addByte(0x16);
+    this->sendEngine->addByte(BSC_CONTROL_ETX);     // BCC added by the SendEngine
 
     this->sendEngine->addByte(BSC_CONTROL_PAD);
+    this->sendEngine->setAutoBcc(autoBcc);
 
     sendEngine->startSending();
     sendEngine->stopSendingOnIdle();
@@ -549,11 +1524,14 @@ void CommandProcessorText::execWrite() {
 
 }
 
-void CommandProcessorText::execRead() {
+void CommandProcessorText::execRead(uint8_t replyClass) {
+    ReplyDeadline deadline;
+
     receiveEngine->startReceiving();
     sendDebug("Reading response ...");
 
-    if ( receiveEngine->waitReceivedFrameComplete(RECEIVE_TIMEOUT) < 0 ) {
+    setReplyDeadline(&deadline, replyClass, 0);
+    if ( receiveEngine->waitReceivedFrameComplete(&deadline) < 0 ) {
         DataBuffer * frame = receiveEngine->getDataBuffer();
         this->useSerial->print(F("Error: Timeout. We have "));
         this->useSerial->print(frame->getLength());
@@ -576,19 +1554,23 @@ void CommandProcessorText::execRead() {
             this->useSerial->print(' ');
         }
         this->useSerial->println(F("**END**"));
+        if ( frame->getBccStatus() == FRAME_ABORTED )
+            this->useSerial->println(F("Error: Line lost part way through the frame"));
+        else if ( frame->getBccStatus() == FRAME_BCC_BAD )
+            this->useSerial->println(F("Error: BCC check failed"));
     }
 
 }
 
-CommandProcessorFrontEnd::CommandProcessorFrontEnd(SyncBitBanger * bitBanger) {
-    this->syncBitBanger = bitBanger;
+CommandProcessorFrontEnd::CommandProcessorFrontEnd(LineBackend * lineBackend) {
+    this->lineBackend = lineBackend;
     //Serial.println(F("Creating SyncControl instance."));
-    this->syncControl = new SyncControl(bitBanger);
+    this->syncControl = new SyncControl(lineBackend);
 
     //Serial.println(F("Creating CommandProcessorBinary instance."));
     cmdProcessor = new CommandProcessorBinary(
-        bitBanger->sendEngine,
-        bitBanger->receiveEngine,
+        lineBackend->sendEngine,
+        lineBackend->receiveEngine,
         syncControl);
     //Serial.println(F("CommandProcessorFrontEnd constructor complete."));
 }
@@ -613,8 +1595,8 @@ unsigned long CommandProcessorFrontEnd::getAndProcessCommand() {
                 //this->cmdProcessor->sendDebugToHost("Switching command mode to binary.");
                 delete this->cmdProcessor;
                 this->cmdProcessor = new CommandProcessorBinary(
-                    this->syncBitBanger->sendEngine,
-                    this->syncBitBanger->receiveEngine,
+                    this->lineBackend->sendEngine,
+                    this->lineBackend->receiveEngine,
                     this->syncControl);
                 break;
 
@@ -622,8 +1604,8 @@ unsigned long CommandProcessorFrontEnd::getAndProcessCommand() {
                 //this->cmdProcessor->sendDebugToHost("Switching command mode to text.");
                 delete this->cmdProcessor;
                 this->cmdProcessor = new CommandProcessorText(
-                    this->syncBitBanger->sendEngine,
-                    this->syncBitBanger->receiveEngine,
+                    this->lineBackend->sendEngine,
+                    this->lineBackend->receiveEngine,
                     this->syncControl);
                 break;
         }
@@ -8,9 +8,10 @@
 #include <Arduino.h>
 #include "DataBuffer.h"
 
-#include "SyncBitBanger.h"
+#include "LineBackend.h"
 #include "SendEngine.h"
 #include "ReceiveEngine.h"
+#include "ControlFrameCache.h"
 
 #include "bsc_protocol.h"
 
@@ -21,11 +22,29 @@
 #define CMD_WRITE   0x01
 #define CMD_READ    0x02
 #define CMD_WRITE_READ    0x03
+#define CMD_READ_STREAM   0x04
+#define CMD_WRITE_STREAM  0x05
+#define CMD_CONFIG        0x06
+#define CMD_POLL_LIST     0x07
+#define CMD_READ_MULTI    0x08
 #define CMD_DEBUG   0x09
+#define CMD_STATS         0x0A
+#define CMD_CACHE         0x0B
+#define CMD_SEQUENCED     0x0E
 #define CMD_RESET   0x0F
 
+// CMD_CONFIG options
+#define CONFIG_AUTO_BCC         0x01
+#define CONFIG_NAK_RETRIES      0x02
+#define CONFIG_BIT_RATE         0x03
+#define CONFIG_READ_TIMEOUT     0x04
+#define CONFIG_NEXT_TIMEOUT     0x05
+#define CONFIG_TURNAROUND       0x06
+#define CONFIG_ABORT_MARK       0x07
+
 #define CMD_RESPONSE_MASK       0x80
 #define CMD_RESPONSE_TIMEOUT    0x10
+#define CMD_RESPONSE_MORE       0x20    // More response records follow for this command
 #define CMD_RESPONSE_ERROR      0x70
 
 #define CMD_TEXTMODE '0'    // 0x30
@@ -35,6 +54,42 @@
 
 #define RECEIVE_TIMEOUT     2000
 
+// Adaptive receive timeouts, used unless a fixed one is configured. A reply must
+// start within the station's turnaround time plus REPLY_LEAD_BYTES byte times,
+// and once started the line must not go back to mark for REPLY_SILENCE_BYTES.
+// The whole reply gets twice the time it would take to send the most its class
+// could be.
+#define REPLY_TURNAROUND_MS     20
+#define REPLY_LEAD_BYTES        8
+#define REPLY_SILENCE_BYTES     4
+
+#define REPLY_CONTROL           0   // ACK, NAK, EOT ..., up to REPLY_CONTROL_BYTES
+#define REPLY_TEXT              1   // A block of text, up to DATABUFF_MAX_DATA
+#define REPLY_CONTROL_BYTES     8
+
+// Autonomous polling (CMD_POLL_LIST) ... up to this many device addresses.
+#define POLL_LIST_MAX       16
+
+// Command data is taken from the host in lots of up to this many bytes, as many
+// as have arrived, rather than a byte at a time.
+#define SERIAL_INGEST_CHUNK 32
+
+// Response records are put together here and written to the host in one call,
+// one USB packet's worth at most. Longer data goes in a second write straight
+// from where it is.
+#define RESPONSE_BUFFER_SIZE    64
+
+// Streaming read (CMD_READ_STREAM) ... received bytes are forwarded to the host
+// once this many have arrived, or STREAM_FLUSH_MS after the first of them.
+#define STREAM_CHUNK_SIZE   64
+#define STREAM_FLUSH_MS     2
+
+// Streaming write (CMD_WRITE_STREAM) ... the line is started once this many bytes
+// are waiting in the send stream ring, and further credit is only granted to the
+// host in steps of at least STREAM_CREDIT_STEP bytes.
+#define STREAM_START_THRESHOLD  64
+#define STREAM_CREDIT_STEP      32
+
 
 /**
  * @brief Process commands from the connected device, host program or terminal
@@ -82,15 +137,42 @@ class CommandProcessor {
 
         void setNewCommandMode(uint8_t newCommandMode);
 
+        // Milliseconds allowed for the station to start its reply, for adaptive
+        // timeouts.
+        uint8_t turnaroundMs;
+
+        // Poll and select frames ready to send.
+        ControlFrameCache frameCache;
+
+        // How long to wait for a reply of replyClass (REPLY_xxx) ... fixedMs,
+        // or worked out from the bit rate if that is 0.
+        void setReplyDeadline(ReplyDeadline *deadline, uint8_t replyClass,
+                              unsigned int fixedMs);
+
         inline int serialRead(void) {
             int val = -1;
             while ( this->useSerial && val < 0 ) {
                 val = this->useSerial->read();
                 if ( val < 0 )
-                    delay(1);
+                    serialIdle();
             }
             return val;
         }
+
+        // Whatever the host has sent so far, up to maxLen bytes, without waiting.
+        int serialReadAvailable(uint8_t *dest, int maxLen);
+        // len bytes from the host, waiting up to timeoutMs for each lot of them.
+        // Returns how many were read, less than len on timeout.
+        int serialReadBytes(uint8_t *dest, int len, unsigned long timeoutMs);
+
+        // Waiting for the host ... keep the deferred receive path moving, and
+        // check again as soon as there is any chance of more data rather than
+        // sleeping for a fixed time.
+        inline void serialIdle(void) {
+            if ( this->receiveEngine )
+                this->receiveEngine->drain();
+            yield();
+        }
 };
 
 
@@ -108,34 +190,29 @@ class CommandProcessorBinary : public CommandProcessor {
         virtual unsigned long getAndProcessCommand();
 
         inline void sendResponse(int msgCode) {
-            this->useSerial->write(msgCode);
-            this->useSerial->write((byte)0);
-            this->useSerial->write((byte)0);
+            queueResponse(msgCode, 0, NULL);
+            flushResponses();
         }
         inline void sendResponse(int msgCode, int len, void * data) {
-            int x;
-            char * bytedata = (char *)data;
-
-            this->useSerial->write(msgCode);
-            this->useSerial->write(len>>8 & 0xff);
-            this->useSerial->write(len & 0xff);
-            for ( x=0; x<len; x++ )
-                this->useSerial->write(bytedata[x]);
+            queueResponse(msgCode, len, data);
+            flushResponses();
         }
         inline void sendResponse(int msgCode, int val) {
-            this->useSerial->write(msgCode);
-            this->useSerial->write((byte)0);
-            this->useSerial->write((byte)2);
-            this->useSerial->write(val>>8 & 0xff);
-            this->useSerial->write(val & 0xff);
+            uint8_t data[2];
+
+            data[0] = val>>8 & 0xff;
+            data[1] = val & 0xff;
+            sendResponse(msgCode, sizeof(data), data);
         }
+        // Debug records wait in the response buffer and go out with the next
+        // response.
         inline void sendDebug(char *str) {
             if ( !this->debugEnabled )
                 return;
 
             int len;
             len = strlen(str);
-            sendResponse(CMD_DEBUG|CMD_RESPONSE_MASK, len, (void *)str);
+            queueResponse(CMD_DEBUG|CMD_RESPONSE_MASK, len, (void *)str);
         }
         inline void sendDebug(const char *str) {
             if ( !this->debugEnabled )
@@ -143,14 +220,35 @@ class CommandProcessorBinary : public CommandProcessor {
 
             int len;
             len = strlen(str);
-            sendResponse(CMD_DEBUG|CMD_RESPONSE_MASK, len, (void *)str);
+            queueResponse(CMD_DEBUG|CMD_RESPONSE_MASK, len, (void *)str);
         }
+        void queueResponse(int msgCode, int len, const void * data);
+        void queueResponseHeader(int msgCode, int len);
+        void queueResponseData(const void * data, int len);
+        void flushResponses(void);
         int  getCommandCode();
         int  getCommandDataLength();
 
         void getCommand();
-        void copyCommandDataToSender();
+        bool copyCommandDataToSender();
+        void streamCommandDataToSender();
+        void configure();
+        void configureBitRate(int index);
+        void sendStats();
+        void cacheCommand();
+        void streamReceivedFrame(int cmd);
+        DataBuffer * receiveFrame(uint8_t replyClass = REPLY_TEXT);
+        void sendControlFrame(const uint8_t * data, int len);
+        bool queueControlFrame(const uint8_t * data, int len);
+        void sendNak();
+        void sendAck();
+        void readBlocks();
+        void loadPollList();
+        void pollNext();
         void process();
+        void processSequenced();
+        void discardCommandData(int len);
+        void execute();
 
         virtual void sendDebugToHost(char * str);
         virtual void sendDebugToHost(const char * str);
@@ -158,6 +256,29 @@ class CommandProcessorBinary : public CommandProcessor {
     private:
         int     commandCode;
         int     commandDataLength;
+        // Times a frame that fails the BCC check is NAKed and read again.
+        int     nakRetries;
+        // Fixed receive timeouts in ms, 0 for adaptive ... for every command,
+        // for the next command only (-1 if not set) and for the one running.
+        unsigned int readTimeout;
+        int     nextReadTimeout;
+        unsigned int commandReadTimeout;
+        // The acknowledgement due for the next good block, BSC_CONTROL_ACK1 at
+        // the start of each transmission.
+        uint8_t nextAck;
+
+        // The poll list (CMD_POLL_LIST) ... CU poll address and the devices
+        // polled in turn while the host has nothing for us.
+        uint8_t pollListCu;
+        uint8_t pollList[POLL_LIST_MAX];
+        uint8_t pollListLength;
+        uint8_t pollListNext;
+        // Send EOT before the next poll, to put the line back in control mode.
+        bool    pollListReset;
+
+        // Response records waiting to go to the host in one write.
+        uint8_t responseBuffer[RESPONSE_BUFFER_SIZE];
+        int     responseLength;
 
 };
 
@@ -176,6 +297,7 @@ class CommandProcessorText : public CommandProcessor {
 
         virtual unsigned long getAndProcessCommand();
         int getCommandParamHexadecimal();
+        long getCommandParamDecimal();
         int addressCuPoll;
         int addressCuSelect;
         int addressDevice;
@@ -210,20 +332,28 @@ class CommandProcessorText : public CommandProcessor {
         virtual void sendDebugToHost(const char * str);
 
     private:
+        void cacheAddresses(void);
+        void sendCachedFrame(const uint8_t *frame, uint8_t len);
         void execReset(void);
         void execSelect(void);
         void execPoll(void);
         void execWrite(void);
-        void execRead(void);
+        void execRead(uint8_t replyClass);
 };
 
+// frameCache entries for the ADDR addresses.
+#define TXT_CACHE_POLL      0
+#define TXT_CACHE_SELECT    1
+
 #define TXT_CMD_POLL    1
 #define TXT_CMD_WRITE   2
 #define TXT_CMD_ADDR    3
 #define TXT_CMD_DEBUG   9
 #define TXT_CMD_BIN     10
+#define TXT_CMD_STATS   11
 #define TXT_CMD_HELP    12
 #define TXT_CMD_MEM     13
+#define TXT_CMD_RATE    14
 #define TXT_CMD_RESET   15
 
 
@@ -239,7 +369,7 @@ class CommandProcessorText : public CommandProcessor {
  */
 class CommandProcessorFrontEnd {
     public:
-        CommandProcessorFrontEnd(SyncBitBanger * bitBanger);
+        CommandProcessorFrontEnd(LineBackend * lineBackend);
         ~CommandProcessorFrontEnd(void);
 
         void enableDebug(bool v) {
@@ -259,7 +389,7 @@ class CommandProcessorFrontEnd {
 
 
     private:
-        SyncBitBanger * syncBitBanger;
+        LineBackend * lineBackend;
         bool debugEnabled = true;
         CommandProcessor * cmdProcessor;
         SyncControl * syncControl;
@@ -0,0 +1,49 @@
+#include <Arduino.h>
+#include "ControlFrameCache.h"
+
+const uint8_t ControlFrameCache::eotFrame[CONTROL_EOT_FRAME_LEN] = {
+    BSC_CONTROL_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD,
+    BSC_CONTROL_SYN, BSC_CONTROL_SYN, BSC_CONTROL_EOT, BSC_CONTROL_PAD
+};
+
+ControlFrameCache::ControlFrameCache() {
+    clear();
+}
+
+void ControlFrameCache::clear(void) {
+    for ( uint8_t x = 0; x < CONTROL_CACHE_ENTRIES; x++ )
+        _entries[x].type = CONTROL_FRAME_NONE;
+}
+
+bool ControlFrameCache::load(uint8_t index, uint8_t type, uint8_t cu, uint8_t dev) {
+    if ( index >= CONTROL_CACHE_ENTRIES ||
+         ( type != CONTROL_FRAME_POLL && type != CONTROL_FRAME_SELECT ) )
+        return false;
+
+    uint8_t * frame = _entries[index].frame;
+    *frame++ = BSC_CONTROL_PAD;
+    *frame++ = BSC_CONTROL_LEADING_PAD;
+    *frame++ = BSC_CONTROL_LEADING_PAD;
+    *frame++ = BSC_CONTROL_SYN;
+    *frame++ = BSC_CONTROL_SYN;
+    *frame++ = cu;
+    *frame++ = cu;
+    *frame++ = dev;
+    *frame++ = dev;
+    *frame++ = BSC_CONTROL_ENQ;
+    *frame++ = BSC_CONTROL_PAD;
+    _entries[index].type = type;
+    return true;
+}
+
+uint8_t ControlFrameCache::getType(uint8_t index) {
+    if ( index >= CONTROL_CACHE_ENTRIES )
+        return CONTROL_FRAME_NONE;
+    return _entries[index].type;
+}
+
+const uint8_t * ControlFrameCache::getFrame(uint8_t index) {
+    if ( getType(index) == CONTROL_FRAME_NONE )
+        return NULL;
+    return _entries[index].frame;
+}
@@ -0,0 +1,53 @@
+#ifndef ControlFrameCache_h
+#define ControlFrameCache_h
+
+#include <Arduino.h>
+#include "bsc_protocol.h"
+
+/*
+ * Poll and select frames, each built once for its (poll/select, CU address,
+ * device address) and then sent as often as needed straight from here with
+ * SendEngine::queueFrameRef(). The text commands keep the frames for the
+ * addresses set with ADDR, the host loads and sends entries by index with
+ * CMD_CACHE.
+ *
+ *   PAD LEADING_PAD LEADING_PAD SYN SYN cu cu dv dv ENQ PAD
+ *
+ * An entry must not be loaded again while it is queued to go out.
+ */
+
+#ifndef CONTROL_CACHE_ENTRIES
+#define CONTROL_CACHE_ENTRIES   4
+#endif
+
+#define CONTROL_FRAME_POLL      0
+#define CONTROL_FRAME_SELECT    1
+#define CONTROL_FRAME_NONE      0xFF    // Entry not loaded
+
+#define CONTROL_FRAME_LEN       11
+#define CONTROL_EOT_FRAME_LEN   7
+
+class ControlFrameCache {
+    public:
+        ControlFrameCache();
+        void clear(void);
+
+        // False if the index or type is not valid.
+        bool load(uint8_t index, uint8_t type, uint8_t cu, uint8_t dev);
+        // CONTROL_FRAME_xxx, CONTROL_FRAME_NONE past the end.
+        uint8_t getType(uint8_t index);
+        // The CONTROL_FRAME_LEN bytes of the frame, NULL if not loaded.
+        const uint8_t * getFrame(uint8_t index);
+
+        // PAD LEADING_PAD LEADING_PAD SYN SYN EOT PAD
+        static const uint8_t eotFrame[CONTROL_EOT_FRAME_LEN];
+
+    private:
+        struct Entry {
+            uint8_t     type;
+            uint8_t     frame[CONTROL_FRAME_LEN];
+        };
+        Entry   _entries[CONTROL_CACHE_ENTRIES];
+};
+
+#endif
@@ -59,6 +59,7 @@ DataBuffer::DataBuffer() : DataBufferReadOnly(DATABUFF_MAX_DATA) {
     Serial.println("DataBuffer ... constructor called");
 #endif
     _complete = 0;
+    _bccStatus = 0;
 }
 
 DataBuffer::DataBuffer(const DataBuffer & dbsrc) : DataBufferReadOnly(dbsrc) {
@@ -66,6 +67,7 @@ DataBuffer::DataBuffer(const DataBuffer & dbsrc) : DataBufferReadOnly(dbsrc) {
     Serial.println("DataBuffer ... copy constructor called");
 #endif
     _complete = 0;
+    _bccStatus = dbsrc._bccStatus;
     this->loadData(dbsrc._len, (uint8_t *)dbsrc._buff);
 }
 
@@ -89,6 +91,25 @@ int DataBuffer::readLast(void)
     return _buff[_len - 1];  // Return the last byte written
 }
 
+/*
+ * Remove up to maxLen bytes from the front of the buffer, copying them to dest.
+ * Anything left is moved down to the start. Returns the number of bytes taken.
+ */
+int DataBuffer::take(uint8_t *dest, int maxLen)
+{
+    int len = _len;
+    int taken = min(len, maxLen);
+
+    if ( taken <= 0 )
+        return 0;
+
+    memcpy(dest, (void *)_buff, taken);
+    if ( taken < len )
+        memmove((void *)_buff, (void *)(_buff + taken), len - taken);
+    _len = len - taken;
+    _readPos = 0;
+    return taken;
+}
 
 int DataBuffer::setComplete() {
     // Set the complete flag, providing we have data in the buffer.
@@ -7,47 +7,44 @@
 
 #define DATABUFF_MAX_DATA   300
 
+#include "DataBufferPool.h"
+
 class DataBufferReadOnly {
     public:
         inline DataBufferReadOnly() {
             _readPos = 0;
             _allocSize = 0;
             _len = 0;
+            _buff = NULL;
         }
 
         inline DataBufferReadOnly(int size) {
             _readPos = 0;
-            _allocSize = size;
             _len = 0;
-            if ( _allocSize > 0 )
-                _buff = (uint8_t *)malloc(_allocSize);
+            allocate(size);
         }
 
         inline DataBufferReadOnly(int size, uint8_t *data) {
             _readPos = 0;
-            _allocSize = size;
-            _len = size;
-            if ( _allocSize > 0 ) {
-                _buff = (uint8_t *)malloc(_allocSize);
+            allocate(size);
+            _len = _allocSize;
+            if ( _allocSize > 0 )
                 memcpy((void *)_buff, data, _allocSize);
-            }
         }
 
 
         inline DataBufferReadOnly(const DataBufferReadOnly & dbsrc) {
             _readPos = dbsrc._readPos;
-            _allocSize = dbsrc._allocSize;
-            _len = dbsrc._len;
+            allocate(dbsrc._allocSize);
+            _len = min((int)dbsrc._len, _allocSize);
 
-            if ( _allocSize > 0 ) {
-                _buff = (uint8_t *)malloc(_allocSize);
+            if ( _allocSize > 0 )
                 memcpy((void *)_buff, (void *)dbsrc._buff, _len);
-            }
         }
 
         inline ~DataBufferReadOnly() {
             if ( _allocSize > 0 )
-                free((void *)_buff);
+                dataBufferPool.release((uint8_t *)_buff);
         }
 
         void loadData(uint8_t * data);
@@ -57,8 +54,20 @@ class DataBufferReadOnly {
         int getPos();
         int getLength();
         void * getData();
+        // Zero if no storage could be had from the pool.
+        inline int getAllocSize() {
+            return _allocSize;
+        }
 
     protected:
+        // Storage comes from the pool. Should it be empty we end up with none.
+        inline void allocate(int size) {
+            _buff = NULL;
+            if ( size > 0 )
+                _buff = dataBufferPool.acquire(size);
+            _allocSize = _buff ? size : 0;
+        }
+
         int _allocSize;
         volatile int _readPos;
         volatile int _len;
@@ -74,6 +83,7 @@ class DataBuffer : public DataBufferReadOnly  {
         inline void clear()
         {
             _complete = 0;
+            _bccStatus = 0;
             _len = 0;
             _readPos = 0;
         }
@@ -81,8 +91,8 @@ class DataBuffer : public DataBufferReadOnly  {
         inline int write(uint8_t data)
         {
             int len = _len;
-            if ( len >= DATABUFF_MAX_DATA )
-                return -1;     // Fail, buffer full.
+            if ( len >= _allocSize )
+                return -1;     // Fail, buffer full (or no storage).
 
             _buff[len++] = data;
             _len = len;
@@ -96,11 +106,21 @@ class DataBuffer : public DataBufferReadOnly  {
         }
 
         int readLast(void);
+        int take(uint8_t *dest, int maxLen);
         int setComplete();
         int isComplete();
 
+        // Result of the BCC check of a received frame (FRAME_BCC_xxx in ReceiveEngine.h).
+        inline void setBccStatus(uint8_t status) {
+            _bccStatus = status;
+        }
+        inline uint8_t getBccStatus(void) {
+            return _bccStatus;
+        }
+
     private:
         volatile uint8_t _complete;
+        volatile uint8_t _bccStatus;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <Arduino.h>
+
+#include "DataBuffer.h"
+#include "DataBufferPool.h"
+
+static uint8_t largeBlocks[DATABUFF_POOL_LARGE_BLOCKS][DATABUFF_MAX_DATA];
+static uint8_t smallBlocks[DATABUFF_POOL_SMALL_BLOCKS][DATABUFF_POOL_SMALL_SIZE];
+
+DataBufferPool dataBufferPool;
+
+uint8_t * DataBufferPool::acquire(int size) {
+    int idx = -1;
+
+    if ( size <= DATABUFF_POOL_SMALL_SIZE ) {
+        if ( _small.freeCount > 0 )
+            idx = _smallFree[--_small.freeCount];
+        else if ( _small.nextUnused < DATABUFF_POOL_SMALL_BLOCKS )
+            idx = _small.nextUnused++;
+        if ( idx >= 0 ) {
+            if ( ++_small.inUse > _small.highWater )
+                _small.highWater = _small.inUse;
+            return smallBlocks[idx];
+        }
+        // No small blocks left ... a large one will do.
+    }
+
+    if ( size <= DATABUFF_MAX_DATA ) {
+        if ( _large.freeCount > 0 )
+            idx = _largeFree[--_large.freeCount];
+        else if ( _large.nextUnused < DATABUFF_POOL_LARGE_BLOCKS )
+            idx = _large.nextUnused++;
+        if ( idx >= 0 ) {
+            if ( ++_large.inUse > _large.highWater )
+                _large.highWater = _large.inUse;
+            return largeBlocks[idx];
+        }
+    }
+
+    _failures++;
+    return NULL;
+}
+
+void DataBufferPool::release(uint8_t * block) {
+    if ( block == NULL )
+        return;
+
+    if ( block >= &smallBlocks[0][0] && block < (uint8_t *)smallBlocks + sizeof(smallBlocks) ) {
+        _smallFree[_small.freeCount++] = (block - &smallBlocks[0][0]) / DATABUFF_POOL_SMALL_SIZE;
+        _small.inUse--;
+    } else if ( block >= &largeBlocks[0][0] && block < (uint8_t *)largeBlocks + sizeof(largeBlocks) ) {
+        _largeFree[_large.freeCount++] = (block - &largeBlocks[0][0]) / DATABUFF_MAX_DATA;
+        _large.inUse--;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef _DataBufferPool_h
+#define _DataBufferPool_h 1
+
+#include <Arduino.h>
+
+/*
+ * Fixed pool the DataBuffer storage is taken from, rather than malloc(). Blocks
+ * come in two sizes ... large ones of DATABUFF_MAX_DATA bytes for the engine
+ * buffers and small ones for short read only copies. Both counts are set at
+ * compile time and the whole pool is static, so there is no heap use and no
+ * fragmentation however long the dongle runs.
+ *
+ * acquire() and release() are O(1). Each size has a stack of released blocks;
+ * blocks never used yet are handed out in order. Everything starts at zero, so
+ * the pool works for DataBuffers constructed before any constructor has run.
+ *
+ * When the pool is empty acquire() returns NULL and counts the failure. The
+ * DataBuffer is then left without storage and all writes to it fail.
+ */
+
+// Storage for the engines ... RECEIVE_FRAME_QUEUE_DEPTH receive buffers and the
+// send buffer (checked in ReceiveEngine.h).
+#ifndef DATABUFF_POOL_LARGE_BLOCKS
+#define DATABUFF_POOL_LARGE_BLOCKS  4
+#endif
+
+#ifndef DATABUFF_POOL_SMALL_BLOCKS
+#define DATABUFF_POOL_SMALL_BLOCKS  4
+#endif
+
+#define DATABUFF_POOL_SMALL_SIZE    32
+
+class DataBufferPool {
+    public:
+        uint8_t * acquire(int size);
+        void release(uint8_t * block);
+
+        inline uint8_t getLargeInUse(void)      { return _large.inUse; }
+        inline uint8_t getLargeHighWater(void)  { return _large.highWater; }
+        inline uint8_t getSmallInUse(void)      { return _small.inUse; }
+        inline uint8_t getSmallHighWater(void)  { return _small.highWater; }
+        inline unsigned int getFailures(void)   { return _failures; }
+
+    private:
+        struct BlockList {
+            uint8_t     freeCount;      // Released blocks on the free stack
+            uint8_t     nextUnused;     // Blocks from here on have never been used
+            uint8_t     inUse;
+            uint8_t     highWater;
+        };
+
+        BlockList       _large;
+        BlockList       _small;
+        uint8_t         _largeFree[DATABUFF_POOL_LARGE_BLOCKS];
+        uint8_t         _smallFree[DATABUFF_POOL_SMALL_BLOCKS];
+        unsigned int    _failures;
+};
+
+extern DataBufferPool dataBufferPool;
+
+#endif
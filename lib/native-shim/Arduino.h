@@ -0,0 +1,197 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Minimal Arduino API shim so the engines, data buffers and command processors
+ * can be built and unit tested on the host (PlatformIO "native" environment).
+ *
+ * Time is virtual. millis()/micros() report the virtual clock, delay() and
+ * yield() advance it and fire the Timer1 callback (see TimerOne.h) at the
+ * programmed period, exactly as the Timer1 interrupt would on the board.
+ *
+ * The I/O ports are virtual registers laid out as on the Leonardo
+ * (ATmega32U4), so portInputRegister()/portOutputRegister() return real
+ * addresses and the engines exercise their normal pin access code.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <type_traits>
+
+#include "avr/pgmspace.h"
+
+#define ARDUINO_SHIM 1
+
+// As the Leonardo
+#ifndef F_CPU
+#define F_CPU 16000000L
+#endif
+
+#ifndef _BV
+#define _BV(bit)    (1 << (bit))
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH            0x1
+#define LOW             0x0
+
+#define INPUT           0x0
+#define OUTPUT          0x1
+#define INPUT_PULLUP    0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define LED_BUILTIN     13
+
+#define NOT_A_PIN       0
+#define NOT_A_PORT      0
+
+// Port numbering matches the AVR core: PB = 2 ... PF = 6
+#define PB 2
+#define PC 3
+#define PD 4
+#define PE 5
+#define PF 6
+
+#define SHIM_NUM_PORTS      8
+#define SHIM_NUM_PINS       24
+
+template<class T, class U>
+inline typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<class T, class U>
+inline typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+
+#define bit(b)                  (1UL << (b))
+#define bitRead(value, b)       (((value) >> (b)) & 0x01)
+#define lowByte(w)              ((uint8_t) ((w) & 0xff))
+#define highByte(w)             ((uint8_t) ((w) >> 8))
+
+// Virtual port registers
+extern volatile uint8_t shimPortInput[SHIM_NUM_PORTS];
+extern volatile uint8_t shimPortOutput[SHIM_NUM_PORTS];
+extern volatile uint8_t shimPortMode[SHIM_NUM_PORTS];
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+
+#define portInputRegister(port)     (&shimPortInput[(port)])
+#define portOutputRegister(port)    (&shimPortOutput[(port)])
+#define portModeRegister(port)      (&shimPortMode[(port)])
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int  digitalRead(uint8_t pin);
+
+// Drive an input pin from the test/simulator side.
+void shimSetInputPin(uint8_t pin, uint8_t val);
+// Read back the level an output pin is being driven to.
+uint8_t shimGetOutputPin(uint8_t pin);
+
+// Virtual clock
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+void shimAdvanceMicros(unsigned long long us);
+// Idle until the next interrupt, Timer1 or the millisecond tick.
+void shimSleepCpu(void);
+unsigned long long shimNowMicros(void);
+void shimResetClock(void);
+
+// Interrupt enable is tracked only so tests can assert on it.
+extern volatile uint8_t shimInterruptsEnabled;
+inline void interrupts(void)    { shimInterruptsEnabled = 1; }
+inline void noInterrupts(void)  { shimInterruptsEnabled = 0; }
+#define sei()   interrupts()
+#define cli()   noInterrupts()
+
+// Flash strings are plain strings on the host.
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size) {
+            size_t n = 0;
+            while ( size-- ) {
+                if ( write(*buffer++) )
+                    n++;
+                else
+                    break;
+            }
+            return n;
+        }
+        size_t write(const char *str) {
+            if ( str == NULL )
+                return 0;
+            return write((const uint8_t *)str, strlen(str));
+        }
+        size_t write(const char *buffer, size_t size) {
+            return write((const uint8_t *)buffer, size);
+        }
+
+        size_t print(const __FlashStringHelper *str) { return write((const char *)str); }
+        size_t print(const char *str) { return write(str); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+        size_t print(int n, int base = DEC) { return print((long)n, base); }
+        size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+        size_t print(long n, int base = DEC);
+        size_t print(unsigned long n, int base = DEC);
+        size_t print(double n, int digits = 2);
+
+        size_t println(void) { return write("\r\n"); }
+        template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+        template<class T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        virtual void flush() {}
+
+        void setTimeout(unsigned long timeout) { _timeout = timeout; }
+        size_t readBytes(char *buffer, size_t length);
+        size_t readBytes(uint8_t *buffer, size_t length) {
+            return readBytes((char *)buffer, length);
+        }
+
+    protected:
+        unsigned long _timeout = 1000;
+        int timedRead();
+};
+
+// Stand in for the Leonardo's native USB CDC serial class. Anything written
+// goes to stdout; there is never anything to read.
+class Serial_ : public Stream {
+    public:
+        void begin(unsigned long) {}
+        void end(void) {}
+        virtual int available(void) { return 0; }
+        virtual int peek(void) { return -1; }
+        virtual int read(void) { return -1; }
+        virtual int availableForWrite(void) { return 64; }
+        virtual void flush(void) { fflush(stdout); }
+        virtual size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+        using Print::write;
+        operator bool() { return true; }
+};
+
+extern Serial_ Serial;
+
+#endif
@@ -0,0 +1,542 @@
+#include "ControlUnitEmulator.h"
+
+// The 3270 buffer address code for each six bit value.
+static const uint8_t cuAddressCodes[64] = {
+    0x40, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+    0x50, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+    0x60, 0x61, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F
+};
+
+ControlUnitEmulator::ControlUnitEmulator(LineSimulator *sim, uint8_t station,
+                                         uint8_t pollAddr, uint8_t selectAddr,
+                                         uint8_t deviceAddr) {
+    _sim = sim;
+    _station = station;
+    _pollAddr = pollAddr;
+    _selectAddr = selectAddr;
+    _deviceAddr = deviceAddr;
+
+    _state = CU_STATE_CONTROL;
+    _nextAck = BSC_CONTROL_ACK1;
+    _aid = CU_AID_NONE;
+    _statusPending = false;
+    _sentStatus = false;
+    _expectAck = BSC_CONTROL_ACK1;
+    _busy = 0;
+    memset(&_stats, 0, sizeof(_stats));
+
+    _rxBits = 0;
+    _rxBitCount = 0;
+    _rxInSync = false;
+    _rxDle = false;
+    _rxInText = false;
+    _rxBccCount = 0;
+    _rxLen = 0;
+
+    _textLen = 0;
+    _textPos = 0;
+    _blockSize = CU_BLOCK_SIZE;
+
+    _txLen = 0;
+    _turnaround = 32;
+    _txDelay = -1;
+
+    memset(_screen, 0, sizeof(_screen));
+    memset(_isAttr, 0, sizeof(_isAttr));
+    _cursor = 0;
+
+    _sim->setListener(_station, this);
+}
+
+ControlUnitEmulator::~ControlUnitEmulator() {
+    _sim->setListener(_station, NULL);
+}
+
+int ControlUnitEmulator::decodeAddress(uint8_t b1, uint8_t b2) {
+    if ( (b1 & 0xC0) == 0 )
+        return ((b1 & 0x3F) << 8 | b2) % CU_SCREEN_SIZE;      // 14 bit
+    return ((b1 & 0x3F) << 6 | (b2 & 0x3F)) % CU_SCREEN_SIZE;  // 12 bit
+}
+
+uint8_t ControlUnitEmulator::addressCode(int value) {
+    return cuAddressCodes[value & 0x3F];
+}
+
+//-----------------------------------------------------------------------------------
+// Receiver. Hunt for SYN, then take a byte every eight bits until the end of a
+// frame, then hunt again.
+
+void ControlUnitEmulator::lineBit(uint8_t level) {
+    if ( _txDelay > 0 && --_txDelay == 0 )
+        txLoad();
+
+    _rxBits = (_rxBits >> 1) | (level ? 0x80 : 0x00);
+
+    if ( !_rxInSync ) {
+        if ( _rxBits == BSC_CONTROL_SYN ) {
+            _rxInSync = true;
+            _rxBitCount = 0;
+            _rxLen = 0;
+            _rxDle = false;
+            _rxInText = false;
+        }
+        return;
+    }
+    if ( ++_rxBitCount < 8 )
+        return;
+    _rxBitCount = 0;
+    receiveByte(_rxBits);
+}
+
+void ControlUnitEmulator::receiveByte(uint8_t data) {
+    if ( _rxLen >= CU_RX_MAX ) {
+        _rxInSync = false;
+        return;
+    }
+
+    if ( _rxInText ) {
+        _rx[_rxLen++] = data;
+        if ( _rxBccCount ) {
+            _rxBcc[2 - _rxBccCount] = data;
+            if ( --_rxBccCount == 0 ) {
+                bool good = ( _rxBcc[0] == _rxCrc.getBcc1() && _rxBcc[1] == _rxCrc.getBcc2() );
+                uint8_t term = _rx[_rxLen - 3];
+                if ( !good )
+                    frameDone(CU_FRAME_TEXT_BAD);
+                else if ( term != BSC_CONTROL_ITB )
+                    frameDone(CU_FRAME_TEXT);
+                // After ITB the next block follows.
+            }
+        } else if ( _rxCrc.update(data) ) {
+            _rxBccCount = 2;
+        } else if ( !_rxCrc.inBlock() ) {
+            frameDone(CU_FRAME_ENQ);    // Text ended with ENQ
+        }
+        return;
+    }
+
+    if ( data == BSC_CONTROL_SYN )
+        return;
+
+    if ( _rxDle ) {
+        _rxDle = false;
+        switch ( data ) {
+            case BSC_CONTROL_ACK0:
+            case BSC_CONTROL_ACK1:
+                _rx[_rxLen++] = data;
+                frameDone(CU_FRAME_ACK);
+                return;
+            case BSC_CONTROL_STX:
+                _rxCrc.reset();
+                _rxCrc.update(BSC_CONTROL_DLE);
+                _rxCrc.update(BSC_CONTROL_STX);
+                _rx[_rxLen++] = BSC_CONTROL_DLE;
+                _rx[_rxLen++] = BSC_CONTROL_STX;
+                _rxInText = true;
+                _rxBccCount = 0;
+                return;
+        }
+    }
+
+    switch ( data ) {
+        case BSC_CONTROL_PAD:
+            // Mark ... nothing more is coming.
+            _rxInSync = false;
+            return;
+        case BSC_CONTROL_DLE:
+            _rxDle = true;
+            return;
+        case BSC_CONTROL_STX:
+        case BSC_CONTROL_SOH:
+            _rxCrc.reset();
+            _rxCrc.update(data);
+            _rx[_rxLen++] = data;
+            _rxInText = true;
+            _rxBccCount = 0;
+            return;
+        case BSC_CONTROL_ENQ:
+            frameDone(_rxLen == 4 ? CU_FRAME_POLL_SELECT : CU_FRAME_ENQ);
+            return;
+        case BSC_CONTROL_EOT:
+            frameDone(CU_FRAME_EOT);
+            return;
+        case BSC_CONTROL_NAK:
+            frameDone(CU_FRAME_NAK);
+            return;
+    }
+    _rx[_rxLen++] = data;
+}
+
+void ControlUnitEmulator::frameDone(uint8_t type) {
+    _rxInSync = false;
+    _rxInText = false;
+    handleFrame(type);
+}
+
+//-----------------------------------------------------------------------------------
+// Session
+
+void ControlUnitEmulator::handleFrame(uint8_t type) {
+    if ( type == CU_FRAME_EOT ) {
+        _state = CU_STATE_CONTROL;
+        return;
+    }
+
+    switch ( _state ) {
+        case CU_STATE_CONTROL:
+            if ( type != CU_FRAME_POLL_SELECT || _rx[0] != _rx[1] || _rx[2] != _rx[3] )
+                return;
+            if ( _rx[2] != _deviceAddr && !( _rx[0] == _pollAddr && _rx[2] == 0x7F ) )
+                return;
+
+            if ( _rx[0] == _pollAddr ) {
+                _stats.polls++;
+                if ( _statusPending ) {
+                    replyStatus();
+                    _state = CU_STATE_TEXT_SENT;
+                } else if ( _aid != CU_AID_NONE ) {
+                    replyReadModified();
+                    _state = CU_STATE_TEXT_SENT;
+                } else {
+                    replyControl(BSC_CONTROL_EOT);
+                }
+            } else if ( _rx[0] == _selectAddr ) {
+                _stats.selects++;
+                if ( _busy ) {
+                    _busy--;
+                    replyDle(BSC_CONTROL_WACK);
+                } else if ( _statusPending ) {
+                    replyDle(BSC_CONTROL_RVI);
+                } else {
+                    replyDle(BSC_CONTROL_ACK0);
+                    _nextAck = BSC_CONTROL_ACK1;
+                    _state = CU_STATE_SELECTED;
+                }
+            }
+            break;
+
+        case CU_STATE_SELECTED:
+            if ( type == CU_FRAME_TEXT_BAD ) {
+                _stats.naksSent++;
+                replyControl(BSC_CONTROL_NAK);
+            } else if ( type == CU_FRAME_TEXT ) {
+                _stats.texts++;
+                handleText();
+            } else if ( type == CU_FRAME_ENQ ) {
+                _stats.resends++;
+                txSend();
+            }
+            break;
+
+        case CU_STATE_TEXT_SENT:
+            if ( type == CU_FRAME_ACK && _rx[_rxLen - 1] != _expectAck ) {
+                _stats.ackErrors++;
+                _stats.resends++;
+                txSend();
+            } else if ( type == CU_FRAME_ACK && !_sentStatus &&
+                        _textPos + _blockSize < _textLen ) {
+                _textPos += _blockSize;
+                _expectAck = ( _expectAck == BSC_CONTROL_ACK1 ) ? BSC_CONTROL_ACK0 : BSC_CONTROL_ACK1;
+                txBlock();
+            } else if ( type == CU_FRAME_ACK ) {
+                if ( _sentStatus )
+                    _statusPending = false;
+                else
+                    _aid = CU_AID_NONE;
+                replyControl(BSC_CONTROL_EOT);
+                _state = CU_STATE_CONTROL;
+            } else if ( type == CU_FRAME_NAK || type == CU_FRAME_ENQ ) {
+                _stats.resends++;
+                txSend();
+            }
+            break;
+    }
+}
+
+// The text of the frame without the framing and transparency DLEs.
+int ControlUnitEmulator::textPayload(uint8_t *dest, int maxLen) {
+    int len = 0;
+    int x = 0;
+    int end = _rxLen - 3;           // Terminator, BCC1, BCC2
+    bool transparent = false;
+
+    // Skip any header up to and including the STX.
+    while ( x < end && _rx[x] != BSC_CONTROL_STX )
+        x++;
+    if ( x > 0 && _rx[x - 1] == BSC_CONTROL_DLE && x == 1 )
+        transparent = true;
+    x++;
+    if ( transparent )
+        end--;                      // DLE before the terminator
+
+    for ( ; x < end && len < maxLen; x++ ) {
+        if ( transparent && _rx[x] == BSC_CONTROL_DLE ) {
+            // DLE DLE is one DLE, DLE SYN is time fill.
+            if ( ++x < end && _rx[x] == BSC_CONTROL_SYN )
+                continue;
+        } else if ( !transparent && _rx[x] == BSC_CONTROL_SYN ) {
+            continue;
+        }
+        if ( x < end )
+            dest[len++] = _rx[x];
+    }
+    return len;
+}
+
+void ControlUnitEmulator::handleText(void) {
+    uint8_t text[CU_RX_MAX];
+    int len = textPayload(text, sizeof(text));
+
+    if ( len >= 2 && text[0] == CU_ESC ) {
+        switch ( text[1] ) {
+            case CU_CMD_EW:
+            case CU_CMD_EWA:
+                memset(_screen, 0, sizeof(_screen));
+                memset(_isAttr, 0, sizeof(_isAttr));
+                _cursor = 0;
+                // fall through
+            case CU_CMD_W:
+                if ( len >= 3 ) {
+                    if ( text[2] & CU_WCC_RESET_MDT ) {
+                        for ( int x = 0; x < CU_SCREEN_SIZE; x++ )
+                            if ( _isAttr[x] )
+                                _screen[x] &= ~CU_ATTR_MDT;
+                    }
+                    write3270(text + 3, len - 3);
+                }
+                replyAck();
+                return;
+
+            case CU_CMD_RM:
+                replyReadModified();
+                _state = CU_STATE_TEXT_SENT;
+                return;
+        }
+    }
+    _stats.unsupported++;
+    replyAck();
+}
+
+//-----------------------------------------------------------------------------------
+// Replies ... PAD SYN SYN what PAD, with the BCC added by the SendEngine.
+
+void ControlUnitEmulator::txStart(void) {
+    _txLen = 0;
+    txByte(BSC_CONTROL_PAD);
+    txByte(BSC_CONTROL_SYN);
+    txByte(BSC_CONTROL_SYN);
+}
+
+void ControlUnitEmulator::txByte(uint8_t data) {
+    if ( _txLen < (int)sizeof(_tx) )
+        _tx[_txLen++] = data;
+}
+
+// Send the reply (again) once the turnaround time is up.
+void ControlUnitEmulator::txSend(void) {
+    _txDelay = _turnaround > 0 ? _turnaround : 1;
+}
+
+void ControlUnitEmulator::txLoad(void) {
+    SendEngine * eng = _sim->getSendEngine(_station);
+    eng->clearBuffer();
+    eng->setAutoBcc(true);
+    for ( int x = 0; x < _txLen; x++ )
+        eng->addByte(_tx[x]);
+    eng->setAutoBcc(false);
+    eng->startSending();
+    eng->stopSendingOnIdle();
+}
+
+void ControlUnitEmulator::replyControl(uint8_t ch) {
+    txStart();
+    txByte(ch);
+    txByte(BSC_CONTROL_PAD);
+    txSend();
+}
+
+void ControlUnitEmulator::replyDle(uint8_t ch) {
+    txStart();
+    txByte(BSC_CONTROL_DLE);
+    txByte(ch);
+    txByte(BSC_CONTROL_PAD);
+    txSend();
+}
+
+void ControlUnitEmulator::replyAck(void) {
+    replyDle(_nextAck);
+    _nextAck = ( _nextAck == BSC_CONTROL_ACK0 ) ? BSC_CONTROL_ACK1 : BSC_CONTROL_ACK0;
+}
+
+// SOH % R STX cu dev SS0 SS1 ETX
+void ControlUnitEmulator::replyStatus(void) {
+    txStart();
+    txByte(BSC_CONTROL_SOH);
+    txByte(0x6C);
+    txByte(0xD9);
+    txByte(BSC_CONTROL_STX);
+    txByte(_pollAddr);
+    txByte(_deviceAddr);
+    txByte(_status[0]);
+    txByte(_status[1]);
+    txByte(BSC_CONTROL_ETX);
+    txByte(BSC_CONTROL_PAD);
+    _sentStatus = true;
+    _expectAck = BSC_CONTROL_ACK1;
+    _stats.textsSent++;
+    txSend();
+}
+
+// STX cu dev AID cursor [SBA addr field data]... ETX
+void ControlUnitEmulator::replyReadModified(void) {
+    _textLen = 0;
+    textByte(_pollAddr);
+    textByte(_deviceAddr);
+    textByte(_aid);
+    textByte(addressCode(_cursor >> 6));
+    textByte(addressCode(_cursor));
+
+    for ( int x = 0; x < CU_SCREEN_SIZE && _aid != CU_AID_NONE; x++ ) {
+        if ( !_isAttr[x] || !(_screen[x] & CU_ATTR_MDT) )
+            continue;
+        int addr = (x + 1) % CU_SCREEN_SIZE;
+        textByte(CU_ORDER_SBA);
+        textByte(addressCode(addr >> 6));
+        textByte(addressCode(addr));
+        for ( ; !_isAttr[addr]; addr = (addr + 1) % CU_SCREEN_SIZE )
+            if ( _screen[addr] )
+                textByte(_screen[addr]);
+    }
+
+    replyText();
+}
+
+void ControlUnitEmulator::textByte(uint8_t data) {
+    if ( _textLen < (int)sizeof(_text) )
+        _text[_textLen++] = data;
+}
+
+// Start sending the text, first block first.
+void ControlUnitEmulator::replyText(void) {
+    _textPos = 0;
+    _sentStatus = false;
+    _expectAck = BSC_CONTROL_ACK1;
+    txBlock();
+}
+
+// STX, the block of text from _textPos, then ETX if it is the last, ETB if not.
+void ControlUnitEmulator::txBlock(void) {
+    int end = min(_textPos + _blockSize, _textLen);
+
+    txStart();
+    txByte(BSC_CONTROL_STX);
+    for ( int x = _textPos; x < end; x++ )
+        txByte(_text[x]);
+    txByte(end < _textLen ? BSC_CONTROL_ETB : BSC_CONTROL_ETX);
+    txByte(BSC_CONTROL_PAD);
+    _stats.textsSent++;
+    txSend();
+}
+
+//-----------------------------------------------------------------------------------
+// 3270 buffer
+
+void ControlUnitEmulator::queueStatus(uint8_t ss0, uint8_t ss1) {
+    _status[0] = ss0;
+    _status[1] = ss1;
+    _statusPending = true;
+}
+
+// The attribute of the field holding addr, -1 for an unformatted screen.
+int ControlUnitEmulator::fieldAttribute(int addr) {
+    for ( int x = 0; x < CU_SCREEN_SIZE; x++ ) {
+        addr = ( addr + CU_SCREEN_SIZE - 1 ) % CU_SCREEN_SIZE;
+        if ( _isAttr[addr] )
+            return addr;
+    }
+    return -1;
+}
+
+void ControlUnitEmulator::typeText(int addr, const uint8_t *data, int len) {
+    int attr = fieldAttribute(addr);
+
+    for ( int x = 0; x < len; x++ ) {
+        int pos = (addr + x) % CU_SCREEN_SIZE;
+        if ( _isAttr[pos] )
+            break;
+        _screen[pos] = data[x];
+        _cursor = (pos + 1) % CU_SCREEN_SIZE;
+    }
+    if ( attr >= 0 )
+        _screen[attr] |= CU_ATTR_MDT;
+}
+
+void ControlUnitEmulator::write3270(const uint8_t *data, int len) {
+    int addr = 0;
+    int x = 0;
+
+    while ( x < len ) {
+        uint8_t ch = data[x++];
+
+        switch ( ch ) {
+            case CU_ORDER_SBA:
+                if ( x + 2 > len )
+                    return;
+                addr = decodeAddress(data[x], data[x + 1]);
+                x += 2;
+                break;
+
+            case CU_ORDER_SF:
+                if ( x + 1 > len )
+                    return;
+                _screen[addr] = data[x++];
+                _isAttr[addr] = true;
+                addr = (addr + 1) % CU_SCREEN_SIZE;
+                break;
+
+            case CU_ORDER_IC:
+                _cursor = addr;
+                break;
+
+            case CU_ORDER_RA:
+            case CU_ORDER_EUA: {
+                if ( x + 2 + (ch == CU_ORDER_RA) > len )
+                    return;
+                int stop = decodeAddress(data[x], data[x + 1]);
+                uint8_t fill = ( ch == CU_ORDER_RA ) ? data[x + 2] : 0;
+                x += 2 + (ch == CU_ORDER_RA);
+                do {
+                    int attr = fieldAttribute(addr);
+                    if ( ch == CU_ORDER_RA ) {
+                        _screen[addr] = fill;
+                        _isAttr[addr] = false;
+                    } else if ( !_isAttr[addr] &&
+                                ( attr < 0 || !(_screen[attr] & CU_ATTR_PROTECTED) ) ) {
+                        _screen[addr] = 0;
+                    }
+                    addr = (addr + 1) % CU_SCREEN_SIZE;
+                } while ( addr != stop );
+                break;
+            }
+
+            case CU_ORDER_PT:
+                // On to the first position of the next unprotected field.
+                for ( int n = 0; n < CU_SCREEN_SIZE; n++ ) {
+                    int pos = addr;
+                    addr = (addr + 1) % CU_SCREEN_SIZE;
+                    if ( _isAttr[pos] && !(_screen[pos] & CU_ATTR_PROTECTED) )
+                        break;
+                }
+                break;
+
+            default:
+                if ( ch < 0x40 )
+                    break;      // Some other order, not emulated
+                _screen[addr] = ch;
+                _isAttr[addr] = false;
+                addr = (addr + 1) % CU_SCREEN_SIZE;
+                break;
+        }
+    }
+}
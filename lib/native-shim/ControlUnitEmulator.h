@@ -0,0 +1,183 @@
+#ifndef ControlUnitEmulator_h
+#define ControlUnitEmulator_h
+
+#include <Arduino.h>
+
+#include "LineSimulator.h"
+#include "BscCrc.h"
+#include "bsc_protocol.h"
+
+/*
+ * A 3174/3274 control unit with one 3270 display, as a tributary station on
+ * the simulated line (see LineSimulator.h). It takes a station's place on the
+ * line: bits are taken from its TXD pin as they arrive, and replies go out
+ * through that station's SendEngine.
+ *
+ *   EOT                   Back to control mode.
+ *   Poll (cu cu dv dv ENQ) Pending status, read data if a key has been pressed,
+ *                          otherwise EOT.
+ *   Select                 ACK0, WACK while busy, RVI with status pending.
+ *   Text                   NAK on a bad BCC. Write commands update the screen
+ *                          buffer and get ACK1/ACK0 in turn. Read Modified
+ *                          replies with the modified fields.
+ *   After sending text     ACK ... the next block or EOT, NAK or ENQ ... send
+ *                          it again. The ACKs must alternate, ACK1 first.
+ *
+ * Replies longer than the block size (CU_BLOCK_SIZE unless set) are sent as
+ * STX ... ETB blocks, the last ending with ETX.
+ *
+ * Only what the dongle's text commands and the tests need is emulated. Read
+ * Buffer is not supported.
+ */
+
+#define CU_SCREEN_SIZE          1920    // 24 x 80
+#define CU_RX_MAX               1024
+#define CU_TEXT_MAX             (CU_SCREEN_SIZE + 256)
+#define CU_BLOCK_SIZE           256
+
+// 3270 commands, after ESC
+#define CU_ESC                  0x27
+#define CU_CMD_W                0xF1
+#define CU_CMD_EW               0xF5
+#define CU_CMD_EWA              0x7E
+#define CU_CMD_RM               0xF6
+
+// 3270 orders
+#define CU_ORDER_PT             0x05
+#define CU_ORDER_SBA            0x11
+#define CU_ORDER_EUA            0x12
+#define CU_ORDER_IC             0x13
+#define CU_ORDER_SF             0x1D
+#define CU_ORDER_RA             0x3C
+
+#define CU_WCC_RESET_MDT        0x01
+#define CU_ATTR_PROTECTED       0x20
+#define CU_ATTR_MDT             0x01
+
+#define CU_AID_NONE             0x60
+#define CU_AID_ENTER            0x7D
+
+// Session state
+#define CU_STATE_CONTROL        0       // Waiting for a poll or select
+#define CU_STATE_SELECTED       1       // Waiting for text
+#define CU_STATE_TEXT_SENT      2       // Waiting for the text sent to be acknowledged
+
+// What a received frame was
+#define CU_FRAME_POLL_SELECT    1
+#define CU_FRAME_ENQ            2
+#define CU_FRAME_EOT            3
+#define CU_FRAME_NAK            4
+#define CU_FRAME_ACK            5
+#define CU_FRAME_TEXT           6
+#define CU_FRAME_TEXT_BAD       7
+
+struct ControlUnitStats {
+    unsigned long   polls;
+    unsigned long   selects;
+    unsigned long   texts;          // Good text frames received
+    unsigned long   naksSent;       // Text frames that failed the BCC check
+    unsigned long   textsSent;
+    unsigned long   resends;
+    unsigned long   ackErrors;      // ACK0 when ACK1 was due or the other way round
+    unsigned long   unsupported;    // Commands acknowledged but not acted on
+};
+
+class ControlUnitEmulator : public LineSimListener {
+    public:
+        ControlUnitEmulator(LineSimulator *sim, uint8_t station,
+                            uint8_t pollAddr = 0x40, uint8_t selectAddr = 0x60,
+                            uint8_t deviceAddr = 0x40);
+        virtual ~ControlUnitEmulator();
+
+        virtual void lineBit(uint8_t level);
+
+        // Bit times between the end of a frame and the start of the reply.
+        void setTurnaroundBits(unsigned int bits) { _turnaround = bits; }
+        // Most text bytes to send in one block.
+        void setBlockSize(int bytes) { _blockSize = bytes; }
+
+        // The operator keys data into the field at addr and presses a key.
+        void typeText(int addr, const uint8_t *data, int len);
+        void pressKey(uint8_t aid) { _aid = aid; }
+        // Status to send on the next poll (and RVI a select until then).
+        void queueStatus(uint8_t ss0, uint8_t ss1);
+        // WACK this many selects.
+        void setBusy(uint8_t selects) { _busy = selects; }
+
+        uint8_t getState(void) { return _state; }
+        uint8_t getScreen(int addr) { return _screen[addr % CU_SCREEN_SIZE]; }
+        bool isFieldAttribute(int addr) { return _isAttr[addr % CU_SCREEN_SIZE]; }
+        int getCursor(void) { return _cursor; }
+        const ControlUnitStats & getStats(void) { return _stats; }
+
+        static int decodeAddress(uint8_t b1, uint8_t b2);
+        static uint8_t addressCode(int value);
+
+    private:
+        LineSimulator *     _sim;
+        uint8_t             _station;
+        uint8_t             _pollAddr, _selectAddr, _deviceAddr;
+
+        uint8_t             _state;
+        uint8_t             _nextAck;       // BSC_CONTROL_ACK0 or BSC_CONTROL_ACK1
+        uint8_t             _aid;
+        bool                _statusPending;
+        uint8_t             _status[2];
+        uint8_t             _sentStatus;    // The text awaiting ACK was the status
+        uint8_t             _expectAck;     // For the block awaiting ACK
+        uint8_t             _busy;
+        ControlUnitStats    _stats;
+
+        // Receiver
+        uint8_t             _rxBits;
+        uint8_t             _rxBitCount;
+        bool                _rxInSync;
+        bool                _rxDle;
+        bool                _rxInText;
+        uint8_t             _rxBccCount;
+        uint8_t             _rxBcc[2];
+        BscCrc              _rxCrc;
+        uint8_t             _rx[CU_RX_MAX];
+        int                 _rxLen;
+
+        // Text being sent, a block at a time from _textPos.
+        uint8_t             _text[CU_TEXT_MAX];
+        int                 _textLen;
+        int                 _textPos;
+        int                 _blockSize;
+
+        // Transmitter ... the last reply, kept to send again.
+        uint8_t             _tx[DATABUFF_MAX_DATA];
+        int                 _txLen;
+        unsigned int        _turnaround;
+        long                _txDelay;       // Bit times to go, -1 for nothing to send
+
+        // The 3270 buffer
+        uint8_t             _screen[CU_SCREEN_SIZE];
+        bool                _isAttr[CU_SCREEN_SIZE];
+        int                 _cursor;
+
+        void receiveByte(uint8_t data);
+        void frameDone(uint8_t type);
+        void handleFrame(uint8_t type);
+        void handleText(void);
+        int  textPayload(uint8_t *dest, int maxLen);
+
+        void replyControl(uint8_t ch);
+        void replyDle(uint8_t ch);
+        void replyAck(void);
+        void replyStatus(void);
+        void replyReadModified(void);
+        void replyText(void);
+        void textByte(uint8_t data);
+        void txBlock(void);
+        void txStart(void);
+        void txByte(uint8_t data);
+        void txSend(void);
+        void txLoad(void);
+
+        void write3270(const uint8_t *data, int len);
+        int  fieldAttribute(int addr);
+};
+
+#endif
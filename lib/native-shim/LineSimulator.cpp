@@ -0,0 +1,316 @@
+#include <chrono>
+
+#include "LineSimulator.h"
+
+LineSimulator * LineSimulator::lineSimulatorInstance = NULL;
+
+//-----------------------------------------------------------------------------------
+// LineSimStation
+
+LineSimStation::LineSimStation(uint8_t station, LineSimulator *sim) : LineBackend() {
+    _sim = sim;
+    if ( station != 0 ) {
+        // Station 0 keeps the dongle's own pins.
+        ctsPin = 7;
+        dsrPin = 4;
+        dtrPin = 13;
+        rtsPin = 0;
+        cdPin  = 12;
+        txdPin = 1;
+        rxdPin = 11;
+    }
+}
+
+void LineSimStation::init() {
+    setupModemPins();
+    pinMode(rxdPin, OUTPUT);
+    pinMode(txdPin, INPUT_PULLUP);
+
+    sendEngine = new SendEngine(rxdPin);
+    receiveEngine = new ReceiveEngine(txdPin, ctsPin);
+
+    // Line held at mark until there is something to send.
+    sendEngine->stopSending();
+    setDsrNotReady();
+}
+
+int LineSimStation::changeBitRate(long rate, LineRateInfo *info) {
+    if ( !_sim )
+        return LINE_RATE_UNSUPPORTED;
+    return _sim->changeBitRate(rate, info);
+}
+
+//-----------------------------------------------------------------------------------
+// LineSimWire
+
+LineSimWire::LineSimWire() {
+    reset();
+}
+
+void LineSimWire::reset(void) {
+    _eventCount = 0;
+    _bit = 0;
+    _gapRemaining = 0;
+    _flip = false;
+    _inGap = false;
+    _errorOneIn = 0;
+    _errorSeed = 1;
+    _bitErrors = 0;
+    _slips = 0;
+    _gapBits = 0;
+}
+
+bool LineSimWire::addEvent(unsigned long bit, uint8_t type, int count) {
+    if ( _eventCount >= LINESIM_MAX_EVENTS )
+        return false;
+    _events[_eventCount].bit = bit;
+    _events[_eventCount].type = type;
+    _events[_eventCount].count = count;
+    _eventCount++;
+    return true;
+}
+
+bool LineSimWire::scheduleBitError(unsigned long bit) {
+    return addEvent(bit, LINESIM_EVENT_FLIP, 1);
+}
+
+bool LineSimWire::scheduleSlip(unsigned long bit, int8_t bits) {
+    if ( bits != 1 && bits != -1 )
+        return false;
+    return addEvent(bit, LINESIM_EVENT_SLIP, bits);
+}
+
+bool LineSimWire::scheduleIdleGap(unsigned long bit, unsigned int bits) {
+    return addEvent(bit, LINESIM_EVENT_GAP, bits);
+}
+
+void LineSimWire::setBitErrorRate(unsigned long oneIn, unsigned long seed) {
+    _errorOneIn = oneIn;
+    _errorSeed = seed;
+}
+
+uint8_t LineSimWire::beginBit(void) {
+    uint8_t clocks = 1;
+
+    _flip = false;
+    _inGap = false;
+
+    if ( _errorOneIn ) {
+        _errorSeed = _errorSeed * 1103515245UL + 12345UL;
+        if ( (_errorSeed >> 8) % _errorOneIn == 0 )
+            _flip = true;
+    }
+
+    for ( uint8_t x = 0; x < _eventCount; ) {
+        Event & ev = _events[x];
+
+        if ( ev.bit != _bit ) {
+            x++;
+            continue;
+        }
+        switch ( ev.type ) {
+            case LINESIM_EVENT_FLIP:
+                _flip = true;
+                break;
+            case LINESIM_EVENT_SLIP:
+                // Inserting a bit holds the sender so the receiver samples the same
+                // level twice. Dropping one clocks the sender twice so one bit is
+                // never sampled.
+                clocks = ev.count > 0 ? 0 : 2;
+                _slips++;
+                break;
+            case LINESIM_EVENT_GAP:
+                _gapRemaining += ev.count;
+                break;
+        }
+        _events[x] = _events[--_eventCount];
+    }
+
+    _bit++;
+
+    if ( _gapRemaining ) {
+        _gapRemaining--;
+        _gapBits++;
+        _inGap = true;
+        return 0;
+    }
+    return clocks;
+}
+
+uint8_t LineSimWire::carry(uint8_t level) {
+    if ( _inGap )
+        return HIGH;    // Mark
+    if ( _flip ) {
+        _bitErrors++;
+        level = !level;
+    }
+    return level;
+}
+
+//-----------------------------------------------------------------------------------
+// LineSimulator
+
+LineSimulator::LineSimulator(long bitRate) {
+    _bitRate = bitRate;
+    _clockPhase = 0;
+    for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+        _listeners[s] = NULL;
+        _stations[s] = new LineSimStation(s, this);
+        _stations[s]->bitRate = bitRate;
+        _stations[s]->init();
+    }
+    resetCounters();
+}
+
+LineSimulator::~LineSimulator() {
+    stop();
+    for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ )
+        delete _stations[s];
+}
+
+void LineSimulator::resetCounters(void) {
+    _bits = 0;
+    _hostNs = 0;
+    for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+        _frames[s] = 0;
+        _overruns[s] = 0;
+    }
+}
+
+void LineSimulator::start(void) {
+    lineSimulatorInstance = this;
+    _clockPhase = 0;
+    // As SyncBitBanger::init(), four interrupts per bit.
+    Timer1.initialize((long)1000000 / _bitRate / 4);
+    Timer1.attachInterrupt(interruptRoutine);
+}
+
+void LineSimulator::stop(void) {
+    if ( lineSimulatorInstance != this )
+        return;
+    Timer1.detachInterrupt();
+    Timer1.stop();
+    lineSimulatorInstance = NULL;
+}
+
+int LineSimulator::changeBitRate(long rate, LineRateInfo *info) {
+    long period = (long)1000000 / rate / 4;
+
+    _bitRate = rate;
+    for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ )
+        _stations[s]->bitRate = rate;
+    if ( lineSimulatorInstance == this )
+        Timer1.setPeriod(period);
+
+    LineBackend::setRateInfo(info, rate, period * 4);
+    return LINE_RATE_OK;
+}
+
+void LineSimulator::runBits(unsigned long bits) {
+    if ( lineSimulatorInstance != this )
+        start();
+
+    unsigned long long period = Timer1.getPeriod();
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    shimAdvanceMicros(period * 4 * bits);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    _hostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+}
+
+void LineSimulator::getReport(LineSimReport *report) {
+    memset(report, 0, sizeof(LineSimReport));
+
+    report->bits = _bits;
+    for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+        report->frames += _frames[s];
+        report->frameOverruns += _overruns[s];
+    }
+    if ( _bits == 0 )
+        return;
+
+    report->simulatedSeconds = (double)_bits / _bitRate;
+    report->framesPerSecond = report->frames / report->simulatedSeconds;
+    report->hostNsPerBit = (double)_hostNs / _bits;
+    if ( report->hostNsPerBit > 0 )
+        report->maxHostBitRate = (long)(1e9 / report->hostNsPerBit);
+}
+
+// Count the frames the receive engine completes in processBit() or drain().
+inline void LineSimulator::processReceived(uint8_t station) {
+    ReceiveEngine * eng = _stations[station]->receiveEngine;
+    unsigned int overruns = eng->getFrameOverruns();
+    uint8_t queued = eng->getQueuedFrames();
+
+#ifdef RECEIVE_ENGINE_DEFERRED
+    eng->drain();
+#else
+    eng->processBit();
+#endif
+
+    unsigned int newOverruns = eng->getFrameOverruns() - overruns;
+    _overruns[station] += newOverruns;
+    _frames[station] += eng->getQueuedFrames() + newOverruns - queued;
+}
+
+// The phases of SyncBitBanger::serialDriverInterruptRoutine, for both stations.
+void LineSimulator::clockPhase(void) {
+    switch ( _clockPhase ) {
+        case 0:
+            // Put the output data pins in the correct state and carry them over
+            // the line to the other station's input pin.
+            for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+                LineSimStation * from = _stations[s];
+                LineSimStation * to = _stations[(s + 1) % LINESIM_STATIONS];
+                uint8_t clocks = _wires[s].beginBit();
+
+                for ( uint8_t c = 0; c < clocks; c++ )
+                    from->sendEngine->sendBit();
+
+                shimSetInputPin(to->txdPin, _wires[s].carry(shimGetOutputPin(from->rxdPin)));
+            }
+            _clockPhase++;
+            break;
+
+        case 1:
+            // Read the state of the input data pins
+            for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+                if ( _listeners[s] )
+                    _listeners[s]->lineBit(digitalRead(_stations[s]->txdPin));
+                else
+                    _stations[s]->receiveEngine->getBit();
+            }
+            _clockPhase++;
+            break;
+
+        case 2:
+            for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ ) {
+                if ( _listeners[s] )
+                    continue;
+#ifdef RECEIVE_ENGINE_DEFERRED
+                _stations[s]->receiveEngine->collectBit();
+#else
+                processReceived(s);
+#endif
+            }
+            _clockPhase++;
+            break;
+
+        case 3:
+#ifdef RECEIVE_ENGINE_DEFERRED
+            // What the main loop would be doing.
+            for ( uint8_t s = 0; s < LINESIM_STATIONS; s++ )
+                if ( !_listeners[s] )
+                    processReceived(s);
+#endif
+            _bits++;
+            _clockPhase = 0;
+            break;
+    }
+}
+
+void LineSimulator::interruptRoutine(void) {
+    if ( lineSimulatorInstance )
+        lineSimulatorInstance->clockPhase();
+}
@@ -0,0 +1,159 @@
+#ifndef LineSimulator_h
+#define LineSimulator_h
+
+#include <Arduino.h>
+#include <TimerOne.h>
+
+#include "LineBackend.h"
+#include "SendEngine.h"
+#include "ReceiveEngine.h"
+
+/*
+ * Host side loopback line for exercising the engines without hardware.
+ *
+ * Two stations, each a send/receive engine pair on its own virtual pins, are
+ * connected back to back: the RXD output of one is the TXD input of the other.
+ * Timer1 (on the virtual clock, see Arduino.h) runs the same four phases as
+ * SyncBitBanger::serialDriverInterruptRoutine for both stations, so the bits go
+ * through the real sendBit()/getBit() pin access and processBit()/collectBit().
+ *
+ * Each direction of the line can be given bit errors, bit slips and idle gaps.
+ * The simulator counts the frames completed and the host CPU time spent, for
+ * benchmarking the engines.
+ */
+
+#define LINESIM_STATIONS        2
+#define LINESIM_MAX_EVENTS      8
+
+#define LINESIM_EVENT_FLIP      1   // Invert the bit on the line
+#define LINESIM_EVENT_SLIP      2   // Receiver sees one bit more (+1) or less (-1)
+#define LINESIM_EVENT_GAP       3   // Mark on the line, sender held, for count bits
+
+class LineSimulator;
+
+// One end of the line. Pins are picked so that the two stations do not share a
+// virtual port bit. Changing the bit rate of either changes it for the line.
+class LineSimStation : public LineBackend {
+    public:
+        LineSimStation(uint8_t station, LineSimulator *sim = NULL);
+        virtual void init();
+
+    protected:
+        virtual int changeBitRate(long rate, LineRateInfo *info);
+
+    private:
+        LineSimulator * _sim;
+};
+
+// One direction of the line, from the RXD pin of a station to the TXD pin of
+// the other, with any impairments scheduled on it. Bit numbers count bit times
+// since the simulator was started.
+class LineSimWire {
+    public:
+        LineSimWire();
+        void reset(void);
+
+        bool scheduleBitError(unsigned long bit);
+        bool scheduleSlip(unsigned long bit, int8_t bits);
+        bool scheduleIdleGap(unsigned long bit, unsigned int bits);
+        // Random bit errors, about one in every oneIn bits. Zero for none.
+        void setBitErrorRate(unsigned long oneIn, unsigned long seed = 1);
+
+        // How many times to clock the sender this bit time (0 to 2) and what
+        // to do to the level it leaves on the line.
+        uint8_t beginBit(void);
+        uint8_t carry(uint8_t level);
+
+        unsigned long getBitErrors(void)    { return _bitErrors; }
+        unsigned long getSlips(void)        { return _slips; }
+        unsigned long getGapBits(void)      { return _gapBits; }
+
+    private:
+        struct Event {
+            unsigned long   bit;
+            uint8_t         type;
+            int             count;
+        };
+        Event           _events[LINESIM_MAX_EVENTS];
+        uint8_t         _eventCount;
+        unsigned long   _bit;
+        unsigned int    _gapRemaining;
+        bool            _flip;
+        bool            _inGap;
+        unsigned long   _errorOneIn;
+        unsigned long   _errorSeed;
+        unsigned long   _bitErrors;
+        unsigned long   _slips;
+        unsigned long   _gapBits;
+
+        bool addEvent(unsigned long bit, uint8_t type, int count);
+};
+
+// Something other than the station's ReceiveEngine listening on its TXD pin,
+// such as an emulated control unit.
+class LineSimListener {
+    public:
+        virtual ~LineSimListener() {}
+        // Called once per bit time with the level sampled on the pin.
+        virtual void lineBit(uint8_t level) = 0;
+};
+
+struct LineSimReport {
+    unsigned long   bits;               // Bit times simulated
+    unsigned long   frames;             // Frames completed, both directions
+    unsigned long   frameOverruns;
+    double          simulatedSeconds;
+    double          framesPerSecond;    // Per simulated second
+    double          hostNsPerBit;       // Host CPU time per bit time, both stations
+    long            maxHostBitRate;     // Bit rate at which the host would keep up
+};
+
+class LineSimulator {
+    public:
+        LineSimulator(long bitRate);
+        virtual ~LineSimulator();
+
+        // Attach the line to Timer1. From then on it is clocked whenever the
+        // virtual clock moves: delay(), yield(), runBits().
+        void start(void);
+        void stop(void);
+
+        // Run the line for a number of bit times, timing the host CPU used.
+        void runBits(unsigned long bits);
+
+        LineSimStation & getStation(uint8_t station) { return *_stations[station]; }
+        SendEngine * getSendEngine(uint8_t station) { return _stations[station]->sendEngine; }
+        ReceiveEngine * getReceiveEngine(uint8_t station) { return _stations[station]->receiveEngine; }
+        // The direction of the line carrying what the station sends.
+        LineSimWire & getWireFrom(uint8_t station) { return _wires[station]; }
+        // Hand the station's received bits to the listener rather than its
+        // ReceiveEngine. NULL to go back to the ReceiveEngine.
+        void setListener(uint8_t station, LineSimListener *listener) { _listeners[station] = listener; }
+
+        long getBitRate(void) { return _bitRate; }
+        // As SyncBitBanger, for both stations.
+        int changeBitRate(long rate, LineRateInfo *info);
+        unsigned long getBits(void) { return _bits; }
+        unsigned long getFrames(uint8_t station) { return _frames[station]; }
+        void getReport(LineSimReport *report);
+        void resetCounters(void);
+
+        static LineSimulator * lineSimulatorInstance;
+        static void interruptRoutine(void);
+
+    private:
+        LineSimStation *    _stations[LINESIM_STATIONS];
+        LineSimWire         _wires[LINESIM_STATIONS];
+        LineSimListener *   _listeners[LINESIM_STATIONS];
+        long                _bitRate;
+        uint8_t             _clockPhase;
+        unsigned long       _bits;
+        unsigned long       _frames[LINESIM_STATIONS];
+        unsigned long       _overruns[LINESIM_STATIONS];
+        unsigned long long  _hostNs;
+
+        void clockPhase(void);
+        void processReceived(uint8_t station);
+};
+
+#endif
@@ -0,0 +1,244 @@
+#include "Arduino.h"
+#include "TimerOne.h"
+
+volatile uint8_t shimPortInput[SHIM_NUM_PORTS];
+volatile uint8_t shimPortOutput[SHIM_NUM_PORTS];
+volatile uint8_t shimPortMode[SHIM_NUM_PORTS];
+volatile uint8_t shimInterruptsEnabled = 1;
+
+Serial_ Serial;
+TimerOne Timer1;
+volatile uint16_t TCNT1 = 0;
+volatile uint16_t ICR1 = 0;
+ShimFlagRegister TIFR1;
+
+// Leonardo (ATmega32U4) digital pin to port/bit mapping.
+static const uint8_t shimPinPort[SHIM_NUM_PINS] = {
+    PD, PD, PD, PD, PD, PC, PD, PE,     // D0 - D7
+    PB, PB, PB, PB, PD, PC, PB, PB,     // D8 - D15
+    PB, PB, PF, PF, PF, PF, PF, PF      // D16 - D23 (A0 - A5 are D18 - D23)
+};
+
+static const uint8_t shimPinBit[SHIM_NUM_PINS] = {
+    2, 3, 1, 0, 4, 6, 7, 6,
+    4, 5, 6, 7, 6, 7, 3, 1,
+    2, 0, 7, 6, 5, 4, 1, 0
+};
+
+uint8_t digitalPinToPort(uint8_t pin) {
+    if ( pin >= SHIM_NUM_PINS )
+        return NOT_A_PORT;
+    return shimPinPort[pin];
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+    if ( pin >= SHIM_NUM_PINS )
+        return 0;
+    return 1 << shimPinBit[pin];
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    uint8_t port = digitalPinToPort(pin);
+    uint8_t mask = digitalPinToBitMask(pin);
+
+    if ( port == NOT_A_PORT )
+        return;
+
+    if ( mode == OUTPUT ) {
+        shimPortMode[port] |= mask;
+    } else {
+        shimPortMode[port] &= ~mask;
+        if ( mode == INPUT_PULLUP ) {
+            shimPortOutput[port] |= mask;
+            shimPortInput[port] |= mask;
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    uint8_t port = digitalPinToPort(pin);
+    uint8_t mask = digitalPinToBitMask(pin);
+
+    if ( port == NOT_A_PORT )
+        return;
+
+    if ( val == LOW )
+        shimPortOutput[port] &= ~mask;
+    else
+        shimPortOutput[port] |= mask;
+}
+
+int digitalRead(uint8_t pin) {
+    uint8_t port = digitalPinToPort(pin);
+
+    if ( port == NOT_A_PORT )
+        return LOW;
+
+    return (shimPortInput[port] & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+void shimSetInputPin(uint8_t pin, uint8_t val) {
+    uint8_t port = digitalPinToPort(pin);
+    uint8_t mask = digitalPinToBitMask(pin);
+
+    if ( val )
+        shimPortInput[port] |= mask;
+    else
+        shimPortInput[port] &= ~mask;
+}
+
+uint8_t shimGetOutputPin(uint8_t pin) {
+    return (shimPortOutput[digitalPinToPort(pin)] & digitalPinToBitMask(pin)) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------------
+// Virtual clock
+
+static unsigned long long shimMicros = 0;
+
+unsigned long long shimNowMicros(void) {
+    return shimMicros;
+}
+
+void shimResetClock(void) {
+    shimMicros = 0;
+    Timer1.reset();
+}
+
+void shimAdvanceMicros(unsigned long long us) {
+    unsigned long long target = shimMicros + us;
+
+    while ( Timer1.due(target) ) {
+        if ( Timer1.getNextFire() > shimMicros )
+            shimMicros = Timer1.getNextFire();
+        Timer1.fire();
+    }
+    shimMicros = target;
+}
+
+unsigned long millis(void) {
+    return (unsigned long)(shimMicros / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)shimMicros;
+}
+
+void delay(unsigned long ms) {
+    shimAdvanceMicros((unsigned long long)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    shimAdvanceMicros(us);
+}
+
+void yield(void) {
+    unsigned long long next = Timer1.getNextFire();
+
+    // Step to the next timer tick so busy-wait loops make progress.
+    if ( Timer1.due(next) && next > shimMicros )
+        shimAdvanceMicros(next - shimMicros);
+    else
+        shimAdvanceMicros(1);
+}
+
+void shimSleepCpu(void) {
+    unsigned long long next = (shimMicros / 1000 + 1) * 1000;
+    unsigned long long fire = Timer1.getNextFire();
+
+    if ( Timer1.due(fire) && fire > shimMicros && fire < next )
+        next = fire;
+    shimAdvanceMicros(next - shimMicros);
+}
+
+void TimerOne::setPeriod(unsigned long microseconds) {
+    period = microseconds;
+    nextFire = shimMicros + period;
+    ICR1 = microseconds * (F_CPU / 2000000L);
+}
+
+void TimerOne::start(void) {
+    nextFire = shimMicros + period;
+    running = true;
+}
+
+void TimerOne::stop(void) {
+    if ( running && nextFire > shimMicros )
+        stoppedFor = nextFire - shimMicros;
+    running = false;
+}
+
+void TimerOne::resume(void) {
+    if ( !running )
+        nextFire = shimMicros + stoppedFor;
+    running = true;
+}
+
+void TimerOne::fire(void) {
+    nextFire += period;
+    if ( isrCallback )
+        isrCallback();
+}
+
+void TimerOne::reset(void) {
+    period = 0;
+    nextFire = 0;
+    stoppedFor = 0;
+    running = false;
+    isrCallback = 0;
+}
+
+//-----------------------------------------------------------------------------------
+// Print / Stream
+
+size_t Print::print(long n, int base) {
+    if ( base == DEC && n < 0 )
+        return print('-') + print((unsigned long)-n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    if ( base < 2 )
+        base = 10;
+
+    *str = '\0';
+    do {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while ( n );
+
+    return write(str);
+}
+
+size_t Print::print(double n, int digits) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+int Stream::timedRead() {
+    unsigned long startMillis = millis();
+    do {
+        int c = read();
+        if ( c >= 0 )
+            return c;
+        yield();
+    } while ( millis() - startMillis < _timeout );
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length) {
+    size_t count = 0;
+    while ( count < length ) {
+        int c = timedRead();
+        if ( c < 0 )
+            break;
+        *buffer++ = (char)c;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,71 @@
+#ifndef TimerOne_h_
+#define TimerOne_h_
+
+#include <stdint.h>
+
+/*
+ * Host stand in for paulstoffregen/TimerOne. The attached callback is fired
+ * from the virtual clock (see Arduino.h) every period microseconds whenever
+ * time is advanced by delay(), delayMicroseconds() or yield().
+ *
+ * As on the board, stop() holds the count where it is and resume() carries on
+ * from there, so the interrupts that would have come in between never do.
+ */
+
+// The Timer1 registers read by SyncBitBanger's interrupt statistics. ICR1 is
+// set for the period as TimerOne would (one count per CPU cycle, up to ICR1
+// and back down). Nothing else moves them ... tests set TCNT1 and the TIFR1
+// flags to what the interrupt routine should see.
+class ShimFlagRegister {
+    public:
+        operator uint8_t() const { return value; }
+        // Writing a one clears the flag.
+        ShimFlagRegister & operator=(uint8_t ones) { value &= ~ones; return *this; }
+        void set(uint8_t flags) { value |= flags; }
+    private:
+        uint8_t value = 0;
+};
+
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t ICR1;
+extern ShimFlagRegister TIFR1;
+#define TOV1    0
+#define ICF1    5
+
+class TimerOne {
+    public:
+        void initialize(unsigned long microseconds = 1000000) {
+            setPeriod(microseconds);
+        }
+        void setPeriod(unsigned long microseconds);
+        unsigned long getPeriod(void) { return period; }
+        void attachInterrupt(void (*isr)(), unsigned long microseconds = 0) {
+            if ( microseconds > 0 )
+                setPeriod(microseconds);
+            isrCallback = isr;
+            running = true;
+        }
+        void detachInterrupt() { isrCallback = 0; }
+        void start();
+        void stop();
+        void resume();
+
+        // Host side only -- fire the callback if one is due by the given time.
+        bool due(unsigned long long now) {
+            return running && isrCallback && period > 0 && now >= nextFire;
+        }
+        void fire(void);
+        unsigned long long getNextFire(void) { return nextFire; }
+        void reset(void);
+
+    private:
+        unsigned long period = 0;
+        unsigned long long nextFire = 0;
+        unsigned long long stoppedFor = 0;     // Left of the period when stopped
+        bool running = false;
+        void (*isrCallback)() = 0;
+};
+
+extern TimerOne Timer1;
+
+#endif
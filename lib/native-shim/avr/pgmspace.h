@@ -0,0 +1,17 @@
+#ifndef shim_pgmspace_h
+#define shim_pgmspace_h
+
+// Program memory is ordinary memory on the host.
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)                 (s)
+#define pgm_read_byte(addr)     (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)     (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr)    (*(const uint32_t *)(addr))
+#define memcpy_P(dest, src, n)  memcpy((dest), (src), (n))
+#define strlen_P(s)             strlen(s)
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef shim_sleep_h
+#define shim_sleep_h
+
+// Sleeping until the next interrupt moves the virtual clock on to it (see
+// shimSleepCpu()).
+
+#include <Arduino.h>
+
+#define SLEEP_MODE_IDLE         0
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()             shimSleepCpu()
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef BscCrc_h
+#define BscCrc_h
+
+#include <Arduino.h>
+
+/*
+ * BSC block check (BCC) for EBCDIC text ... CRC-16, table driven with the
+ * table in flash (PROGMEM).
+ *
+ * BscCrc follows a frame byte by byte and applies the BSC rules for what is
+ * covered by the BCC. It starts after the STX/SOH opening the block and takes
+ * in everything up to and including the ETB/ETX/ITB that ends it, except SYN
+ * fill. In transparent text (DLE STX ...) the DLEs are left out, so DLE DLE
+ * counts as one DLE and DLE ETX as ETX. After an ITB the BCC starts again for
+ * the next block.
+ *
+ * The BCC goes on the line low byte (BCC1) first.
+ */
+
+extern const uint16_t bscCrcTable[256] PROGMEM;
+
+inline uint16_t bscCrcUpdate(uint16_t crc, uint8_t data) {
+    return (crc >> 8) ^ pgm_read_word(&bscCrcTable[(uint8_t)(crc ^ data)]);
+}
+
+#define BCC_STATE_IDLE      0       // Not in a block
+#define BCC_STATE_IDLE_DLE  1       // DLE outside a block, maybe DLE STX
+#define BCC_STATE_TEXT      2       // In the block
+#define BCC_STATE_TEXT_DLE  3       // DLE in the block
+#define BCC_STATE_ITB       4       // First byte after ITB BCC1 BCC2
+#define BCC_STATE_ITB_DLE   5
+
+class BscCrc {
+    public:
+        BscCrc() {
+            reset();
+        }
+
+        void reset(void);
+        bool update(uint8_t data);
+
+        inline uint16_t getCrc(void) {
+            return _crc;
+        }
+        inline uint8_t getBcc1(void) {
+            return _crc & 0xff;
+        }
+        inline uint8_t getBcc2(void) {
+            return _crc >> 8;
+        }
+        inline bool inBlock(void) {
+            return _state >= BCC_STATE_TEXT;
+        }
+
+    private:
+        uint16_t    _crc;
+        uint8_t     _state;
+        bool        _transparent;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef ByteRing_h
+#define ByteRing_h
+
+#include <Arduino.h>
+
+/*
+ * Single producer / single consumer ring of bytes.
+ *
+ * One side (normally the timer interrupt routine) only ever calls put() and the
+ * other side (normally the main loop) only ever calls get(), count() and flush().
+ * Each index is written by exactly one side and is a single byte, so no locking
+ * is required on the AVR.
+ *
+ * SIZE must be a power of two between 2 and 128. One slot is always kept empty
+ * to tell a full ring from an empty one.
+ */
+template <uint8_t SIZE>
+class ByteRing {
+    public:
+        ByteRing() {
+            _head = 0;
+            _tail = 0;
+            _overruns = 0;
+        }
+
+        // Producer side. Returns false, and counts an overrun, when the ring is full.
+        inline bool put(uint8_t data) {
+            uint8_t head = _head;
+            uint8_t next = (head + 1) & (SIZE - 1);
+            if ( next == _tail ) {
+                _overruns++;
+                return false;
+            }
+            _data[head] = data;
+            _head = next;
+            return true;
+        }
+
+        // Consumer side. Returns the oldest byte, or -1 when the ring is empty.
+        inline int get(void) {
+            uint8_t tail = _tail;
+            if ( tail == _head )
+                return -1;
+            uint8_t data = _data[tail];
+            _tail = (tail + 1) & (SIZE - 1);
+            return data;
+        }
+
+        // Consumer side. Number of bytes waiting to be read.
+        inline uint8_t count(void) {
+            return (_head - _tail) & (SIZE - 1);
+        }
+
+        // Consumer side. Discard anything waiting to be read.
+        inline void flush(void) {
+            _tail = _head;
+        }
+
+        inline uint8_t getCapacity(void) {
+            return SIZE - 1;
+        }
+
+        inline uint8_t getOverruns(void) {
+            return _overruns;
+        }
+
+        inline void clearOverruns(void) {
+            _overruns = 0;
+        }
+
+    private:
+        volatile uint8_t    _data[SIZE];
+        volatile uint8_t    _head;
+        volatile uint8_t    _tail;
+        volatile uint8_t    _overruns;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "LineBackend.h"
+
+const long lineBitRates[LINE_BIT_RATE_COUNT] = {
+    300, 600, 1200, 2400, 4800, 9600, 19200
+};
+
+LineBackend::LineBackend() {
+    this->sendEngine = NULL;
+    this->receiveEngine = NULL;
+
+    // RS232 pin names are from the DTE point of view.
+    // Therefore, for example, the DTE transmit data pin is an input to the
+    // DCE. Likewise, the DTE receive data pin is an output from the DCE.
+
+    ctsPin = 8;         // Output
+    dsrPin = 6;         // Output
+    dtrPin = 10;        // Input
+    rtsPin = 2;         // Input
+    cdPin  = 5;         // Output
+    riPin  = 0;         // Output - not used.
+    txdPin = 3;         // Input tx data
+    rxdPin = 9;         // Output rx data
+
+    bitRate = 300;
+
+    dsrReady = false;
+}
+
+LineBackend::~LineBackend() {
+    if ( this->sendEngine )
+        delete this->sendEngine;
+
+    if ( this->receiveEngine )
+        delete this->receiveEngine;
+}
+
+void LineBackend::setDsrNotReady()
+{
+        digitalWrite(dsrPin, HIGH); // Active low
+        digitalWrite(cdPin, HIGH); // Active low
+        digitalWrite(ctsPin, HIGH); // Active low
+        digitalWrite(rxdPin, HIGH); // Idle state for the data line we are sending on.
+
+        idleClockLines();
+        dsrReady = false;
+}
+
+void LineBackend::setDsrReady()
+{
+    if ( !dsrReady ) {
+        digitalWrite(dsrPin, LOW);    // Active low
+        delay(500);
+        // This is going to be my temp ring indicator.
+        digitalWrite(cdPin, LOW); //Ring!
+        delay(2000);
+        digitalWrite(cdPin, HIGH); // Silent
+        delay(4000);
+        digitalWrite(cdPin, LOW); // Ring! short ring because we going to pretend an answer.
+        delay(500);
+        digitalWrite(cdPin, HIGH); // Silent after answer
+        //
+        // ctsPin now also drives CD (temp)
+        digitalWrite(ctsPin, LOW);
+        delay(500);
+        digitalWrite(rxdPin, HIGH);    // Idle state for the data line we are sending on.
+        dsrReady = true;
+
+        idleClockLines();
+    }
+}
+
+void LineBackend::deviceReset() {
+    setDsrNotReady();
+    delay(2000);
+    setDsrReady();
+}
+
+bool LineBackend::isLineIdle(void) {
+    if ( sendEngine && sendEngine->xmitState == SEND_STATE_XMIT )
+        return false;
+    if ( receiveEngine && receiveEngine->isFrameInProgress() )
+        return false;
+    return true;
+}
+
+int LineBackend::setBitRate(long rate, LineRateInfo *info) {
+    int x;
+
+    for ( x = 0; x < LINE_BIT_RATE_COUNT && lineBitRates[x] != rate; x++ )
+        ;
+    if ( x == LINE_BIT_RATE_COUNT )
+        return LINE_RATE_UNSUPPORTED;
+    if ( !isLineIdle() )
+        return LINE_RATE_BUSY;
+    return changeBitRate(rate, info);
+}
+
+// What a bit period of bitPeriodUs gives, for the rate asked for.
+void LineBackend::setRateInfo(LineRateInfo *info, long rate, double bitPeriodUs) {
+    double actual = 1000000.0 / bitPeriodUs;
+
+    info->bitRate = (long)(actual + 0.5);
+    info->bitPeriodNs = (long)(bitPeriodUs * 1000.0 + 0.5);
+    info->errorPpm = (long)((actual - rate) * 1000000.0 / rate);
+}
+
+void LineBackend::setupModemPins() {
+    pinMode(ctsPin, OUTPUT);
+    pinMode(dsrPin, OUTPUT);
+    pinMode(dtrPin, INPUT);
+    pinMode(cdPin,OUTPUT);
+    //pinMode(riPin, OUTPUT);  // This is not being used because
+                               // we don't have enough output channels
+                               // on the 3 MAX232 ICs.
+}
+
+SyncControl::SyncControl(LineBackend * instance) {
+    this->lineBackend = instance;
+}
+
+void SyncControl::deviceReset() {
+    this->lineBackend->deviceReset();
+}
+
+int SyncControl::setBitRate(long rate, LineRateInfo *info) {
+    if ( !this->lineBackend )
+        return LINE_RATE_UNSUPPORTED;
+    return this->lineBackend->setBitRate(rate, info);
+}
+
+long SyncControl::getBitRate(void) {
+    return this->lineBackend ? this->lineBackend->bitRate : 0;
+}
+
+bool SyncControl::getStats(LineStats *stats, bool clear) {
+    if ( !this->lineBackend )
+        return false;
+    return this->lineBackend->getStats(stats, clear);
+}
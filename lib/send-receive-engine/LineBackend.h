@@ -0,0 +1,133 @@
+#ifndef LineBackend_h
+#define LineBackend_h
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <Arduino.h>
+
+#include "SendEngine.h"
+#include "ReceiveEngine.h"
+
+#include "bsc_protocol.h"
+
+// Line bit rates that can be chosen at run time (LineBackend::setBitRate()).
+#define LINE_BIT_RATE_COUNT     7
+extern const long lineBitRates[LINE_BIT_RATE_COUNT];
+
+// setBitRate() results
+#define LINE_RATE_OK            0
+#define LINE_RATE_BUSY          1   // Something is being sent or received
+#define LINE_RATE_TOO_FAST      2   // The interrupt routine would not keep up
+#define LINE_RATE_UNSUPPORTED   3   // Not a rate this backend can clock
+
+// The rate the line actually runs at, after rounding to what the timer can do.
+struct LineRateInfo {
+    long    bitRate;
+    long    bitPeriodNs;
+    long    errorPpm;       // Against the rate asked for
+};
+
+// Interrupt routine load and line throughput (LineBackend::getStats()). Times
+// are in CPU cycles, for each of the interrupt phases of a bit. The averages and
+// rates are over the last whole second, the rest since the stats were cleared.
+#define LINE_STATS_PHASES       4
+
+struct LineStats {
+    unsigned long   interrupts;
+    unsigned long   lateInterrupts;     // Still running when the next was due
+    unsigned long   missedInterrupts;   // Never run at all
+    unsigned int    periodCycles;       // Between interrupts
+    unsigned int    phaseCyclesMin[LINE_STATS_PHASES];
+    unsigned int    phaseCyclesAvg[LINE_STATS_PHASES];
+    unsigned int    phaseCyclesMax[LINE_STATS_PHASES];
+    unsigned long   bitsSentPerSecond;
+    unsigned long   bitsReceivedPerSecond;
+};
+
+/*
+ * The synchronous line driver. This is what clocks bits out to and in from the
+ * DTE and owns the send and receive engines.
+ *
+ * The backend is selected at build time ...
+ *
+ *   SyncBitBanger     (default)             Timer1 interrupt toggling the clock pins,
+ *                                           one bit per four interrupts.
+ *   UsartSyncDriver   (LINE_BACKEND_USART)  USART1 in master SPI mode. The hardware
+ *                                           generates the clock and shifts whole bytes.
+ *
+ * This base class holds what is common to all of them: the modem control pins,
+ * the DSR/CD/CTS handshake, changing the bit rate and the byte level path used
+ * by backends that move whole bytes rather than single bits.
+ */
+class LineBackend {
+    public:
+
+        int txdPin, rxdPin;
+        int ctsPin, rtsPin, dsrPin, dtrPin, cdPin, riPin;
+        long    bitRate;
+        uint8_t dsrReady;
+
+        SendEngine      *sendEngine;
+        ReceiveEngine   *receiveEngine;
+
+        LineBackend();
+        virtual ~LineBackend();
+        virtual void init() = 0;
+        void setDsrNotReady();
+        void setDsrReady();
+        void deviceReset();
+
+        // Change the bit rate to one of lineBitRates[], only while nothing is
+        // being sent or received. Returns LINE_RATE_xxx, and on LINE_RATE_OK
+        // what the line now runs at in info.
+        int setBitRate(long rate, LineRateInfo *info);
+        bool isLineIdle(void);
+        static void setRateInfo(LineRateInfo *info, long rate, double bitPeriodUs);
+
+        // The statistics so far, then start them again if clear is set. False
+        // if the backend does not keep any.
+        virtual bool getStats(LineStats *stats, bool clear) {
+            return false;
+        }
+
+        // Byte path. Called from the transmit interrupt of a byte clocked backend,
+        // returns the next byte to shift out on the line. When the send engine is
+        // off the line is held at mark by sending PAD (all ones).
+        inline uint8_t nextLineByte(void) {
+            int data = sendEngine->nextByte();
+            return data < 0 ? BSC_CONTROL_PAD : (uint8_t)data;
+        }
+
+        // Byte path. Called from the receive interrupt of a byte clocked backend
+        // with the byte as shifted in (first bit received in bit 0).
+        inline void lineByteReceived(uint8_t data) {
+            receiveEngine->receiveByte(data);
+        }
+
+    protected:
+        void setupModemPins();
+
+        // Put any backend specific clock outputs in their idle state.
+        virtual void idleClockLines() {}
+
+        // Reprogram the clock for the new rate (the line is idle).
+        virtual int changeBitRate(long rate, LineRateInfo *info) {
+            return LINE_RATE_UNSUPPORTED;
+        }
+};
+
+class SyncControl {
+    public:
+        SyncControl(LineBackend *lineBackend);
+        virtual ~SyncControl() {};
+        void deviceReset();
+        int setBitRate(long rate, LineRateInfo *info);
+        bool getStats(LineStats *stats, bool clear);
+        // 0 if there is no line.
+        long getBitRate(void);
+    private:
+        LineBackend * lineBackend;
+};
+
+#endif
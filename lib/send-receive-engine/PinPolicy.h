@@ -0,0 +1,67 @@
+#ifndef PinPolicy_h
+#define PinPolicy_h
+
+#include <Arduino.h>
+
+/*
+ * Pin access policies for the interrupt routine hot path.
+ *
+ * The engines take the pin as a template parameter (sendBitOn(), getBitFrom(),
+ * assertClockLinesOn() ...) so the same code can be built against either policy.
+ *
+ *   RuntimePin   Port register pointer and bit mask worked out at run time with
+ *                portOutputRegister(digitalPinToPort(pin)). Works for any pin and
+ *                on the host, so this is what the tests and the default build use.
+ *
+ *   FixedPin     Port register address and bit known at compile time. With the
+ *                address in the I/O space the compiler emits a single sbi/cbi to
+ *                set/clear the pin, and sbis/sbic to test it, instead of loading
+ *                the pointer and doing a read-modify-write.
+ *
+ * Build with LINE_PINS_FIXED defined to use the FixedPin descriptors below in the
+ * SyncBitBanger interrupt routine. They must agree with the pin numbers set up in
+ * the SyncBitBanger/LineBackend constructors.
+ */
+
+class RuntimePin {
+    public:
+        RuntimePin(volatile uint8_t *reg, uint8_t bit) : _reg(reg), _bit(bit) {}
+
+        inline void high(void) const    { *_reg |= _bit; }
+        inline void low(void) const     { *_reg &= (uint8_t)~_bit; }
+        inline uint8_t read(void) const { return *_reg & _bit; }
+
+    private:
+        volatile uint8_t *  _reg;
+        uint8_t             _bit;
+};
+
+// ADDR is the data memory address of the PORTx (output) or PINx (input) register.
+template <uint16_t ADDR, uint8_t BIT>
+class FixedPin {
+    public:
+        inline void high(void) const    { *(volatile uint8_t *)ADDR |= (uint8_t)(1 << BIT); }
+        inline void low(void) const     { *(volatile uint8_t *)ADDR &= (uint8_t)~(1 << BIT); }
+        inline uint8_t read(void) const { return *(volatile uint8_t *)ADDR & (uint8_t)(1 << BIT); }
+};
+
+#ifdef LINE_PINS_FIXED
+
+#ifndef __AVR_ATmega32U4__
+#error "LINE_PINS_FIXED descriptors are for the Leonardo (ATmega32U4)"
+#endif
+
+// ATmega32U4 register addresses (data memory space)
+#define PIN_ADDR_PINB   0x23
+#define PIN_ADDR_PORTB  0x25
+#define PIN_ADDR_PIND   0x29
+#define PIN_ADDR_PORTD  0x2B
+
+typedef FixedPin<PIN_ADDR_PORTB, 5> LineRxdPin;     // Pin 9,  PB5, output rx data
+typedef FixedPin<PIN_ADDR_PIND,  0> LineTxdPin;     // Pin 3,  PD0, input tx data
+typedef FixedPin<PIN_ADDR_PORTB, 3> LineRxclkPin;   // Pin 14, PB3, output rx clock
+typedef FixedPin<PIN_ADDR_PORTB, 2> LineTxclkPin;   // Pin 16, PB2, output tx clock
+
+#endif
+
+#endif
@@ -1,6 +1,8 @@
 #include <Arduino.h>
+#include <avr/sleep.h>
 #include "ReceiveEngine.h"
 #include "bsc_protocol.h"
+#include "ReceiveStateTable.h"
 
 ReceiveEngine::ReceiveEngine(uint8_t txdPin, uint8_t ctsPin) {
 
@@ -12,25 +14,37 @@ ReceiveEngine::ReceiveEngine(uint8_t txdPin, uint8_t ctsPin) {
 
     _inCharSync = false;
     _previousByteDLE = false;
-    _frameComplete = false;
+    _frameTerminator = 0;
+    _streamed = 0;
+    _bccExpected = 0;
+    _bcc1Match = false;
+    _bccStatus = FRAME_BCC_UNCHECKED;
     _receiveBitCounter = 0;
+    _markBytes = 0;
+    _abortMarkBytes = RECEIVE_ABORT_MARK_BYTES;
     _ctsPin = ctsPin;
 
     _inputBitBuffer = 0;        // This is not really required, however it is useful for
                                 // unit testing that we clear it initially.
     _savedFrame = NULL;
-    _workingDataBuffer = 0;
+    _savedSlot = 0;
+    _receiveSlot = 0;
     _receiveDataBuffer = &(_dataBuffers[0]);
-
-    // _dataBuffers[0] = DataBuffer();
-    // _dataBuffers[1] = DataBuffer();
+    _queueHead = 0;
+    _queuedFrames = 0;
+    _frameOverruns = 0;
+    _frameAborts = 0;
+    _frameCompleteHook = NULL;
+    _frameCompleteContext = NULL;
+    memset(_frameInfo, 0, sizeof(_frameInfo));
 
 #ifdef RECEIVE_ENGINE_DEBUG
-    Serial.print("_dataBuffer[0] = 0x");
-    Serial.print((unsigned)&(_dataBuffers[0]), HEX);
-    Serial.print(", _dataBuffer[1] = 0x");
-    Serial.print((unsigned)&(_dataBuffers[1]), HEX);
-    Serial.println();
+    for ( int x = 0; x < RECEIVE_FRAME_QUEUE_DEPTH; x++ ) {
+        Serial.print("_dataBuffer[");
+        Serial.print(x);
+        Serial.print("] = 0x");
+        Serial.println((unsigned)&(_dataBuffers[x]), HEX);
+    }
 #endif
 
 }
@@ -73,7 +87,7 @@ DataBuffer * ReceiveEngine::getDataBuffer(void) {
 }
 
 bool ReceiveEngine::isFrameComplete(void) {
-    return _frameComplete;
+    return _queuedFrames > 0;
 }
 
 /*
@@ -96,18 +110,14 @@ bool ReceiveEngine::isFrameComplete(void) {
 
 void ReceiveEngine::processBit(void) {
 
-    uint8_t localReceiveState;
-    localReceiveState = receiveState;
-
     // When we are out of sync (no char/byte sync on the line ...
-    if ( localReceiveState == RECEIVE_STATE_OUT_OF_SYNC ) {
+    if ( receiveState == RECEIVE_STATE_OUT_OF_SYNC ) {
 
         // When are out of sync then we constantly look for the sync bit pattern.
         if ( _inputBitBuffer == BSC_CONTROL_SYN ) {
             _inCharSync = true;
-            receiveState = RECEIVE_STATE_IDLE;
-            _receiveDataBuffer->write(_inputBitBuffer);
             _receiveBitCounter = 0;
+            processByte(_inputBitBuffer);
         }
         // We are done
         return;
@@ -118,14 +128,93 @@ void ReceiveEngine::processBit(void) {
     if ( _receiveBitCounter != 8 )
         return;
 
-    _latestByte = _inputBitBuffer;
     _receiveBitCounter = 0;
+    processByte(_inputBitBuffer);
+}
+
+/*
+ * Run the bytes assembled by collectBit() through the state machine. This is
+ * the deferred half of the receive path and must not be called from the
+ * interrupt routine.
+ */
+void ReceiveEngine::drain(void) {
+    int data;
+
+    while ( (data = _receiveRing.get()) >= 0 )
+        processByte((uint8_t)data);
+}
+
+uint8_t ReceiveEngine::getRingOverruns(void) {
+    return _receiveRing.getOverruns();
+}
+
+/*
+ * Check the BCC as the frame arrives. Every byte in sync goes through BscCrc,
+ * which knows which of them the BCC covers. When it reports the end of a block
+ * the next two bytes are BCC1 and BCC2. With ITB there may be several blocks;
+ * the frame is bad if any of them is.
+ */
+inline void ReceiveEngine::checkBcc(uint8_t data) {
+    if ( _bccExpected == 2 ) {
+        _bcc1Match = ( data == _bcc.getBcc1() );
+        _bccExpected = 1;
+    } else if ( _bccExpected == 1 ) {
+        if ( !_bcc1Match || data != _bcc.getBcc2() )
+            _bccStatus = FRAME_BCC_BAD;
+        else if ( _bccStatus != FRAME_BCC_BAD )
+            _bccStatus = FRAME_BCC_GOOD;
+        _bccExpected = 0;
+    } else if ( _bcc.update(data) ) {
+        _bccExpected = 2;
+    }
+}
+
+inline void ReceiveEngine::processByte(uint8_t data) {
+    // The sender has stopped and left the line at mark. Transparent text may
+    // hold anything.
+    if ( data != BSC_CONTROL_PAD || receiveState == RECEIVE_STATE_TRANSPARENT_DATA )
+        _markBytes = 0;
+    else if ( _markBytes != 0xff )
+        _markBytes++;
+
+    // The BCC and PAD states move on with any byte, so only these can stall.
+    if ( _markBytes == _abortMarkBytes && _abortMarkBytes != 0 &&
+         ( receiveState == RECEIVE_STATE_DATA || receiveState == RECEIVE_STATE_IDLE ) ) {
+        lostSync();
+        return;
+    }
+
+    checkBcc(data);
+#ifdef RECEIVE_ENGINE_TABLE
+    processByteTable(data);
+#else
+    processByteChain(data);
+#endif
+}
+
+void ReceiveEngine::processByteChain(uint8_t data) {
+
+    uint8_t localReceiveState;
+    localReceiveState = receiveState;
+
+    if ( localReceiveState == RECEIVE_STATE_OUT_OF_SYNC ) {
+        // The first byte after gaining character sync is always the SYN.
+        if ( data == BSC_CONTROL_SYN ) {
+            receiveState = RECEIVE_STATE_IDLE;
+            _receiveDataBuffer->write(data);
+        }
+        return;
+    }
+
+    _latestByte = data;
 
 
     if ( localReceiveState == RECEIVE_STATE_PAD ) {
         _receiveDataBuffer->write(_latestByte);
         frameComplete();
         receiveState = RECEIVE_STATE_IDLE;
+        // A DLE ACK0/1 or DLE ETX that ended the frame is not a DLE for the next one.
+        _previousByteDLE = false;
         return;
     }
 
@@ -134,7 +223,7 @@ void ReceiveEngine::processBit(void) {
 
         // If latest character is a SYNC/IDLE then just discard.
         if ( _latestByte == BSC_CONTROL_SYN ) {
-            if ( _receiveDataBuffer->getLength() == 0 )
+            if ( _receiveDataBuffer->getLength() == 0 && _streamed == 0 )
                 _receiveDataBuffer->write(_latestByte);
             return;
         }
@@ -168,10 +257,12 @@ void ReceiveEngine::processBit(void) {
     if ( localReceiveState == RECEIVE_STATE_IDLE ) {
 
         if ( _previousByteDLE &&
-             ( _latestByte == BSC_CONTROL_ACK0 || _latestByte == BSC_CONTROL_ACK1 ) ) {
-            // We got a SYN DLE ACK0 or SYN DLE ACK1 sequence
+             ( _latestByte == BSC_CONTROL_ACK0 || _latestByte == BSC_CONTROL_ACK1 ||
+               _latestByte == BSC_CONTROL_WACK || _latestByte == BSC_CONTROL_RVI ) ) {
+            // We got a SYN DLE ACK0/ACK1/WACK/RVI sequence
             _receiveDataBuffer->write(BSC_CONTROL_DLE);
             _receiveDataBuffer->write(_latestByte);
+            _frameTerminator = _latestByte;
             receiveState = RECEIVE_STATE_PAD;
             return;
         }
@@ -189,6 +280,7 @@ void ReceiveEngine::processBit(void) {
              _latestByte == BSC_CONTROL_NAK ) {
             // We got a SYN EOT or SYN NAK sequence
             _receiveDataBuffer->write(_latestByte);
+            _frameTerminator = _latestByte;
             receiveState = RECEIVE_STATE_PAD;
             return;
         }
@@ -205,6 +297,7 @@ void ReceiveEngine::processBit(void) {
         if ( _latestByte == BSC_CONTROL_ETB ||
              _latestByte == BSC_CONTROL_ETX ) {
             _receiveDataBuffer->write(_latestByte);
+            _frameTerminator = _latestByte;
             receiveState = RECEIVE_STATE_BCC1;
             return;
         }
@@ -227,6 +320,7 @@ void ReceiveEngine::processBit(void) {
         if ( _previousByteDLE && _latestByte == BSC_CONTROL_ENQ ) {
             _receiveDataBuffer->write(BSC_CONTROL_DLE);
             _receiveDataBuffer->write(_latestByte);
+            _frameTerminator = _latestByte;
             // _frameComplete = true;
             frameComplete();
             _previousByteDLE = false;
@@ -239,6 +333,7 @@ void ReceiveEngine::processBit(void) {
               _latestByte == BSC_CONTROL_ETB ) ) {
             _receiveDataBuffer->write(BSC_CONTROL_DLE);
             _receiveDataBuffer->write(_latestByte);
+            _frameTerminator = _latestByte;
             receiveState = RECEIVE_STATE_BCC1;
             return;
         }
@@ -269,52 +364,244 @@ void ReceiveEngine::processBit(void) {
 
 }
 
+/*
+ * Table driven version of processByteChain(). The byte is classified, then the
+ * transition for (state, previous byte DLE, class) gives the next state, the next
+ * DLE flag and what to do with the byte. See ReceiveStateTable.cpp.
+ */
+void ReceiveEngine::processByteTable(uint8_t data) {
+
+    uint8_t byteClass = pgm_read_byte(&receiveByteClass[data]);
+    uint8_t entry = pgm_read_byte(&receiveTransition[(receiveState << 1) | _previousByteDLE][byteClass]);
+
+    if ( receiveState != RECEIVE_STATE_OUT_OF_SYNC )
+        _latestByte = data;
+
+    receiveState = entry & RX_NEXT_STATE_MASK;
+    _previousByteDLE = (entry & RX_NEXT_DLE) ? true : false;
+    if ( entry & RX_TERMINATOR )
+        _frameTerminator = data;
+
+    switch ( (entry >> RX_ACTION_SHIFT) & RX_ACTION_MASK ) {
+        case RX_ACTION_WRITE:
+            _receiveDataBuffer->write(data);
+            break;
+        case RX_ACTION_WRITE_IF_EMPTY:
+            if ( _receiveDataBuffer->getLength() == 0 && _streamed == 0 )
+                _receiveDataBuffer->write(data);
+            break;
+        case RX_ACTION_WRITE_DLE:
+            _receiveDataBuffer->write(BSC_CONTROL_DLE);
+            _receiveDataBuffer->write(data);
+            break;
+        case RX_ACTION_WRITE_COMPLETE:
+            _receiveDataBuffer->write(data);
+            frameComplete();
+            break;
+        case RX_ACTION_WRITE_DLE_COMPLETE:
+            _receiveDataBuffer->write(BSC_CONTROL_DLE);
+            _receiveDataBuffer->write(data);
+            frameComplete();
+            break;
+    }
+}
+
+/*
+ * The frame in the receive slot is complete. Queue it and move on to the next
+ * slot, dropping the oldest queued frame if that is where it is.
+ */
 inline void ReceiveEngine::frameComplete(void) {
-    _savedFrame = _receiveDataBuffer;
-    if ( _workingDataBuffer == 0 ) {
-        _workingDataBuffer = 1;
-        _receiveDataBuffer = &(_dataBuffers[1]);
-    } else {
-        _workingDataBuffer = 0;
-        _receiveDataBuffer = &(_dataBuffers[0]);
+    ReceivedFrameInfo * info = &_frameInfo[_receiveSlot];
+
+    _receiveDataBuffer->setBccStatus(_bccStatus);
+    info->length = _receiveDataBuffer->getLength();
+    info->terminator = _frameTerminator;
+    info->bccStatus = _bccStatus;
+    info->timestamp = millis();
+
+    _frameTerminator = 0;
+    _streamed = 0;
+    _bcc.reset();
+    _bccExpected = 0;
+    _bccStatus = FRAME_BCC_UNCHECKED;
+
+    _queuedFrames++;
+    if ( ++_receiveSlot == RECEIVE_FRAME_QUEUE_DEPTH )
+        _receiveSlot = 0;
+    if ( _queuedFrames == RECEIVE_FRAME_QUEUE_DEPTH ) {
+        // Nobody has taken the oldest frame and we need its buffer.
+        if ( ++_queueHead == RECEIVE_FRAME_QUEUE_DEPTH )
+            _queueHead = 0;
+        _queuedFrames--;
+        _frameOverruns++;
     }
+    _receiveDataBuffer = &(_dataBuffers[_receiveSlot]);
 #ifdef RECEIVE_ENGINE_DEBUG
-    Serial.print("ReceiveEngine.frameComplete() - _workingDataBuffer now = ");
-    Serial.println(_workingDataBuffer);
-    Serial.print("ReceiveEngine.frameComplete() -_savedFrame now set to 0x");
-    Serial.print((unsigned)_savedFrame, HEX);
-    Serial.print(", _receiveDataBuffer now set to 0x");
-    Serial.print((unsigned)_receiveDataBuffer, HEX);
-    Serial.println();
+    Serial.print("ReceiveEngine.frameComplete() - _receiveSlot now = ");
+    Serial.print(_receiveSlot);
+    Serial.print(", _queuedFrames = ");
+    Serial.println(_queuedFrames);
 #endif
     // Clear out data buffer for the next frame.
     _receiveDataBuffer->clear();
-    // Set the flag.
-    _frameComplete = true;
+
+    if ( _frameCompleteHook )
+        _frameCompleteHook(_frameCompleteContext);
+}
+
+/*
+ * The station has stopped sending (carrier lost, or it gave up) ... the line
+ * has been at mark for _abortMarkBytes. Queue what there is of a frame so
+ * the wait for it ends now rather than at its timeout, and hunt for SYN again.
+ */
+void ReceiveEngine::lostSync(void) {
+    if ( receiveState == RECEIVE_STATE_DATA ) {
+        _bccStatus = FRAME_ABORTED;
+        frameComplete();
+        _frameAborts++;
+    } else {
+        _receiveDataBuffer->clear();
+    }
+    _previousByteDLE = false;
+    _markBytes = 0;
+    _inCharSync = false;
+    receiveState = RECEIVE_STATE_OUT_OF_SYNC;
+}
+
+void ReceiveEngine::setFrameCompleteHook(FrameCompleteHook hook, void *context) {
+    noInterrupts();
+    _frameCompleteHook = hook;
+    _frameCompleteContext = context;
+    interrupts();
 }
 
+/*
+ * Take the oldest complete frame off the queue. With none queued this is the
+ * frame taken last time.
+ */
 DataBuffer * ReceiveEngine::getSavedFrame(void) {
-    _frameComplete = false;
+    // The state machine may be running from the interrupt routine.
+    noInterrupts();
+    if ( _queuedFrames > 0 ) {
+        _savedSlot = _queueHead;
+        _savedFrame = &(_dataBuffers[_savedSlot]);
+        if ( ++_queueHead == RECEIVE_FRAME_QUEUE_DEPTH )
+            _queueHead = 0;
+        _queuedFrames--;
+    }
+    interrupts();
     return _savedFrame;
 }
 
+uint8_t ReceiveEngine::getSavedFrameTerminator(void) {
+    return _frameInfo[_savedSlot].terminator;
+}
+
+const ReceivedFrameInfo * ReceiveEngine::getSavedFrameInfo(void) {
+    return &_frameInfo[_savedSlot];
+}
+
+uint8_t ReceiveEngine::getQueuedFrames(void) {
+    return _queuedFrames;
+}
+
+unsigned int ReceiveEngine::getFrameOverruns(void) {
+    return _frameOverruns;
+}
+
+/*
+ * Take the bytes received so far of the frame currently being received, for
+ * streaming it to the host while it is still arriving. Returns the number of
+ * bytes copied to dest. Once the frame is complete nothing more is taken here:
+ * the rest of it is in the saved frame (getSavedFrame()).
+ */
+int ReceiveEngine::takeReceivedData(uint8_t *dest, int maxLen) {
+    int taken = 0;
+
+    // The state machine may be running from the interrupt routine.
+    noInterrupts();
+    if ( _queuedFrames == 0 ) {
+        taken = _receiveDataBuffer->take(dest, maxLen);
+        _streamed += taken;
+    }
+    interrupts();
+    return taken;
+}
+
+/*
+ * Start listening for a new reply. Frames still queued came in after their
+ * reply was given up on, and would otherwise be taken as this one, so they
+ * are dropped. The frame last taken by getSavedFrame() is left alone.
+ */
 void ReceiveEngine::startReceiving() {
+    // The state machine may be running from the interrupt routine.
+    noInterrupts();
+    _queuedFrames = 0;
+    _queueHead = _receiveSlot;
     _inCharSync = false;
+    _previousByteDLE = false;
+    _streamed = 0;
+    _frameTerminator = 0;
+    _bcc.reset();
+    _bccExpected = 0;
+    _bccStatus = FRAME_BCC_UNCHECKED;
+    _markBytes = 0;
+    _receiveRing.flush();
     _receiveDataBuffer->clear();
     receiveState = RECEIVE_STATE_OUT_OF_SYNC;
+    interrupts();
     digitalWrite(_ctsPin, LOW);
 }
 
-int ReceiveEngine::waitReceivedFrameComplete(int timeoutMs = 3000) {
+// As below, with nothing but an overall timeout.
+int ReceiveEngine::waitReceivedFrameComplete(int timeoutMs) {
+    ReplyDeadline deadline = { (unsigned long)timeoutMs, (unsigned long)timeoutMs, 0 };
+
+    return waitReceivedFrameComplete(&deadline);
+}
+
+/*
+ * No reply is coming if the station has not started one by startMs (there has
+ * been no SYN), if it has gone quiet part way (the line back at mark for
+ * silenceBytes) or if it is still going at totalMs.
+ */
+bool ReceiveEngine::replyTimedOut(const ReplyDeadline *deadline, unsigned long waitedMs) {
+    if ( waitedMs >= deadline->totalMs )
+        return true;
+    if ( !_inCharSync )
+        return waitedMs >= deadline->startMs;
+    return deadline->silenceBytes && _markBytes >= deadline->silenceBytes;
+}
+
+/*
+ * Wait for a complete frame, until replyTimedOut(). Returns the milliseconds
+ * waited, or -1 on timeout.
+ *
+ * Between checks the CPU sleeps (idle mode, the timers and USB carry on) until
+ * the next interrupt ... Timer1, which may have completed the frame, or
+ * anything else. Interrupts are held off from the check to the sleep so a
+ * frame completing in between still wakes it.
+ */
+int ReceiveEngine::waitReceivedFrameComplete(const ReplyDeadline *deadline) {
     unsigned long startTime = millis();
-    unsigned long completeByTime = startTime + timeoutMs;
-    while ( !_frameComplete ) {
-        if ( millis() > completeByTime )
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while ( true ) {
+        drain();
+        noInterrupts();
+        if ( _queuedFrames > 0 ) {
+            interrupts();
+            return millis() - startTime;
+        }
+        if ( replyTimedOut(deadline, millis() - startTime) ) {
+            interrupts();
             return -1;
-        delay(1);
+        }
+        sleep_enable();
+        interrupts();
+        sleep_cpu();
+        sleep_disable();
     }
-    return millis() - startTime;
-    digitalWrite(_ctsPin, HIGH);
 }
 
 int ReceiveEngine::getFrameLength() {
@@ -3,6 +3,10 @@
 
 #include <Arduino.h>
 #include "DataBuffer.h"
+#include "ByteRing.h"
+#include "PinPolicy.h"
+#include "BscCrc.h"
+#include "bsc_protocol.h"
 
 #define RECEIVE_STATE_OUT_OF_SYNC       0
 #define RECEIVE_STATE_IDLE              1
@@ -12,8 +16,67 @@
 #define RECEIVE_STATE_BCC2              5
 #define RECEIVE_STATE_PAD               6
 
+// BCC check result for a received frame. Frames without a text block (ACK0,
+// EOT ...) are not checked.
+#define FRAME_BCC_UNCHECKED             0
+#define FRAME_BCC_GOOD                  1
+#define FRAME_BCC_BAD                   2
+// Not a BCC result: the line went to mark part way through the frame and it was
+// given up, see ReceiveEngine::setAbortMarkBytes().
+#define FRAME_ABORTED                   3
+
 //#define RECEIVE_ENGINE_DEBUG
 
+// When defined, the interrupt routine only assembles bytes (collectBit) and the
+// BSC state machine runs from drain() outside of the interrupt routine.
+//#define RECEIVE_ENGINE_DEFERRED
+
+// When defined, received bytes are run through the table driven state machine
+// (processByteTable) rather than the if-chain (processByteChain).
+//#define RECEIVE_ENGINE_TABLE
+
+// Number of frame buffers. One is used for the frame being received, so up to
+// RECEIVE_FRAME_QUEUE_DEPTH - 1 complete frames wait for getSavedFrame() before
+// the oldest is dropped (and counted in getFrameOverruns()).
+#ifndef RECEIVE_FRAME_QUEUE_DEPTH
+#define RECEIVE_FRAME_QUEUE_DEPTH       3
+#endif
+
+// The frame buffers and the SendEngine buffer all take large pool blocks.
+static_assert(DATABUFF_POOL_LARGE_BLOCKS >= RECEIVE_FRAME_QUEUE_DEPTH + 1,
+              "DATABUFF_POOL_LARGE_BLOCKS too small for the receive queue and send buffer");
+
+// What is known about a received frame besides its data.
+struct ReceivedFrameInfo {
+    int                 length;
+    uint8_t             terminator;     // See getSavedFrameTerminator()
+    uint8_t             bccStatus;      // FRAME_BCC_xxx
+    unsigned long       timestamp;      // millis() when the frame completed
+};
+
+// How long to wait for a reply, see ReceiveEngine::waitReceivedFrameComplete().
+// Times are from the start of the wait.
+struct ReplyDeadline {
+    unsigned long       startMs;        // To gain character sync
+    unsigned long       totalMs;        // For the whole frame
+    uint8_t             silenceBytes;   // Of mark once in sync, 0 not to check
+};
+
+// Called as each frame completes, see ReceiveEngine::setFrameCompleteHook().
+typedef void (*FrameCompleteHook)(void *context);
+
+// Bytes of mark in a row that end a frame being received, or character sync
+// while waiting for one. 0 to wait for ETX/ETB however long it takes.
+#ifndef RECEIVE_ABORT_MARK_BYTES
+#define RECEIVE_ABORT_MARK_BYTES        4
+#endif
+
+// Size of the ring carrying assembled bytes from the interrupt routine to drain().
+// Must be a power of two.
+#ifndef RECEIVE_RING_SIZE
+#define RECEIVE_RING_SIZE               32
+#endif
+
 
 class ReceiveEngine {
     public:
@@ -31,9 +94,15 @@ class ReceiveEngine {
         // This routine is timing critical. It needs to be invoked before de-asserting the DTE-transmit
         // clock line. The processBit() routine can be invoked afterwards and is not timing critical.
         inline void getBit(void) {
+            getBitFrom(RuntimePin(_TXD_PORT, _TXD_BIT));
+        }
+
+        // getBit() for a given pin policy (see PinPolicy.h).
+        template <class PIN>
+        inline void getBitFrom(const PIN &txdPin) {
             uint8_t inputBit;
             // Read value from port
-            inputBit = (*_TXD_PORT & _TXD_BIT) ? 0x80 : 0x00;
+            inputBit = txdPin.read() ? 0x80 : 0x00;
             // Save in buffer
             getBitSet(inputBit);
         }
@@ -44,13 +113,74 @@ class ReceiveEngine {
             getBitSet(inputBit);
         }
 
+        // Deferred alternative to processBit(). This is all the interrupt routine
+        // needs to do: hunt for the SYN pattern and, once in character sync, hand
+        // every eighth bit's worth of data over to drain() through the ring.
+        inline void collectBit(void) {
+            if ( !_inCharSync ) {
+                if ( _inputBitBuffer != BSC_CONTROL_SYN )
+                    return;
+                _inCharSync = true;
+            } else if ( _receiveBitCounter != 8 ) {
+                return;
+            }
+            _receiveBitCounter = 0;
+            _receiveRing.put(_inputBitBuffer);
+        }
+
+        // Byte clocked backends (USART) deliver 8 bits at a time, first bit received
+        // in bit 0. The bytes are not aligned to the BSC characters until we have
+        // found the SYN, so they are fed through the bit path to hunt for it.
+        inline void receiveByte(uint8_t data) {
+            for ( uint8_t x = 0; x < 8; x++ ) {
+                getBitSet((data & 0x01) ? 0x80 : 0x00);
+                data >>= 1;
+#ifdef RECEIVE_ENGINE_DEFERRED
+                collectBit();
+#else
+                processBit();
+#endif
+            }
+        }
+
         // void getBit(uint8_t val);
         // void getBit(void);
         void setBit(uint8_t bit);
         void processBit(void);
+        void drain(void);
+        // The two implementations of the BSC receive state machine. Both are public
+        // so they can be compared in the unit tests; normally processByte() picks one.
+        void processByteChain(uint8_t data);
+        void processByteTable(uint8_t data);
+        uint8_t getRingOverruns(void);
         virtual void startReceiving(void);
         void stopReceiving(void);
-        virtual int waitReceivedFrameComplete(int timeoutMs);
+        virtual int waitReceivedFrameComplete(const ReplyDeadline *deadline);
+        int waitReceivedFrameComplete(int timeoutMs);
+        bool replyTimedOut(const ReplyDeadline *deadline, unsigned long waitedMs);
+        // Bytes of mark (all ones) received in a row since the last of anything
+        // else, outside transparent text. Up to 255.
+        uint8_t getMarkBytes(void) { return _markBytes; }
+        // A frame has started and not yet been queued: past its STX or SOH, or
+        // a DLE seen while IDLE, and short of the trailing PAD. Waiting in IDLE
+        // between frames is not.
+        bool isFrameInProgress(void) {
+            return ( receiveState != RECEIVE_STATE_OUT_OF_SYNC &&
+                     receiveState != RECEIVE_STATE_IDLE &&
+                     receiveState != RECEIVE_STATE_PAD ) ||
+                   ( receiveState == RECEIVE_STATE_IDLE && _previousByteDLE );
+        }
+        // After this many bytes of mark the station is taken to have stopped.
+        // A frame being received is queued as it is with FRAME_ABORTED, and
+        // either way the engine goes back to hunting for SYN. 0 for never. Less
+        // than 2 would end text frames holding 0xFF.
+        void setAbortMarkBytes(uint8_t bytes) { _abortMarkBytes = bytes; }
+        uint8_t getAbortMarkBytes(void) { return _abortMarkBytes; }
+        unsigned int getFrameAborts(void) { return _frameAborts; }
+        // Have hook(context) called as each frame is queued. That is from drain()
+        // in RECEIVE_ENGINE_DEFERRED builds, otherwise from the interrupt routine,
+        // so it should do no more than take note. NULL for none.
+        void setFrameCompleteHook(FrameCompleteHook hook, void *context);
         int getFrameLength(void);
         int getFrameDataByte(int idx);
         uint8_t *getTxdPort(void);
@@ -64,26 +194,56 @@ class ReceiveEngine {
         DataBuffer * getDataBuffer(void);
         bool isFrameComplete(void);
         virtual DataBuffer * getSavedFrame(void);
+        uint8_t getSavedFrameTerminator(void);
+        const ReceivedFrameInfo * getSavedFrameInfo(void);
+        uint8_t getQueuedFrames(void);
+        unsigned int getFrameOverruns(void);
+        int takeReceivedData(uint8_t *dest, int maxLen);
         uint8_t _inputBitBuffer;
 
     protected:
-        // Two data buffers that we alternate for receiving and processing data
-        DataBuffer           _dataBuffers[2];
+        // The frame buffers, used in turn. The complete frames waiting for
+        // getSavedFrame() are the _queuedFrames slots before _receiveSlot, oldest
+        // at _queueHead.
+        DataBuffer           _dataBuffers[RECEIVE_FRAME_QUEUE_DEPTH];
+        ReceivedFrameInfo    _frameInfo[RECEIVE_FRAME_QUEUE_DEPTH];
         // The data buffer we are currently using for receiving data
         DataBuffer *         _receiveDataBuffer;
-        // The data buffer we have received a complete frame (or poll, ack etc.)
+        uint8_t              _receiveSlot;
+        // The frame last returned by getSavedFrame(). It is not reused for receiving
+        // until RECEIVE_FRAME_QUEUE_DEPTH - 1 more frames have completed.
         DataBuffer *         _savedFrame;
-        // An indicator as to which data buffer is the current working buffer (pointed
-        // to by _receiveDataBuffer).
-        uint8_t              _workingDataBuffer = 0;
+        uint8_t              _savedSlot;
+        uint8_t              _queueHead;
+        volatile uint8_t     _queuedFrames;
+        volatile unsigned int _frameOverruns;
+        volatile unsigned int _frameAborts;
+        FrameCompleteHook    _frameCompleteHook;
+        void *               _frameCompleteContext;
 
     private:
+        ByteRing<RECEIVE_RING_SIZE> _receiveRing;
+        inline void          processByte(uint8_t data);
+        inline void          checkBcc(uint8_t data);
         uint8_t              _receiveBitCounter;
         uint8_t              _latestByte;
         uint8_t              _previousByteDLE;
-        volatile bool        _frameComplete;
+        // The control character that ended the text of the frame being received
+        // (ETX, ETB, ITB, ENQ, EOT, NAK, ACK0/1).
+        uint8_t              _frameTerminator;
+        // BCC of the frame being received, worked out as the bytes arrive.
+        // _bccExpected counts down the BCC bytes still to be compared.
+        BscCrc               _bcc;
+        uint8_t              _bccExpected;
+        uint8_t              _bcc1Match;
+        uint8_t              _bccStatus;
+        // Bytes of the frame being received already taken by takeReceivedData().
+        volatile int         _streamed;
         volatile uint8_t     _inCharSync;
+        volatile uint8_t     _markBytes;
+        uint8_t              _abortMarkBytes;
         inline void          frameComplete(void);
+        void                 lostSync(void);
         volatile uint8_t *   _TXD_PORT;
         uint8_t              _TXD_BIT;
         uint8_t              _TXD_BITMASK;
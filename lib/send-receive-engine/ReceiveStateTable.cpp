@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include "ReceiveEngine.h"
+#include "ReceiveStateTable.h"
+
+// Short names to keep the tables readable.
+#define DA  RX_CLASS_DATA
+#define SY  RX_CLASS_SYN
+#define DL  RX_CLASS_DLE
+#define SX  RX_CLASS_STX
+#define SH  RX_CLASS_SOH
+#define EX  RX_CLASS_ETX
+#define EB  RX_CLASS_ETB
+#define IB  RX_CLASS_ITB
+#define EQ  RX_CLASS_ENQ
+#define ET  RX_CLASS_EOT
+#define NK  RX_CLASS_NAK
+#define AK  RX_CLASS_ACK
+
+const uint8_t receiveByteClass[256] PROGMEM = {
+    DA, SH, SX, EX, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0x00
+    DL, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, IB,    // 0x10
+    DA, DA, DA, DA, DA, DA, EB, DA, DA, DA, DA, DA, DA, EQ, DA, DA,    // 0x20
+    DA, DA, SY, DA, DA, DA, DA, ET, DA, DA, DA, DA, DA, NK, DA, DA,    // 0x30
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0x40
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0x50
+    DA, AK, DA, DA, DA, DA, DA, DA, DA, DA, DA, AK, DA, DA, DA, DA,    // 0x60
+    AK, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, AK, DA, DA, DA,    // 0x70
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0x80
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0x90
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0xA0
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0xB0
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0xC0
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0xD0
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA,    // 0xE0
+    DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA, DA     // 0xF0
+};
+
+#undef DA
+#undef SY
+#undef DL
+#undef SX
+#undef SH
+#undef EX
+#undef EB
+#undef IB
+#undef EQ
+#undef ET
+#undef NK
+#undef AK
+
+#define RS_OS   RECEIVE_STATE_OUT_OF_SYNC
+#define RS_ID   RECEIVE_STATE_IDLE
+#define RS_DT   RECEIVE_STATE_DATA
+#define RS_TR   RECEIVE_STATE_TRANSPARENT_DATA
+#define RS_B1   RECEIVE_STATE_BCC1
+#define RS_B2   RECEIVE_STATE_BCC2
+#define RS_PD   RECEIVE_STATE_PAD
+
+#define RA_N    RX_ACTION_NONE
+#define RA_W    RX_ACTION_WRITE
+#define RA_WE   RX_ACTION_WRITE_IF_EMPTY
+#define RA_WD   RX_ACTION_WRITE_DLE
+#define RA_WC   RX_ACTION_WRITE_COMPLETE
+#define RA_WDC  RX_ACTION_WRITE_DLE_COMPLETE
+
+// The short state and action names are pasted onto their prefixes, so PD, B1
+// and the like from the Arduino headers are never expanded here.
+#define RS_E(state, dle, action)    RX_ENTRY(RS_##state, dle, RA_##action)
+#define RS_ET(state, dle, action)   (RX_ENTRY(RS_##state, dle, RA_##action) | RX_TERMINATOR)
+
+/*
+ * This reproduces the if-chain in ReceiveEngine::processByteChain() exactly,
+ * including where the DLE flag is (and is not) cleared. RS_ET entries record
+ * the byte as the frame terminator.
+ *
+ * Rows are (state << 1 | previous byte was DLE), columns are the byte class:
+ *
+ *      DATA            SYN             DLE             STX             SOH             ETX
+ *      ETB             ITB             ENQ             EOT             NAK             ACK0/1 WACK RVI
+ */
+const uint8_t receiveTransition[RX_STATE_COUNT * 2][RX_CLASS_COUNT] PROGMEM = {
+    // RECEIVE_STATE_OUT_OF_SYNC
+    {   RS_E(OS,0,N),   RS_E(ID,0,W),   RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N),
+        RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N),   RS_E(OS,0,N)   },
+    {   RS_E(OS,1,N),   RS_E(ID,1,W),   RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N),
+        RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N),   RS_E(OS,1,N)   },
+
+    // RECEIVE_STATE_IDLE
+    {   RS_E(ID,0,N),   RS_E(ID,0,WE),  RS_E(ID,1,N),   RS_E(DT,0,W),   RS_E(DT,0,W),   RS_E(ID,0,N),
+        RS_E(ID,0,N),   RS_E(ID,0,N),   RS_E(ID,0,N),   RS_ET(PD,0,W),  RS_ET(PD,0,W),  RS_E(ID,0,N)   },
+    {   RS_E(ID,0,N),   RS_E(ID,1,WE),  RS_E(ID,1,N),   RS_E(TR,0,WD),  RS_E(DT,0,W),   RS_E(ID,0,N),
+        RS_E(ID,0,N),   RS_E(ID,0,N),   RS_E(ID,0,N),   RS_ET(PD,0,W),  RS_ET(PD,0,W),  RS_ET(PD,1,WD)   },
+
+    // RECEIVE_STATE_DATA
+    {   RS_E(DT,0,W),   RS_E(DT,0,WE),  RS_E(DT,1,N),   RS_E(DT,0,W),   RS_E(DT,0,W),   RS_ET(B1,0,W),
+        RS_ET(B1,0,W),  RS_E(DT,0,W),   RS_E(DT,0,W),   RS_E(DT,0,W),   RS_E(DT,0,W),   RS_E(DT,0,W)   },
+    {   RS_E(DT,1,W),   RS_E(DT,1,WE),  RS_E(DT,1,N),   RS_E(TR,0,WD),  RS_E(DT,0,W),   RS_ET(B1,1,W),
+        RS_ET(B1,1,W),  RS_E(DT,1,W),   RS_E(DT,1,W),   RS_E(DT,1,W),   RS_E(DT,1,W),   RS_E(DT,1,W)   },
+
+    // RECEIVE_STATE_TRANSPARENT_DATA
+    {   RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,1,N),   RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,0,W),
+        RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,0,W),   RS_E(TR,0,W)   },
+    {   RS_E(TR,1,W),   RS_E(TR,1,W),   RS_E(TR,0,W),   RS_E(TR,1,W),   RS_E(TR,1,W),   RS_ET(B1,1,WD),
+        RS_ET(B1,1,WD), RS_ET(B1,1,WD), RS_ET(TR,0,WDC),RS_E(TR,1,W),   RS_E(TR,1,W),   RS_E(TR,1,W)   },
+
+    // RECEIVE_STATE_BCC1
+    {   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),
+        RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W),   RS_E(B2,0,W)   },
+    {   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),
+        RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W),   RS_E(B2,1,W)   },
+
+    // RECEIVE_STATE_BCC2
+    {   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),
+        RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W),   RS_E(PD,0,W)   },
+    {   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),
+        RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W),   RS_E(PD,1,W)   },
+
+    // RECEIVE_STATE_PAD
+    {   RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),
+        RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC)   },
+    {   RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),
+        RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC),  RS_E(ID,0,WC)   }
+};
+
+#undef RS_OS
+#undef RS_ID
+#undef RS_DT
+#undef RS_TR
+#undef RS_B1
+#undef RS_B2
+#undef RS_PD
+#undef RA_N
+#undef RA_W
+#undef RA_WE
+#undef RA_WD
+#undef RA_WC
+#undef RA_WDC
+#undef RS_E
+#undef RS_ET
@@ -0,0 +1,56 @@
+#ifndef ReceiveStateTable_h
+#define ReceiveStateTable_h
+
+#include <Arduino.h>
+
+/*
+ * Tables for the table driven receive state machine (ReceiveEngine::processByteTable).
+ *
+ * Every received byte is first mapped to a byte class, then the transition table
+ * is indexed by (receive state, previous byte was DLE, byte class). Each entry is
+ * a single byte holding the next state, the next DLE flag and the action to take,
+ * so the per-byte cost is two flash reads and one switch whatever the byte is.
+ *
+ * Both tables live in flash (PROGMEM).
+ */
+
+// Byte classes
+#define RX_CLASS_DATA       0
+#define RX_CLASS_SYN        1
+#define RX_CLASS_DLE        2
+#define RX_CLASS_STX        3
+#define RX_CLASS_SOH        4
+#define RX_CLASS_ETX        5
+#define RX_CLASS_ETB        6
+#define RX_CLASS_ITB        7
+#define RX_CLASS_ENQ        8
+#define RX_CLASS_EOT        9
+#define RX_CLASS_NAK        10
+#define RX_CLASS_ACK        11      // ACK0, ACK1, WACK or RVI
+#define RX_CLASS_COUNT      12
+
+// Actions
+#define RX_ACTION_NONE              0   // Discard the byte
+#define RX_ACTION_WRITE             1   // Add the byte to the frame
+#define RX_ACTION_WRITE_IF_EMPTY    2   // Add the byte only if the frame is empty (SYN)
+#define RX_ACTION_WRITE_DLE         3   // Add DLE and then the byte
+#define RX_ACTION_WRITE_COMPLETE    4   // Add the byte and complete the frame
+#define RX_ACTION_WRITE_DLE_COMPLETE 5  // Add DLE and the byte and complete the frame
+
+// Transition table entry layout
+#define RX_NEXT_STATE_MASK  0x07
+#define RX_NEXT_DLE         0x08
+#define RX_ACTION_SHIFT     4
+#define RX_ACTION_MASK      0x07
+#define RX_TERMINATOR       0x80    // The byte ends the text (ETX, ETB, ITB, ENQ ...)
+
+#define RX_ENTRY(state, dle, action) \
+    ((state) | ((dle) ? RX_NEXT_DLE : 0) | ((action) << RX_ACTION_SHIFT))
+
+// Number of receive states (RECEIVE_STATE_OUT_OF_SYNC .. RECEIVE_STATE_PAD)
+#define RX_STATE_COUNT      7
+
+extern const uint8_t receiveByteClass[256] PROGMEM;
+extern const uint8_t receiveTransition[RX_STATE_COUNT * 2][RX_CLASS_COUNT] PROGMEM;
+
+#endif
@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include <avr/sleep.h>
 #include "SendEngine.h"
 #include "bsc_protocol.h"
 
@@ -13,10 +14,29 @@ SendEngine::SendEngine(uint8_t rxdPin) {
     // Initialize/clear data buffers
     _sendDataBuffer.clear();
     _sendBitBufferLength = 0;
+    _bcc.reset();
 
     // Initialize the state engine to be idle.
     xmitState = SEND_STATE_OFF;
     _stopOnIdle = false;
+
+    _autoBcc = false;
+
+    _streaming = false;
+    _streamEnded = false;
+    _streamUnderruns = 0;
+    _streamDLE = false;
+    _streamTransparent = false;
+    _streamFillSyn = false;
+    _streamAborted = false;
+
+    _sendQueueHead = 0;
+    _sendQueueTail = 0;
+    _sendQueuePos = 0;
+    _sendQueueCount = 0;
+    _framesSent = 0;
+    _sendCompleteHook = NULL;
+    _sendCompleteContext = NULL;
 }
 
 SendEngine::~SendEngine() {
@@ -27,10 +47,16 @@ void SendEngine::clearBuffer(void)
     // Initialize/clear data buffers
     _sendDataBuffer.clear();
     _sendBitBufferLength = 0;
+    _bcc.reset();
 
     // Initialize the state engine to be idle.
     xmitState = SEND_STATE_OFF;
     _stopOnIdle = false;
+    _streaming = false;
+    _sendQueueCount = 0;
+    _sendQueueHead = 0;
+    _sendQueueTail = 0;
+    _sendQueuePos = 0;
 }
 
 volatile uint8_t * SendEngine::getRxdPort(void)
@@ -58,42 +84,122 @@ DataBuffer & SendEngine::getDataBuffer(void) {
     return _sendDataBuffer;
 }
 
-void SendEngine::sendBit() {
-    int retVal;
+/*
+ * Fetch the next byte to go out on the line. This is the byte level half of
+ * sendBit() and is also called directly by backends that shift out whole bytes.
+ * Returns -1 when there is nothing more to send (the engine is now off).
+ */
+int SendEngine::nextByte() {
+    uint8_t data;
 
     if ( xmitState == SEND_STATE_OFF )
-      return;
-
-    // If nothing in bit buffer, then fetch character from sendDataBuffer.
-    if ( _sendBitBufferLength == 0 ) {
-        retVal = _sendDataBuffer.read(&_sendBitBuffer);
-        if ( retVal < 0 ) {
-            // There was nothing in the data buffer, so we going to send an
-            // idle character.
-            _sendBitBuffer = BSC_CONTROL_IDLE;
-            if ( _stopOnIdle ) {
-                xmitState = SEND_STATE_OFF;
-                // Set the output pin high ... idle state.
-                *_RXD_PORT |= _RXD_BIT;
-                return;
+        return -1;
+
+    if ( _sendDataBuffer.read(&data) < 0 ) {
+        if ( _streaming ) {
+            int streamData = nextStreamByte();
+            if ( streamData >= 0 ) {
+                xmitState = SEND_STATE_XMIT;
+                return streamData;
             }
-            xmitState = SEND_STATE_IDLE;
-        } else {
+            _streaming = false;
+        }
+
+        int queued = nextQueuedByte();
+        if ( queued >= 0 ) {
             xmitState = SEND_STATE_XMIT;
+            return queued;
         }
-        _sendBitBufferLength = 8;
+
+        // There was nothing in the data buffer, so we going to send an
+        // idle character.
+        if ( _stopOnIdle ) {
+            xmitState = SEND_STATE_OFF;
+            return -1;
+        }
+        xmitState = SEND_STATE_IDLE;
+        return BSC_CONTROL_IDLE;
+    }
+
+    xmitState = SEND_STATE_XMIT;
+    return data;
+}
+
+/*
+ * The next byte of the stream, idle fill if the host has not kept up, or -1
+ * once the stream has ended and been sent.
+ *
+ * A bare SYN inside transparent text (DLE STX ... DLE ETX/ETB/ITB/ENQ) is data,
+ * so the fill there is the pair DLE SYN. Should the ring run dry just after the
+ * DLE of a pair, nothing can go between it and its partner, so the block is
+ * ended with DLE ENQ (the station discards it) and the rest of the stream is
+ * dropped.
+ */
+int SendEngine::nextStreamByte(void) {
+    if ( _streamFillSyn ) {
+        _streamFillSyn = false;
+        return BSC_CONTROL_SYN;
     }
 
-    // Set pin high or low.
-    lastBitSent = _sendBitBuffer & 0x01;
-    if ( lastBitSent )
-        *_RXD_PORT |= _RXD_BIT;
+    int data = -1;
+    if ( _streamAborted )
+        _streamRing.flush();
     else
-        *_RXD_PORT &= _RXD_BITMASK;
+        data = _streamRing.get();
+
+    if ( data >= 0 ) {
+        if ( _streamDLE ) {
+            _streamDLE = false;
+            if ( data == BSC_CONTROL_STX )
+                _streamTransparent = true;
+            else if ( data == BSC_CONTROL_ETX || data == BSC_CONTROL_ETB ||
+                      data == BSC_CONTROL_ITB || data == BSC_CONTROL_ENQ )
+                _streamTransparent = false;
+        } else if ( data == BSC_CONTROL_DLE ) {
+            _streamDLE = true;
+        }
+        return data;
+    }
 
-    _savedBitBuffer = _sendBitBuffer;
-    _sendBitBuffer = _sendBitBuffer >> 1;    // Shift bits in send buffer
-    _sendBitBufferLength--;
+    if ( _streamEnded )
+        return -1;
+
+    // The host has not kept up. Idle fill and count it.
+    _streamUnderruns++;
+    if ( !_streamTransparent )
+        return BSC_CONTROL_IDLE;
+    if ( _streamDLE ) {
+        _streamDLE = false;
+        _streamTransparent = false;
+        _streamAborted = true;
+        return BSC_CONTROL_ENQ;
+    }
+    _streamFillSyn = true;
+    return BSC_CONTROL_DLE;
+}
+
+// The next byte of the frame at the head of the queue, or -1 with none queued.
+inline int SendEngine::nextQueuedByte(void) {
+    if ( _sendQueueCount == 0 )
+        return -1;
+
+    QueuedFrame * frame = &_sendQueue[_sendQueueHead];
+    uint8_t data = frame->bytes[_sendQueuePos++];
+
+    if ( _sendQueuePos >= frame->len ) {
+        _sendQueuePos = 0;
+        if ( ++_sendQueueHead == SEND_QUEUE_DEPTH )
+            _sendQueueHead = 0;
+        _sendQueueCount--;
+        _framesSent++;
+        if ( _sendCompleteHook )
+            _sendCompleteHook(_sendCompleteContext);
+    }
+    return data;
+}
+
+void SendEngine::sendBit() {
+    sendBitOn(RuntimePin(_RXD_PORT, _RXD_BIT));
 }
 
 int SendEngine::addOutputByte(uint8_t data) {
@@ -113,7 +219,13 @@ What could be coming in ...
 
 
 int SendEngine::addByte(int data) {
-    return addOutputByte( (uint8_t)data );
+    int rc = addOutputByte( (uint8_t)data );
+
+    if ( _autoBcc && _bcc.update( (uint8_t)data ) ) {
+        addOutputByte(_bcc.getBcc1());
+        rc = addOutputByte(_bcc.getBcc2());
+    }
+    return rc;
 }
 
 void SendEngine::startSending() {
@@ -125,15 +237,110 @@ void SendEngine::stopSending() {
     xmitState = SEND_STATE_OFF;
 }
 
+/*
+ * Wait for the data to have gone out. Between checks the CPU sleeps until the
+ * next interrupt, as ReceiveEngine::waitReceivedFrameComplete() does.
+ */
 void SendEngine::waitForSendIdle() {
-    while (xmitState != SEND_STATE_IDLE &&
-           xmitState != SEND_STATE_OFF);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while ( true ) {
+        noInterrupts();
+        if ( xmitState == SEND_STATE_IDLE || xmitState == SEND_STATE_OFF ) {
+            interrupts();
+            return;
+        }
+        sleep_enable();
+        interrupts();
+        sleep_cpu();
+        sleep_disable();
+    }
 }
 
 void SendEngine::stopSendingOnIdle() {
     _stopOnIdle = true;
 }
 
+/*
+ * Start streaming. Call with the engine stopped, after loading anything to go
+ * out ahead of the stream (PAD, SYN ...) into the data buffer.
+ */
+void SendEngine::startStream(void) {
+    _streamRing.flush();
+    _streamUnderruns = 0;
+    _streamDLE = false;
+    _streamTransparent = false;
+    _streamFillSyn = false;
+    _streamAborted = false;
+    _streamEnded = false;
+    _streaming = true;
+}
+
+// No more data will be put into the stream ring.
+void SendEngine::endStream(void) {
+    _streamEnded = true;
+}
+
+unsigned int SendEngine::getStreamUnderruns(void) {
+    return _streamUnderruns;
+}
+
+bool SendEngine::queueFrame(const uint8_t *data, uint8_t len) {
+    if ( len > SEND_QUEUE_FRAME_MAX )
+        return false;
+    return enqueue(data, len, true);
+}
+
+bool SendEngine::queueFrameRef(const uint8_t *data, uint8_t len) {
+    return enqueue(data, len, false);
+}
+
+bool SendEngine::enqueue(const uint8_t *data, uint8_t len, bool copy) {
+    QueuedFrame * frame = &_sendQueue[_sendQueueTail];
+
+    if ( len == 0 || _sendQueueCount >= SEND_QUEUE_DEPTH )
+        return false;
+
+    // The interrupt routine does not look at the tail slot until it is counted.
+    if ( copy ) {
+        memcpy(frame->data, data, len);
+        data = frame->data;
+    }
+    frame->bytes = data;
+    frame->len = len;
+    if ( ++_sendQueueTail == SEND_QUEUE_DEPTH )
+        _sendQueueTail = 0;
+
+    noInterrupts();
+    _sendQueueCount++;
+    if ( xmitState == SEND_STATE_OFF ) {
+        xmitState = SEND_STATE_XMIT;
+        _stopOnIdle = true;
+    }
+    interrupts();
+    return true;
+}
+
+uint8_t SendEngine::getSendQueueFree(void) {
+    return SEND_QUEUE_DEPTH - _sendQueueCount;
+}
+
+unsigned long SendEngine::getFramesSent(void) {
+    unsigned long sent;
+
+    // Counted in the interrupt routine, and more than one byte to read.
+    noInterrupts();
+    sent = _framesSent;
+    interrupts();
+    return sent;
+}
+
+void SendEngine::setSendCompleteHook(SendCompleteHook hook, void *context) {
+    noInterrupts();
+    _sendCompleteHook = hook;
+    _sendCompleteContext = context;
+    interrupts();
+}
+
 int SendEngine::getRemainingDataToBeSent(void) {
     int remainingDataLength = _sendDataBuffer.getLength() - _sendDataBuffer.getPos();
     return remainingDataLength;
@@ -3,20 +3,85 @@
 
 #include <Arduino.h>
 #include "DataBuffer.h"
+#include "ByteRing.h"
+#include "BscCrc.h"
+#include "PinPolicy.h"
 
 #define SEND_STATE_OFF                1
 #define SEND_STATE_IDLE               2
 #define SEND_STATE_XMIT               3
 
+// Size of the ring used to stream data to the line (startStream/putStream).
+// Must be a power of two, at most 128.
+#ifndef SEND_STREAM_RING_SIZE
+#define SEND_STREAM_RING_SIZE         128
+#endif
+
+// Frames that can wait behind the data buffer (queueFrame()), and the most
+// bytes in each. They are held in the engine, so this is for control frames
+// (poll, select, EOT, ACK ...) rather than text.
+#ifndef SEND_QUEUE_DEPTH
+#define SEND_QUEUE_DEPTH              2
+#endif
+#ifndef SEND_QUEUE_FRAME_MAX
+#define SEND_QUEUE_FRAME_MAX          16
+#endif
+
+// Called as each queued frame goes out, see SendEngine::setSendCompleteHook().
+typedef void (*SendCompleteHook)(void *context);
+
 class SendEngine {
     public:
         SendEngine(uint8_t rxdPin);
         virtual ~SendEngine();
         void sendBit(void);
+        int nextByte(void);
+
+        // sendBit() for a given pin policy (see PinPolicy.h). The rxd pin this
+        // engine was constructed with is only used by sendBit().
+        template <class PIN>
+        inline void sendBitOn(const PIN &rxdPin) {
+            int nextData;
+
+            if ( xmitState == SEND_STATE_OFF )
+              return;
+
+            // If nothing in bit buffer, then fetch character from sendDataBuffer.
+            if ( _sendBitBufferLength == 0 ) {
+                nextData = nextByte();
+                if ( nextData < 0 ) {
+                    // Set the output pin high ... idle state.
+                    rxdPin.high();
+                    return;
+                }
+                _sendBitBuffer = (uint8_t)nextData;
+                _sendBitBufferLength = 8;
+            }
+
+            // Set pin high or low.
+            lastBitSent = _sendBitBuffer & 0x01;
+            if ( lastBitSent )
+                rxdPin.high();
+            else
+                rxdPin.low();
+
+            _savedBitBuffer = _sendBitBuffer;
+            _sendBitBuffer = _sendBitBuffer >> 1;    // Shift bits in send buffer
+            _sendBitBufferLength--;
+        }
         volatile uint8_t xmitState = SEND_STATE_IDLE;
         int addByte(int data);
         void clearBuffer(void);
 
+        // With auto BCC on, addByte() works out the BCC of each block as it is
+        // queued and adds BCC1 BCC2 after the ETB/ETX/ITB that ends it.
+        inline void setAutoBcc(bool autoBcc) {
+            _autoBcc = autoBcc;
+        }
+        inline bool getAutoBcc(void) {
+            return _autoBcc;
+        }
+
         virtual void startSending();
         virtual void stopSending();
         virtual void stopSendingOnIdle();
@@ -28,6 +93,39 @@ class SendEngine {
         uint8_t getBitBuffer();
         uint8_t getBitBufferLength();
         int getRemainingDataToBeSent(void);
+
+        // Streaming. Once the data buffer has been sent, bytes are taken from the
+        // stream ring until endStream() is called and the ring is empty. Should the
+        // ring run dry before then, an idle character (DLE SYN in transparent
+        // text) is sent and counted as an underrun. See nextStreamByte().
+        void startStream(void);
+        inline bool putStream(uint8_t data) {
+            return _streamRing.put(data);
+        }
+        inline uint8_t getStreamCount(void) {
+            return _streamRing.count();
+        }
+        inline uint8_t getStreamFree(void) {
+            return _streamRing.getCapacity() - _streamRing.count();
+        }
+        void endStream(void);
+        unsigned int getStreamUnderruns(void);
+
+        // Queued frames follow the data buffer (and any stream) out with no
+        // idle characters in between, so the next frame can be got ready while
+        // one is on the line. queueFrame() copies the frame and starts the
+        // engine, to stop on idle, if it is off. False if the queue is full or
+        // the frame too long. clearBuffer() empties the queue.
+        bool queueFrame(const uint8_t *data, uint8_t len);
+        // As queueFrame(), sending the frame from where it is. It must stay
+        // as it is until sent, see getFramesSent().
+        bool queueFrameRef(const uint8_t *data, uint8_t len);
+        uint8_t getSendQueueFree(void);
+        // Queued frames whose last byte has gone to the line.
+        unsigned long getFramesSent(void);
+        // Have hook(context) called, from the interrupt routine, as each queued
+        // frame's last byte goes to the line. NULL for none.
+        void setSendCompleteHook(SendCompleteHook hook, void *context);
         uint8_t _savedBitBuffer;
         DataBuffer & getDataBuffer(void);
         uint8_t lastBitSent;
@@ -38,6 +136,35 @@ class SendEngine {
         uint8_t              _sendBitBufferLength;
         volatile uint8_t     _stopOnIdle;
 
+        bool                 _autoBcc;
+        BscCrc               _bcc;
+
+        ByteRing<SEND_STREAM_RING_SIZE> _streamRing;
+        volatile uint8_t     _streaming;
+        volatile uint8_t     _streamEnded;
+        volatile unsigned int _streamUnderruns;
+        uint8_t              _streamDLE;            // Last stream byte a DLE, awaiting its partner
+        uint8_t              _streamTransparent;    // DLE STX sent, no DLE ETX/ETB/ITB/ENQ yet
+        uint8_t              _streamFillSyn;        // DLE of a DLE SYN fill sent, SYN next
+        uint8_t              _streamAborted;        // Block ended with DLE ENQ, rest dropped
+        int                  nextStreamByte(void);
+
+        struct QueuedFrame {
+            const uint8_t * bytes;      // data, or the caller's frame
+            uint8_t         len;
+            uint8_t         data[SEND_QUEUE_FRAME_MAX];
+        };
+        QueuedFrame          _sendQueue[SEND_QUEUE_DEPTH];
+        uint8_t              _sendQueueHead;
+        uint8_t              _sendQueueTail;
+        uint8_t              _sendQueuePos;     // Next byte of the frame at the head
+        volatile uint8_t     _sendQueueCount;
+        volatile unsigned long _framesSent;
+        SendCompleteHook     _sendCompleteHook;
+        void *               _sendCompleteContext;
+        inline int           nextQueuedByte(void);
+        bool                 enqueue(const uint8_t *data, uint8_t len, bool copy);
+
         volatile uint8_t *_RXD_PORT;
         uint8_t           _RXD_BIT;
         uint8_t           _RXD_BITMASK;
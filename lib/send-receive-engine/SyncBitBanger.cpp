@@ -1,135 +1,129 @@
 #include "SyncBitBanger.h"
 
 SyncBitBanger * SyncBitBanger::syncBitBangerInstance = NULL;
-unsigned int SyncBitBanger::interruptCallCount = 0;
+
+/*
+ * Time the phase just run and count the bits on the line. TimerOne counts
+ * Timer1 up from zero at the interrupt to ICR1 and back down again, one count
+ * per CPU cycle, and sets ICF1 at the top. TOV1 set again already means the
+ * next interrupt is due.
+ */
+inline void SyncBitBanger::interruptDone(uint8_t phase) {
+    unsigned int cycles = TCNT1;
+
+    if ( TIFR1 & _BV(ICF1) )
+        cycles = 2 * ICR1 - cycles;
+    if ( TIFR1 & _BV(TOV1) )
+        lateInterrupts++;
+
+    if ( cycles < phaseCyclesMin[phase] )
+        phaseCyclesMin[phase] = cycles;
+    if ( cycles > phaseCyclesMax[phase] )
+        phaseCyclesMax[phase] = cycles;
+    phaseCycles[phase] += cycles;
+
+    if ( phase == 3 ) {
+        if ( sendEngine->xmitState == SEND_STATE_XMIT )
+            bitsSent++;
+        if ( receiveEngine->receiveState != RECEIVE_STATE_OUT_OF_SYNC )
+            bitsReceived++;
+    }
+
+    interruptCount++;
+    if ( ++periodCounter >= oneSecondPeriodCount ) {
+        interruptEverySecond();
+        periodCounter = 0;
+    }
+}
 
 // Static interrupt routine
 void SyncBitBanger::serialDriverInterruptRoutine(void) {
     static uint8_t clockPhase = 0;
+    uint8_t phase = clockPhase;
+
+    // Timer1 passes its top once every period, so clear the flag for
+    // interruptDone() to see whether this phase ran past it.
+    TIFR1 = _BV(ICF1);
 
     switch(clockPhase) {
         case 0:
             // Put the output data pin in the correct state
+#ifdef LINE_PINS_FIXED
+            syncBitBangerInstance->sendEngine->sendBitOn(LineRxdPin());
+#else
             syncBitBangerInstance->sendEngine->sendBit();
+#endif
             clockPhase++;
             break;
 
         case 1:
             // Set the output clock lines to high
-            syncBitBangerInstance->interruptAssertClockLines();
             // Read the state of the input data pin
+#ifdef LINE_PINS_FIXED
+            syncBitBangerInstance->assertClockLinesOn(LineRxclkPin(), LineTxclkPin());
+            syncBitBangerInstance->receiveEngine->getBitFrom(LineTxdPin());
+#else
+            syncBitBangerInstance->interruptAssertClockLines();
             syncBitBangerInstance->receiveEngine->getBit();
+#endif
             clockPhase++;
             break;
 
         case 2:
+#ifdef RECEIVE_ENGINE_DEFERRED
+            // Only assemble the byte here. The state machine runs later
+            // from ReceiveEngine::drain().
+            syncBitBangerInstance->receiveEngine->collectBit();
+#else
             // This is the call that may take some cycles to execute.
             // Every 8th bit it is going to process the received byte and
             // look at the byte value and set the state machine appropriately.
             syncBitBangerInstance->receiveEngine->processBit();
+#endif
             clockPhase++;
             break;
 
         case 3:
             // Set the output clock lines to low.
+#ifdef LINE_PINS_FIXED
+            syncBitBangerInstance->deassertClockLinesOn(LineRxclkPin(), LineTxclkPin());
+#else
             syncBitBangerInstance->interruptDeassertClockLines();
+#endif
             clockPhase = 0;
             break;
     }
-//    periodCounter++;
-//    if ( periodCounter > oneSecondPeriodCount ) {
-//        interruptEverySecond();
-//        periodCounter = 0;
-//    }
-}
 
-SyncBitBanger::SyncBitBanger() {
-    this->sendEngine = NULL;
-    this->receiveEngine = NULL;
-
-    // RS232 pin names are from the DTE point of view.
-    // Therefore, for example, the DTE transmit data pin is an input to the
-    // DCE. Likewise, the DTE receive data pin is an output from the DCE.
+    syncBitBangerInstance->interruptDone(phase);
+}
 
-    ctsPin = 8;         // Output
-    dsrPin = 6;         // Output
-    dtrPin = 10;        // Input
-    rtsPin = 2;         // Input
-    cdPin  = 5;         // Output
-    riPin  = 0;         // Output - not used.
+SyncBitBanger::SyncBitBanger() : LineBackend() {
+    debugDataPin = 0;
     rxclkPin = 14;      // Output
     txclkPin = 16;      // Output
     dteclkPin = 15;     // Input tx data clock from DTE -- Not used, but assigned and wired.
-    txdPin = 3;         // Input tx data
-    rxdPin = 9;         // Output rx data
 
     bitRate = 300;      // Bit rate. 19,200 bps is about the max for
                         // bit banging the synchronous serial DCE.
 
-    dsrReady = false;
+    interruptPeriod = (long)1000000 / bitRate / 4;
+    oneSecondPeriodCount = (long)1000000 / interruptPeriod;
+    periodCounter = 0;
+    clearStats();
+    startSecond();
 };
 
 SyncBitBanger::~SyncBitBanger() {
-    if ( this->sendEngine )
-        delete this->sendEngine;
-
-    if ( this->receiveEngine )
-        delete this->receiveEngine;
 }
 
-void SyncBitBanger::setDsrNotReady()
+void SyncBitBanger::idleClockLines()
 {
-        digitalWrite(dsrPin, HIGH); // Active low
-        digitalWrite(cdPin, HIGH); // Active low
-        digitalWrite(ctsPin, HIGH); // Active low
-        digitalWrite(rxdPin, HIGH); // Idle state for the data line we are sending on.
-
         digitalWrite(txclkPin, LOW);
         digitalWrite(rxclkPin, LOW);
-        dsrReady = false;
-}
-
-void SyncBitBanger::setDsrReady()
-{
-    if ( !dsrReady ) {
-        digitalWrite(dsrPin, LOW);    // Active low
-        delay(500);
-        // This is going to be my temp ring indicator.
-        digitalWrite(cdPin, LOW); //Ring!
-        delay(2000);
-        digitalWrite(cdPin, HIGH); // Silent
-        delay(4000);
-        digitalWrite(cdPin, LOW); // Ring! short ring because we going to pretend an answer.
-        delay(500);
-        digitalWrite(cdPin, HIGH); // Silent after answer
-        //
-        // ctsPin now also drives CD (temp)
-        digitalWrite(ctsPin, LOW);
-        delay(500);
-        digitalWrite(rxdPin, HIGH);    // Idle state for the data line we are sending on.
-        dsrReady = true;
-
-        digitalWrite(txclkPin, LOW);
-        digitalWrite(rxclkPin, LOW);
-    }
 }
 
-void SyncBitBanger::deviceReset() {
-    setDsrNotReady();
-    delay(2000);
-    setDsrReady();
-}
-
-
-
 void SyncBitBanger::setupPins() {
-    pinMode(ctsPin, OUTPUT);
-    pinMode(dsrPin, OUTPUT);
-    pinMode(dtrPin, INPUT);
-    pinMode(cdPin,OUTPUT);
-    //pinMode(riPin, OUTPUT);  // This is not being used because
-                               // we don't have enough output channels
-                               // on the 3 MAX232 ICs.
+    this->setupModemPins();
 
     pinMode(dteclkPin, INPUT);
 
@@ -143,8 +137,108 @@ void SyncBitBanger::setupPins() {
 }
 
 
+/*
+ * Called from the interrupt routine every oneSecondPeriodCount interrupts. Any
+ * time over that is interrupts that were held off so long that Timer1 had
+ * already dropped them.
+ */
 void SyncBitBanger::interruptEverySecond() {
+    unsigned long now = micros();
+    long extra = (long)(now - secondStartMicros) - periodCounter * interruptPeriod;
+
+    if ( extra >= interruptPeriod )
+        missedMicros += extra;
+
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ ) {
+        lastPhaseCycles[p] = phaseCycles[p];
+        phaseCycles[p] = 0;
+    }
+    lastPeriodCount = periodCounter;
+    bitsSentPerSecond = bitsSent;
+    bitsReceivedPerSecond = bitsReceived;
+    bitsSent = 0;
+    bitsReceived = 0;
+    secondStartMicros = now;
+}
+
+void SyncBitBanger::clearStats() {
+    interruptCount = 0;
+    lateInterrupts = 0;
+    missedMicros = 0;
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ ) {
+        phaseCyclesMin[p] = 0xffff;
+        phaseCyclesMax[p] = 0;
+    }
+}
 
+// Start the per second figures again, at a new rate.
+void SyncBitBanger::startSecond() {
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ ) {
+        phaseCycles[p] = 0;
+        lastPhaseCycles[p] = 0;
+    }
+    lastPeriodCount = 0;
+    bitsSent = 0;
+    bitsReceived = 0;
+    bitsSentPerSecond = 0;
+    bitsReceivedPerSecond = 0;
+    secondStartMicros = micros();
+}
+
+bool SyncBitBanger::getStats(LineStats *stats, bool clear) {
+    unsigned long cycles[LINE_STATS_PHASES];
+    unsigned long samples;
+    unsigned long missed;
+
+    noInterrupts();
+    stats->interrupts = interruptCount;
+    stats->lateInterrupts = lateInterrupts;
+    missed = missedMicros;
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ ) {
+        stats->phaseCyclesMin[p] = phaseCyclesMax[p] ? phaseCyclesMin[p] : 0;
+        stats->phaseCyclesMax[p] = phaseCyclesMax[p];
+        cycles[p] = lastPhaseCycles[p];
+    }
+    samples = lastPeriodCount / LINE_STATS_PHASES;
+    stats->bitsSentPerSecond = bitsSentPerSecond;
+    stats->bitsReceivedPerSecond = bitsReceivedPerSecond;
+    if ( clear )
+        clearStats();
+    interrupts();
+
+    stats->periodCycles = interruptPeriod * (F_CPU / 1000000L);
+    stats->missedInterrupts = missed / interruptPeriod;
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ )
+        stats->phaseCyclesAvg[p] = samples ? cycles[p] / samples : 0;
+    return true;
+}
+
+/*
+ * Timer1 takes whole microseconds, so the interrupt period is rounded down and
+ * the line runs a little fast (0.16% at 9600 and 19200 bps).
+ */
+int SyncBitBanger::changeBitRate(long rate, LineRateInfo *info) {
+    long period = (long)1000000 / rate / 4;
+    unsigned int longest = 0;
+
+    for ( uint8_t p = 0; p < LINE_STATS_PHASES; p++ )
+        if ( phaseCyclesMax[p] > longest )
+            longest = phaseCyclesMax[p];
+    if ( period < SYNC_ISR_BUDGET_MICROS || longest >= period * (F_CPU / 1000000L) )
+        return LINE_RATE_TOO_FAST;
+
+    noInterrupts();
+    bitRate = rate;
+    interruptPeriod = period;
+    oneSecondPeriodCount = (long)1000000 / interruptPeriod;
+    periodCounter = 0;
+    clearStats();
+    startSecond();
+    Timer1.setPeriod(interruptPeriod);
+    interrupts();
+
+    setRateInfo(info, rate, interruptPeriod * 4);
+    return LINE_RATE_OK;
 }
 
 void SyncBitBanger::init() {
@@ -170,7 +264,8 @@ void SyncBitBanger::init() {
     delay(1000);
 
     syncBitBangerInstance = this;
-    interruptCallCount = 0;
+    clearStats();
+    startSecond();
 
     //Serial.print(F("DEBUG: Setting up interrupt routine with interval of "));
     //Serial.print(interruptPeriod);
@@ -180,10 +275,6 @@ void SyncBitBanger::init() {
     Timer1.attachInterrupt(serialDriverInterruptRoutine);
 
     delay(1000);
-    unsigned int callCount = interruptCallCount;
-    //Serial.print(F("After one second the interrupt routine has been called "));
-    //Serial.print(callCount);
-    //Serial.println(F(" times."));
 
     //Serial.print(F("DEBUG: RXCLK_PORT          = 0x"));
     //Serial.println((unsigned int)RXCLK_PORT, 16);
@@ -198,11 +289,3 @@ void SyncBitBanger::init() {
     //Serial.print(F("DEBUG: TXCLK_BITMASK       = 0x"));
     //Serial.println((unsigned int)TXCLK_BITMASK, 16);
 }
-
-SyncControl::SyncControl(SyncBitBanger * instance) {
-    this->bitBangerInstance = instance;
-}
-
-void SyncControl::deviceReset() {
-    this->bitBangerInstance->deviceReset();
-}
\ No newline at end of file
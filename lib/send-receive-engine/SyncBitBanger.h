@@ -7,6 +7,8 @@
 #include <Arduino.h>
 #include <TimerOne.h>
 
+#include "LineBackend.h"
+#include "PinPolicy.h"
 #include "SendEngine.h"
 #include "ReceiveEngine.h"
 
@@ -15,46 +17,60 @@
 #define CYCLE_STATE_STARTBIT 0
 #define CYCLE_STATE_MIDBIT   1
 
+// Longest the interrupt routine takes in any one phase, in microseconds. Bit
+// rates giving a shorter interrupt period (a quarter bit) are refused, as are
+// any shorter than the longest phase measured so far (see getStats()). 19,200
+// bps (13us) is about the most a 16MHz ATmega32U4 keeps up with.
+#ifndef SYNC_ISR_BUDGET_MICROS
+#define SYNC_ISR_BUDGET_MICROS  12
+#endif
 
-class SyncBitBanger {
-    public:
 
-        int txdPin, rxdPin, debugDataPin, rxclkPin, txclkPin, dteclkPin;
-        int ctsPin, rtsPin, dsrPin, dtrPin, cdPin, riPin;
-        long    bitRate;
-        uint8_t dsrReady;
+class SyncBitBanger : public LineBackend {
+    public:
 
-        SendEngine      *sendEngine;
-        ReceiveEngine   *receiveEngine;
+        int debugDataPin, rxclkPin, txclkPin, dteclkPin;
 
         SyncBitBanger();
-        ~SyncBitBanger();
-        void init();
-        void setDsrNotReady();
-        void setDsrReady();
-        void deviceReset();
+        virtual ~SyncBitBanger();
+        virtual void init();
 
         // Interrupt stuff must be static
 
         static SyncBitBanger * syncBitBangerInstance;
-        static unsigned int interruptCallCount;
         static void serialDriverInterruptRoutine(void);
 
         inline void interruptAssertClockLines() {
+                assertClockLinesOn(RuntimePin(RXCLK_PORT, RXCLK_BIT),
+                                   RuntimePin(TXCLK_PORT, TXCLK_BIT));
+        }
+
+        inline void interruptDeassertClockLines() {
+                deassertClockLinesOn(RuntimePin(RXCLK_PORT, RXCLK_BIT),
+                                     RuntimePin(TXCLK_PORT, TXCLK_BIT));
+        }
+
+        // The clock helpers for a given pin policy (see PinPolicy.h).
+        template <class RXCLK, class TXCLK>
+        inline void assertClockLinesOn(const RXCLK &rxclk, const TXCLK &txclk) {
                 // Assert output clock for data being sent (which is on DTE rxdPin)
                 // Assert output clock for data being received (which is on DTE txdPin)
-                *RXCLK_PORT |= RXCLK_BIT;
-                *TXCLK_PORT |= TXCLK_BIT;
-                interruptCallCount++;
+                rxclk.high();
+                txclk.high();
         }
 
-        inline void interruptDeassertClockLines() {
+        template <class RXCLK, class TXCLK>
+        inline void deassertClockLinesOn(const RXCLK &rxclk, const TXCLK &txclk) {
                 // De-assert output clocks
-                *RXCLK_PORT &= RXCLK_BITMASK;
-                *TXCLK_PORT &= TXCLK_BITMASK;
+                rxclk.low();
+                txclk.low();
         }
         void interruptEverySecond();
 
+        // Each phase of the interrupt routine is timed from Timer1 as it
+        // finishes, which costs a few cycles of its own.
+        virtual bool getStats(LineStats *stats, bool clear);
+
     private:
 
         volatile uint8_t *RXCLK_PORT;
@@ -69,21 +85,32 @@ class SyncBitBanger {
         long oneSecondPeriodCount;
         long periodCounter;
 
+        // Interrupt statistics, kept by the interrupt routine. The per second
+        // figures are worked out in getStats() to keep divides out of it.
+        unsigned long interruptCount;
+        unsigned long lateInterrupts;
+        unsigned long missedMicros;         // Longer than the interrupts counted
+        unsigned int  phaseCyclesMin[LINE_STATS_PHASES];
+        unsigned int  phaseCyclesMax[LINE_STATS_PHASES];
+        unsigned long phaseCycles[LINE_STATS_PHASES];       // This second
+        unsigned long lastPhaseCycles[LINE_STATS_PHASES];   // The last one
+        unsigned long lastPeriodCount;
+        unsigned long bitsSent, bitsReceived;
+        unsigned long bitsSentPerSecond, bitsReceivedPerSecond;
+        unsigned long secondStartMicros;
+
         void setupPins();
+        void interruptDone(uint8_t phase);
+        void clearStats();
+        void startSecond();
 
+    protected:
+        virtual void idleClockLines();
+        virtual int changeBitRate(long rate, LineRateInfo *info);
 
 
 };
 
-class SyncControl {
-    public:
-        SyncControl(SyncBitBanger *bitBangerInstance);
-        virtual ~SyncControl() {};
-        void deviceReset();
-    private:
-        SyncBitBanger * bitBangerInstance;
-};
-
 
 #endif
 
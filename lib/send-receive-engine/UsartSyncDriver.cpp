@@ -0,0 +1,100 @@
+#include "UsartSyncDriver.h"
+
+#ifdef LINE_BACKEND_USART
+
+#ifndef UCSR1C
+#error "UsartSyncDriver requires USART1 (ATmega32U4)"
+#endif
+
+#define XCK1_DDR    DDRD
+#define XCK1_BIT    PD5
+
+// UCSR1C bit in MSPIM mode (shared with UCSZ11, so not in the io header)
+#define MSPIM_UDORD 2
+
+UsartSyncDriver * UsartSyncDriver::usartSyncDriverInstance = NULL;
+
+// Ready for the next byte to send.
+ISR(USART1_UDRE_vect) {
+    UDR1 = UsartSyncDriver::usartSyncDriverInstance->nextLineByte();
+}
+
+// A byte has been clocked in.
+ISR(USART1_RX_vect) {
+    UsartSyncDriver::usartSyncDriverInstance->lineByteReceived(UDR1);
+}
+
+UsartSyncDriver::UsartSyncDriver() : LineBackend() {
+    txdPin = 0;         // Input tx data (RXD1)
+    rxdPin = 1;         // Output rx data (TXD1)
+
+    bitRate = 9600;
+}
+
+UsartSyncDriver::~UsartSyncDriver() {
+    UCSR1B = 0;
+}
+
+void UsartSyncDriver::setupPins() {
+    this->setupModemPins();
+
+    pinMode(txdPin, INPUT_PULLUP);
+    pinMode(rxdPin, OUTPUT);
+}
+
+void UsartSyncDriver::startUsart() {
+    long ubrr = (F_CPU / 2 / bitRate) - 1;
+
+    if ( ubrr > 4095 )
+        ubrr = 4095;
+    if ( ubrr < 0 )
+        ubrr = 0;
+    bitRate = F_CPU / 2 / (ubrr + 1);
+
+    // Sequence from the datasheet: baud rate zero, XCK as output (which makes us
+    // the master), select MSPIM, enable, then set the real baud rate.
+    UBRR1 = 0;
+    XCK1_DDR |= _BV(XCK1_BIT);
+    // MSPIM, LSB first, data set up on the falling edge and sampled on
+    // the rising edge of the clock (UCPHA = UCPOL = 0), same as the bit banger.
+    UCSR1C = _BV(UMSEL11) | _BV(UMSEL10) | _BV(MSPIM_UDORD);
+    UCSR1B = _BV(RXEN1) | _BV(TXEN1) | _BV(RXCIE1) | _BV(UDRIE1);
+    UBRR1 = ubrr;
+}
+
+// The clock is F_CPU / 2 / (UBRR + 1). Rates below the slowest it can go are
+// refused here rather than raised.
+int UsartSyncDriver::changeBitRate(long rate, LineRateInfo *info) {
+    long ubrr = (F_CPU / 2 / rate) - 1;
+
+    if ( ubrr > 4095 )
+        return LINE_RATE_UNSUPPORTED;
+    if ( ubrr < 0 )
+        ubrr = 0;
+
+    UBRR1 = ubrr;
+    bitRate = F_CPU / 2 / (ubrr + 1);
+
+    setRateInfo(info, rate, (ubrr + 1) * 2 * 1000000.0 / F_CPU);
+    return LINE_RATE_OK;
+}
+
+void UsartSyncDriver::init() {
+    this->setupPins();
+
+    sendEngine = new SendEngine(rxdPin);
+    receiveEngine = new ReceiveEngine(txdPin, ctsPin);
+
+    this->setDsrNotReady();
+    delay(1000);
+
+    usartSyncDriverInstance = this;
+
+    // From here the clock runs continuously, with PAD (mark) sent while the
+    // send engine is off, as the receiver is only clocked while we transmit.
+    startUsart();
+
+    delay(1000);
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef UsartSyncDriver_h
+#define UsartSyncDriver_h
+
+#include <Arduino.h>
+
+#include "LineBackend.h"
+
+/*
+ * Line backend using the ATmega32U4 USART1 in master SPI mode (MSPIM). Build
+ * with LINE_BACKEND_USART defined to use it instead of the SyncBitBanger.
+ *
+ * The USART generates the clock on XCK1 and shifts a byte out on TXD1 and a
+ * byte in on RXD1 for every eight clocks, least significant bit first. The data
+ * register empty interrupt takes the next byte from the send engine and the
+ * receive complete interrupt hands the received byte to the receive engine, so
+ * there are two interrupts per byte rather than four per bit.
+ *
+ * Wiring differs from the bit banger ...
+ *
+ * Signal     DCE-Pin     Arduino Pin     Leonardo Port
+ * TXD .      2 .         0 (RXD1)        PD2
+ * RXD .      3 .         1 (TXD1)        PD3
+ * TXCLK .    15 .        XCK1            PD5
+ * RXCLK      17 .        XCK1            PD5
+ *
+ * XCK1 (PD5) is not brought out to a header on the Leonardo (it drives the TX
+ * LED), so a wire has to be taken from the LED side of its resistor. Both clock
+ * lines are driven from the one clock.
+ *
+ * The slowest rate the USART can clock is F_CPU / 8192 (about 1950 bps at 16MHz).
+ * Slower rates are raised to that.
+ */
+class UsartSyncDriver : public LineBackend {
+    public:
+        UsartSyncDriver();
+        virtual ~UsartSyncDriver();
+        virtual void init();
+
+        // Interrupt stuff must be static
+        static UsartSyncDriver * usartSyncDriverInstance;
+
+    protected:
+        virtual int changeBitRate(long rate, LineRateInfo *info);
+
+    private:
+        void setupPins();
+        void startUsart();
+};
+
+#endif
@@ -90,10 +90,14 @@
 #include "SendEngine.h"
 #include "ReceiveEngine.h"
 #include "CommandProcessor.h"
+#ifdef LINE_BACKEND_USART
+#include "UsartSyncDriver.h"
+#else
 #include "SyncBitBanger.h"
+#endif
 
 //CommandProcessorBinary * commandProcessor;
-SyncBitBanger * syncBitBanger;
+LineBackend * lineBackend;
 //SyncControl * syncControl;
 CommandProcessorFrontEnd * commandProcFE;
 
@@ -103,6 +107,8 @@ CommandProcessorFrontEnd * commandProcFE;
 void loop() {
     static unsigned long lastDataReceivedTime = millis();
 
+    lineBackend->receiveEngine->drain();
+
     if ( Serial ) {
         lastDataReceivedTime = commandProcFE->getAndProcessCommand();
     }
@@ -126,10 +132,14 @@ void setup() {
     }
 
     pinMode(LED_BUILTIN, OUTPUT);
-    syncBitBanger = new SyncBitBanger();
-    syncBitBanger->init();
-    commandProcFE = new CommandProcessorFrontEnd(syncBitBanger);
-    syncBitBanger->setDsrReady();
+#ifdef LINE_BACKEND_USART
+    lineBackend = new UsartSyncDriver();
+#else
+    lineBackend = new SyncBitBanger();
+#endif
+    lineBackend->init();
+    commandProcFE = new CommandProcessorFrontEnd(lineBackend);
+    lineBackend->setDsrReady();
     // port = portOutputRegister(digitalPinToPort(syncBitBanger->txclkPin));
     // mask1 = digitalPinToBitMask(syncBitBanger->txclkPin);
     // mask2  = ~digitalPinToBitMask(syncBitBanger->txclkPin);
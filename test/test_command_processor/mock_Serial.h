@@ -9,21 +9,28 @@ class MockSerial_ : public Serial_ {
         byte   writeBuffer[128];
 
         int    readLen, readPtr, writePtr;
+        // Bytes read after those in readBuffer, made up rather than stored so
+        // that long payloads fit on the board (see setReadGenerated()).
+        int    generatedLen;
 
         MockSerial_() {
-            readLen = 0;
-            readPtr = 0;
-            writePtr = 0;
+            reset();
         }
         void reset() {
             readLen = 0;
             readPtr = 0;
             writePtr = 0;
+            generatedLen = 0;
+        }
+        virtual int available(void) {
+            return readLen + generatedLen - readPtr;
         }
         virtual int read(void) {
-            if ( readPtr >= readLen )
+            if ( readPtr >= readLen + generatedLen )
                 return -1;
 
+            if ( readPtr >= readLen )
+                return generatedByte(readPtr++ - readLen);
             return readBuffer[readPtr++];
         }
         virtual size_t write(uint8_t data) {
@@ -50,6 +57,14 @@ class MockSerial_ : public Serial_ {
             }
             readPtr = 0;
             readLen = len;
+            generatedLen = 0;
+        }
+        // Follow what is in readBuffer with len bytes of generatedByte().
+        void setReadGenerated(int len) {
+            generatedLen = len;
+        }
+        static byte generatedByte(int idx) {
+            return 0x40 + (idx % 0x3F);
         }
 };
 
@@ -3,6 +3,9 @@
 #include "DataBuffer.h"
 
 extern void test_CommandProcessor();
+extern void test_CommandProcessorStream();
+extern void test_CommandProcessorWriteStream();
+extern void test_ControlUnitEmulator();
 
 void setUp(void) {
 
@@ -22,6 +25,20 @@ void setup() {
 
 void loop() {
     test_CommandProcessor();
+    test_CommandProcessorStream();
+    test_CommandProcessorWriteStream();
+    test_ControlUnitEmulator();
     UNITY_END();
+#ifdef ARDUINO
     while(1);
-}
\ No newline at end of file
+#endif
+}
+
+#ifndef ARDUINO
+// Native build ... there is no Arduino core to call setup() and loop().
+int main(int argc, char **argv) {
+    setup();
+    loop();
+    return 0;
+}
+#endif
@@ -1,6 +1,10 @@
 #include <Arduino.h>
 #include <unity.h>
 
+#ifdef ARDUINO_SHIM
+#include <chrono>
+#endif
+
 #include "CommandProcessor.h"
 #include "mock_Serial.h"
 
@@ -26,7 +30,8 @@ class MockReceiveEngine : public ReceiveEngine {
 
         virtual void startReceiving() {
         }
-        virtual int waitReceivedFrameComplete(int timeout) {
+        virtual int waitReceivedFrameComplete(const ReplyDeadline *deadline) {
+            lastDeadline = *deadline;
             return 100;     // This is the time in millseconds to receive the frame
         }
         // char tempBuffer[10];
@@ -38,6 +43,7 @@ class MockReceiveEngine : public ReceiveEngine {
             // TEST_MESSAGE(tempBuffer);
             _receiveDataBuffer->loadData(len, data);
         }
+        ReplyDeadline lastDeadline;
 };
 
 class MockSyncControl : public SyncControl {
@@ -46,11 +52,14 @@ class MockSyncControl : public SyncControl {
         virtual void deviceReset() {}
 };
 
-MockSendEngine testSendEngine(1);
-MockReceiveEngine testReceiveEngine(2,3);
+// Each test makes its own engines. Between them they hold all the large pool
+// blocks there are on the board, so they must be gone again before the stream
+// tests make real ones.
 MockSyncControl testSyncControl;
 
 void test_CommandProcessor_constructor(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
 
     TEST_ASSERT_EQUAL((void *)&testSendEngine, (void *)cmdproc.sendEngine);
@@ -58,6 +67,8 @@ void test_CommandProcessor_constructor(void) {
 }
 
 void test_CommandProcessor_getCommand(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
     cmdproc.enableDebug(false);
 
@@ -74,6 +85,8 @@ void test_CommandProcessor_getCommand(void) {
 }
 
 void test_CommandProcessor_sendResponse(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
     cmdproc.enableDebug(false);
 
@@ -106,6 +119,8 @@ void test_CommandProcessor_sendResponse(void) {
 }
 
 void test_CommandProcessor_process_write(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
     cmdproc.enableDebug(false); // Important ... turn off the debug msgs that would
                                 // otherwise be sent to our mock serial instance.
@@ -140,6 +155,8 @@ void test_CommandProcessor_process_write(void) {
 }
 
 void test_CommandProcessor_process_read(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
     cmdproc.enableDebug(false); // Important ... turn off the debug msgs that would
                                 // otherwise be sent to our mock serial instance.
@@ -174,6 +191,8 @@ void test_CommandProcessor_process_read(void) {
 }
 
 void test_CommandProcessor_process_write_read(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
     CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
     cmdproc.enableDebug(false); // Important ... turn off the debug msgs that would
                                 // otherwise be sent to our mock serial instance.
@@ -181,6 +200,12 @@ void test_CommandProcessor_process_write_read(void) {
     MockSerial.reset();
     cmdproc.injectSerial(&MockSerial);
 
+    // The reply the device will send back.
+    byte dummyReceivedFrame[] = { 0x32, 0x10, 0x70 };
+    testReceiveEngine.loadMockFrame(dummyReceivedFrame, 3 /*sizeof(dummyReceivedFrame)*/);
+    DataBuffer *frameBack = testReceiveEngine.getSavedFrame();
+    TEST_ASSERT_EQUAL(3, frameBack->getLength());
+
     byte dummyData[] = {CMD_WRITE_READ, 0x00, 0x03, 0x32, 0x32, 0x37};
     MockSerial.setReadBuffer(dummyData, 6);
 
@@ -200,11 +225,6 @@ void test_CommandProcessor_process_write_read(void) {
     TEST_ASSERT_EQUAL(0x37, testSendEngine.getDataBuffer().get(6));
     TEST_ASSERT_EQUAL(0xFF, testSendEngine.getDataBuffer().get(7));
 
-    byte dummyReceivedFrame[] = { 0x32, 0x10, 0x70 };
-    testReceiveEngine.loadMockFrame(dummyReceivedFrame, 3 /*sizeof(dummyReceivedFrame)*/);
-    DataBuffer *frameBack = testReceiveEngine.getSavedFrame();
-    TEST_ASSERT_EQUAL(3, frameBack->getLength());
-
     // Test what was (mocked) written out on the serial port
     TEST_ASSERT_EQUAL(6, MockSerial.writePtr);
     TEST_ASSERT_EQUAL(CMD_WRITE_READ|CMD_RESPONSE_MASK, MockSerial.writeBuffer[0]);
@@ -216,6 +236,517 @@ void test_CommandProcessor_process_write_read(void) {
 
 }
 
+void test_CommandProcessor_process_config_auto_bcc(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    byte dummyData[] = {CMD_CONFIG, 0x00, 0x02, CONFIG_AUTO_BCC, 0x01,
+                        CMD_WRITE, 0x00, 0x04, 0x02, 0x27, 0xF6, 0x03,
+                        CMD_CONFIG, 0x00, 0x02, CONFIG_AUTO_BCC, 0x00,
+                        CMD_CONFIG, 0x00, 0x02, 0x7F, 0x00};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+    TEST_ASSERT_TRUE(testSendEngine.getAutoBcc());
+
+    // The BCC is added to the write ... PAD LPAD LPAD SYN STX ESC READ ETX BCC1 BCC2 PAD
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(11, testSendEngine.getDataBuffer().getLength());
+    TEST_ASSERT_EQUAL(0xB7, testSendEngine.getDataBuffer().get(8));
+    TEST_ASSERT_EQUAL(0xAA, testSendEngine.getDataBuffer().get(9));
+    TEST_ASSERT_EQUAL(0xFF, testSendEngine.getDataBuffer().get(10));
+
+    cmdproc.process();
+    TEST_ASSERT_FALSE(testSendEngine.getAutoBcc());
+
+    // Unknown option
+    cmdproc.process();
+
+    TEST_ASSERT_EQUAL(12, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK, MockSerial.writeBuffer[0]);
+    TEST_ASSERT_EQUAL(CMD_WRITE|CMD_RESPONSE_MASK, MockSerial.writeBuffer[3]);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK, MockSerial.writeBuffer[6]);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[9]);
+}
+
+void test_CommandProcessor_process_stats(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    // No line behind the mock sync control, so no statistics.
+    byte dummyData[] = {CMD_STATS, 0x00, 0x01, 0x01};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+
+    TEST_ASSERT_EQUAL(3, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_STATS|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[0]);
+    TEST_ASSERT_EQUAL(0, MockSerial.writeBuffer[2]);
+    TEST_ASSERT_EQUAL(0, MockSerial.available());
+}
+
+void test_CommandProcessor_process_config_bit_rate(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    // Past the end of the table, then a rate the (mock) line cannot change to.
+    byte dummyData[] = {CMD_CONFIG, 0x00, 0x02, CONFIG_BIT_RATE, LINE_BIT_RATE_COUNT,
+                        CMD_CONFIG, 0x00, 0x02, CONFIG_BIT_RATE, 0x00};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+    cmdproc.process();
+
+    TEST_ASSERT_EQUAL(8, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[0]);
+    TEST_ASSERT_EQUAL(1, MockSerial.writeBuffer[2]);
+    TEST_ASSERT_EQUAL(LINE_RATE_UNSUPPORTED, MockSerial.writeBuffer[3]);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[4]);
+    TEST_ASSERT_EQUAL(LINE_RATE_UNSUPPORTED, MockSerial.writeBuffer[7]);
+}
+
+void test_CommandProcessor_process_config_read_timeout(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    byte dummyReceivedFrame[] = { 0x32, BSC_CONTROL_EOT, 0xFF };
+    testReceiveEngine.loadMockFrame(dummyReceivedFrame, sizeof(dummyReceivedFrame));
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    byte dummyData[] = {CMD_READ, 0x00, 0x00,
+                        CMD_CONFIG, 0x00, 0x02, CONFIG_READ_TIMEOUT, 0x05,
+                        CMD_CONFIG, 0x00, 0x02, CONFIG_NEXT_TIMEOUT, 0x01,
+                        CMD_READ, 0x00, 0x00,
+                        CMD_READ, 0x00, 0x00};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    // No bit rate from the (mock) line, so the fixed timeout.
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(RECEIVE_TIMEOUT, testReceiveEngine.lastDeadline.totalMs);
+    TEST_ASSERT_EQUAL(0, testReceiveEngine.lastDeadline.silenceBytes);
+
+    cmdproc.process();
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK, MockSerial.writeBuffer[6]);
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK, MockSerial.writeBuffer[9]);
+
+    // The next timeout is for one command, then back to the read timeout.
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(100, testReceiveEngine.lastDeadline.startMs);
+    TEST_ASSERT_EQUAL(100, testReceiveEngine.lastDeadline.totalMs);
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(500, testReceiveEngine.lastDeadline.totalMs);
+}
+
+void test_CommandProcessor_process_cache(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    byte dummyReceivedFrame[] = { 0x32, BSC_CONTROL_EOT, 0xFF };
+    testReceiveEngine.loadMockFrame(dummyReceivedFrame, sizeof(dummyReceivedFrame));
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    byte dummyData[] = {CMD_CACHE, 0x00, 0x04, 0x02, CONTROL_FRAME_POLL, 0x40, 0xC1,
+                        CMD_CACHE, 0x00, 0x01, 0x02,
+                        CMD_CACHE, 0x00, 0x01, 0x03,
+                        CMD_CACHE, 0x00, 0x04, CONTROL_CACHE_ENTRIES, CONTROL_FRAME_POLL, 0x40, 0x40};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(3, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_CACHE|CMD_RESPONSE_MASK, MockSerial.writeBuffer[0]);
+
+    // The poll goes out from the cache, not through the data buffer, and the
+    // reply comes back.
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(0, testSendEngine.getDataBuffer().getLength());
+    uint8_t poll[] = { BSC_CONTROL_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD,
+                       BSC_CONTROL_SYN, BSC_CONTROL_SYN, 0x40, 0x40, 0xC1, 0xC1,
+                       BSC_CONTROL_ENQ, BSC_CONTROL_PAD };
+    for ( int x = 0; x < (int)sizeof(poll); x++ )
+        TEST_ASSERT_EQUAL(poll[x], testSendEngine.nextByte());
+    TEST_ASSERT_EQUAL(-1, testSendEngine.nextByte());
+    TEST_ASSERT_EQUAL(CMD_CACHE|CMD_RESPONSE_MASK, MockSerial.writeBuffer[3]);
+    TEST_ASSERT_EQUAL(3, MockSerial.writeBuffer[5]);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_EOT, MockSerial.writeBuffer[7]);
+
+    // Nothing loaded there, and past the end.
+    cmdproc.process();
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(15, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_CACHE|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[9]);
+    TEST_ASSERT_EQUAL(CMD_CACHE|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[12]);
+
+    testSendEngine.clearBuffer();
+}
+
+void test_CommandProcessor_process_read_bad_bcc(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    byte dummyReceivedFrame[] = { 0x32, 0x02, 0x27, 0xF6, 0x03, 0xB7, 0xAB, 0xFF };
+    testReceiveEngine.loadMockFrame(dummyReceivedFrame, sizeof(dummyReceivedFrame));
+    testReceiveEngine.getSavedFrame()->setBccStatus(FRAME_BCC_BAD);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    // Without retries the frame goes to the host flagged as in error.
+    testSendEngine.clearBuffer();
+    byte dummyData[] = {CMD_READ, 0x00, 0x00,
+                        CMD_CONFIG, 0x00, 0x02, CONFIG_NAK_RETRIES, 0x01,
+                        CMD_READ, 0x00, 0x00};
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(11, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_READ|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[0]);
+    TEST_ASSERT_EQUAL(0, testSendEngine.getDataBuffer().getLength());
+
+    // With a retry the dongle NAKs before giving up.
+    cmdproc.process();
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(CMD_CONFIG|CMD_RESPONSE_MASK, MockSerial.writeBuffer[11]);
+    TEST_ASSERT_EQUAL(CMD_READ|CMD_RESPONSE_MASK|ERROR_BIT, MockSerial.writeBuffer[14]);
+
+    DataBuffer & nak = testSendEngine.getDataBuffer();
+    TEST_ASSERT_EQUAL(7, nak.getLength());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, nak.get(4));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_NAK, nak.get(5));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_PAD, nak.get(6));
+
+    testReceiveEngine.getSavedFrame()->setBccStatus(FRAME_BCC_UNCHECKED);
+}
+
+
+void test_CommandProcessor_process_write_timeout(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    // Three bytes promised, only two sent ... nothing goes to the line.
+    byte dummyData[] = {CMD_WRITE, 0x00, 0x03, 0x32, 0x32};
+    MockSerial.setReadBuffer(dummyData, 5);
+
+    unsigned long startTime = millis();
+    cmdproc.process();
+    TEST_ASSERT_TRUE(millis() - startTime >= RECEIVE_TIMEOUT);
+
+    TEST_ASSERT_EQUAL(0, testSendEngine.getDataBuffer().getLength());
+    TEST_ASSERT_EQUAL(3, MockSerial.writePtr);
+    TEST_ASSERT_EQUAL(CMD_WRITE|CMD_RESPONSE_MASK|CMD_RESPONSE_TIMEOUT, MockSerial.writeBuffer[0]);
+}
+
+void test_CommandProcessor_process_sequenced(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    cmdproc.enableDebug(false);
+
+    MockSerial.reset();
+    cmdproc.injectSerial(&MockSerial);
+
+    // Two commands on their way at once, then one with the lengths wrong.
+    byte dummyData[] = {
+        CMD_SEQUENCED, 0x00, 0x06, 0x05, CMD_CONFIG, 0x00, 0x02, CONFIG_AUTO_BCC, 0x00,
+        CMD_SEQUENCED, 0x00, 0x07, 0x06, CMD_WRITE, 0x00, 0x03, 0x32, 0x32, 0x37,
+        CMD_SEQUENCED, 0x00, 0x05, 0x07, CMD_WRITE, 0x00, 0x03, 0x32
+    };
+    MockSerial.setReadBuffer(dummyData, sizeof(dummyData));
+
+    cmdproc.process();
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(8, testSendEngine.getDataBuffer().getLength());
+    TEST_ASSERT_EQUAL(0x37, testSendEngine.getDataBuffer().get(6));
+    cmdproc.process();
+    TEST_ASSERT_EQUAL(0, MockSerial.available());
+
+    byte expected[] = {
+        CMD_SEQUENCED|CMD_RESPONSE_MASK, 0x00, 0x01, 0x05,
+        CMD_CONFIG|CMD_RESPONSE_MASK, 0x00, 0x00,
+        CMD_SEQUENCED|CMD_RESPONSE_MASK, 0x00, 0x01, 0x06,
+        CMD_WRITE|CMD_RESPONSE_MASK, 0x00, 0x00,
+        CMD_SEQUENCED|CMD_RESPONSE_MASK|ERROR_BIT, 0x00, 0x00
+    };
+    TEST_ASSERT_EQUAL(sizeof(expected), MockSerial.writePtr);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, MockSerial.writeBuffer, sizeof(expected));
+}
+
+#define INGEST_USB_PACKET       64      // Full speed CDC bulk endpoint
+#define INGEST_PACKET_GAP       100     // Microseconds for the host's next packet to land
+
+// The host's bytes as the USB controller hands them over. The endpoint holds
+// one packet of INGEST_USB_PACKET bytes; the host's next packet is NAKed until
+// the dongle has read that one out, and lands INGEST_PACKET_GAP microseconds
+// later. There is nothing to read in between.
+class UsbPacketSerial_ : public MockSerial_ {
+    public:
+        void startPackets(void) {
+            _arrived = min(INGEST_USB_PACKET, readLen + generatedLen);
+            _refillAt = micros();
+        }
+        virtual int available(void) {
+            return arrived() - readPtr;
+        }
+        virtual int read(void) {
+            if ( readPtr >= arrived() )
+                return -1;
+            int val = MockSerial_::read();
+            if ( readPtr == _arrived )
+                _refillAt = micros() + INGEST_PACKET_GAP;
+            return val;
+        }
+
+    private:
+        int             _arrived;
+        unsigned long   _refillAt;
+
+        int arrived(void) {
+            if ( readPtr >= _arrived && _arrived < readLen + generatedLen &&
+                 (long)(micros() - _refillAt) >= 0 )
+                _arrived = min(_arrived + INGEST_USB_PACKET, readLen + generatedLen);
+            return _arrived;
+        }
+};
+
+// Reads command data the way it used to be read, a byte at a time sleeping for
+// a millisecond whenever nothing had arrived, and the way it is now, as much
+// as has arrived at once.
+class IngestCommandProcessor : public CommandProcessorBinary {
+    public:
+        IngestCommandProcessor(SendEngine *send, ReceiveEngine *receive, Serial_ *serial) :
+            CommandProcessorBinary(send, receive, &testSyncControl) {
+            enableDebug(false);
+            injectSerial(serial);
+        }
+
+        unsigned long ingestBytewise(void) {
+            unsigned long sum = 0;
+            int len;
+
+            legacySerialRead();
+            len = legacySerialRead() << 8;
+            len |= legacySerialRead();
+            for ( int x = 0; x < len; x++ )
+                sum += legacySerialRead();
+            return sum;
+        }
+
+        unsigned long ingestBuffered(void) {
+            uint8_t chunk[SERIAL_INGEST_CHUNK];
+            unsigned long sum = 0;
+            int remaining;
+
+            getCommand();
+            remaining = getCommandDataLength();
+            while ( remaining > 0 ) {
+                int len = serialReadBytes(chunk, min(remaining, SERIAL_INGEST_CHUNK), RECEIVE_TIMEOUT);
+                if ( len == 0 )
+                    break;
+                for ( int x = 0; x < len; x++ )
+                    sum += chunk[x];
+                remaining -= len;
+            }
+            return sum;
+        }
+
+    private:
+        // serialRead() as it was before reads were buffered.
+        int legacySerialRead(void) {
+            int val = -1;
+            while ( this->useSerial && val < 0 ) {
+                val = this->useSerial->read();
+                if ( val < 0 )
+                    delay(1);
+            }
+            return val;
+        }
+};
+
+// How long the ingest took as the line side sees it (micros(), the virtual
+// clock on the native build) and, on the native build, the host CPU time.
+struct IngestTime {
+    unsigned long   micros;
+    unsigned long   hostMicros;
+};
+
+static unsigned long ingestTimed(IngestCommandProcessor *cmdproc, UsbPacketSerial_ *serial,
+                                 int len, bool buffered, IngestTime *time) {
+    byte header[] = {CMD_WRITE, (byte)(len >> 8), (byte)(len & 0xff)};
+    unsigned long sum;
+
+    serial->reset();
+    serial->setReadBuffer(header, sizeof(header));
+    serial->setReadGenerated(len);
+    serial->startPackets();
+
+    unsigned long startTime = micros();
+#ifdef ARDUINO_SHIM
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#endif
+    sum = buffered ? cmdproc->ingestBuffered() : cmdproc->ingestBytewise();
+    time->micros = micros() - startTime;
+    time->hostMicros = 0;
+#ifdef ARDUINO_SHIM
+    time->hostMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - begin).count();
+#endif
+    return sum;
+}
+
+void test_CommandProcessor_ingest_timing(void) {
+    static const int payloadLengths[] = { 1, 16, 64, 256, 1024, 2000 };
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    UsbPacketSerial_ serial;
+    IngestCommandProcessor cmdproc(&testSendEngine, &testReceiveEngine, &serial);
+    char printbuff[140];
+
+    for ( unsigned int n = 0; n < sizeof(payloadLengths) / sizeof(payloadLengths[0]); n++ ) {
+        int len = payloadLengths[n];
+        unsigned long expected = 0;
+        IngestTime bytewise, buffered;
+
+        for ( int x = 0; x < len; x++ )
+            expected += MockSerial_::generatedByte(x);
+
+        TEST_ASSERT_EQUAL(expected, ingestTimed(&cmdproc, &serial, len, false, &bytewise));
+        TEST_ASSERT_EQUAL(expected, ingestTimed(&cmdproc, &serial, len, true, &buffered));
+        TEST_ASSERT_EQUAL(0, serial.available());
+
+        // Every packet after the first costs the old loop a whole delay(1).
+        if ( len + 3 > INGEST_USB_PACKET )
+            TEST_ASSERT_TRUE(buffered.micros < bytewise.micros);
+
+        snprintf(printbuff, sizeof(printbuff),
+                 "Ingest of %d bytes: %lu us a byte at a time with delay(1), %lu us buffered "
+                 "(host CPU %lu us, %lu us)",
+                 len, bytewise.micros, buffered.micros, bytewise.hostMicros, buffered.hostMicros);
+        TEST_MESSAGE(printbuff);
+    }
+}
+
+// Counts the calls made to write to the host, and checks the bytes written
+// without keeping them: a response header, then data bytes 0, 1, 2 ...
+class CountingSerial_ : public Serial_ {
+    public:
+        int             writeCalls;
+        int             bytes;
+        int             mismatches;
+        uint8_t         header[3];
+
+        CountingSerial_() {
+            reset(0, 0);
+        }
+        void reset(int code, int len) {
+            writeCalls = 0;
+            bytes = 0;
+            mismatches = 0;
+            header[0] = code;
+            header[1] = len >> 8;
+            header[2] = len & 0xff;
+        }
+        virtual int available(void) {
+            return 0;
+        }
+        virtual int read(void) {
+            return -1;
+        }
+        virtual size_t write(uint8_t data) {
+            writeCalls++;
+            check(data);
+            return 1;
+        }
+        virtual size_t write(const uint8_t *data, size_t len) {
+            writeCalls++;
+            for ( size_t x = 0; x < len; x++ )
+                check(data[x]);
+            return len;
+        }
+        using Print::write;
+
+    private:
+        void check(uint8_t data) {
+            if ( data != ( bytes < 3 ? header[bytes] : (uint8_t)(bytes - 3) ) )
+                mismatches++;
+            bytes++;
+        }
+};
+
+CountingSerial_ CountingSerial;
+
+void test_CommandProcessor_response_writes(void) {
+    MockSendEngine testSendEngine(1);
+    MockReceiveEngine testReceiveEngine(2,3);
+    static const int dataLengths[] = { 0, 2, 16, 61, 62, 300 };
+    static uint8_t data[300];
+    CommandProcessorBinary cmdproc(&testSendEngine, &testReceiveEngine, &testSyncControl);
+    char printbuff[100];
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&CountingSerial);
+
+    for ( int x = 0; x < (int)sizeof(data); x++ )
+        data[x] = x;
+
+    for ( unsigned int n = 0; n < sizeof(dataLengths) / sizeof(dataLengths[0]); n++ ) {
+        int len = dataLengths[n];
+
+        CountingSerial.reset(CMD_READ | CMD_RESPONSE_MASK, len);
+        cmdproc.sendResponse(CMD_READ | CMD_RESPONSE_MASK, len, data);
+
+        TEST_ASSERT_EQUAL(3 + len, CountingSerial.bytes);
+        TEST_ASSERT_EQUAL(0, CountingSerial.mismatches);
+        // One write when it fits in the response buffer, two when it does not.
+        TEST_ASSERT_EQUAL(3 + len <= RESPONSE_BUFFER_SIZE ? 1 : 2, CountingSerial.writeCalls);
+
+        sprintf(printbuff, "Response with %d bytes of data: %d bytes in %d write calls (was %d).",
+                len, CountingSerial.bytes, CountingSerial.writeCalls, 3 + len);
+        TEST_MESSAGE(printbuff);
+    }
+
+    // Debug records go out with the response that follows them.
+    cmdproc.enableDebug(true);
+    CountingSerial.reset(0, 0);
+    cmdproc.sendDebug("Reading response ...");
+    TEST_ASSERT_EQUAL(0, CountingSerial.writeCalls);
+    cmdproc.sendResponse(CMD_READ | CMD_RESPONSE_MASK, 2, data);
+    TEST_ASSERT_EQUAL(1, CountingSerial.writeCalls);
+    TEST_ASSERT_EQUAL(3 + 20 + 3 + 2, CountingSerial.bytes);
+
+    sprintf(printbuff, "Debug record and response: %d bytes in %d write calls (was %d).",
+            CountingSerial.bytes, CountingSerial.writeCalls, CountingSerial.bytes);
+    TEST_MESSAGE(printbuff);
+}
 
 void test_CommandProcessor() {
     RUN_TEST(test_CommandProcessor_constructor);
@@ -224,4 +755,14 @@ void test_CommandProcessor() {
     RUN_TEST(test_CommandProcessor_process_write);
     RUN_TEST(test_CommandProcessor_process_read);
     RUN_TEST(test_CommandProcessor_process_write_read);
+    RUN_TEST(test_CommandProcessor_process_config_auto_bcc);
+    RUN_TEST(test_CommandProcessor_process_config_bit_rate);
+    RUN_TEST(test_CommandProcessor_process_stats);
+    RUN_TEST(test_CommandProcessor_process_config_read_timeout);
+    RUN_TEST(test_CommandProcessor_process_cache);
+    RUN_TEST(test_CommandProcessor_process_read_bad_bcc);
+    RUN_TEST(test_CommandProcessor_process_write_timeout);
+    RUN_TEST(test_CommandProcessor_process_sequenced);
+    RUN_TEST(test_CommandProcessor_ingest_timing);
+    RUN_TEST(test_CommandProcessor_response_writes);
 }
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <TimerOne.h>
+
+#include "CommandProcessor.h"
+
+/*
+ * Streaming read (CMD_READ_STREAM). A frame longer than DATABUFF_MAX_DATA is fed
+ * into a real ReceiveEngine from the Timer1 interrupt, one byte per interrupt,
+ * while the command processor forwards it to the host.
+ *
+ * The host side checks each record as it is written rather than storing the
+ * output, so the test fits in the Leonardo's RAM.
+ */
+
+#define STREAM_DATA_LEN     390     // Text bytes ... the frame is this plus 7.
+
+// The bytes on the line: SYN SYN STX text... ETX BCC1 BCC2 PAD
+static int streamLineLength() {
+    return STREAM_DATA_LEN + 7;
+}
+
+static uint8_t streamBcc[2];
+
+static uint8_t streamLineByte(int idx) {
+    if ( idx < 2 )
+        return BSC_CONTROL_SYN;
+    if ( idx == 2 )
+        return BSC_CONTROL_STX;
+    idx -= 3;
+    if ( idx < STREAM_DATA_LEN )
+        return 0x80 | (idx & 0x3F);
+    idx -= STREAM_DATA_LEN;
+    const uint8_t trailer[] = { BSC_CONTROL_ETX, streamBcc[0], streamBcc[1], BSC_CONTROL_PAD };
+    return trailer[idx];
+}
+
+static void setStreamBcc(void) {
+    BscCrc crc;
+
+    for ( int x = 0; x < streamLineLength(); x++ ) {
+        if ( crc.update(streamLineByte(x)) ) {
+            streamBcc[0] = crc.getBcc1();
+            streamBcc[1] = crc.getBcc2();
+            break;
+        }
+    }
+}
+
+// The frame as received drops the second SYN.
+static uint8_t streamFrameByte(int idx) {
+    return streamLineByte(idx == 0 ? 0 : idx + 1);
+}
+
+class StreamCheckSerial : public Serial_ {
+    public:
+        int     records;
+        int     moreRecords;
+        int     dataBytes;
+        int     mismatches;
+        int     maxRecordLength;
+        int     lastCode;
+        uint8_t status[4];
+
+        StreamCheckSerial() {
+            reset();
+        }
+        void reset() {
+            records = 0;
+            moreRecords = 0;
+            dataBytes = 0;
+            mismatches = 0;
+            maxRecordLength = 0;
+            lastCode = -1;
+            _hdrPos = 0;
+            _remaining = 0;
+            memset(status, 0, sizeof(status));
+        }
+        virtual int available(void) {
+            return 0;
+        }
+        virtual int read(void) {
+            return -1;
+        }
+        virtual size_t write(uint8_t data) {
+            if ( _hdrPos == 0 ) {
+                _code = data;
+                _hdrPos++;
+            } else if ( _hdrPos == 1 ) {
+                _remaining = data << 8;
+                _hdrPos++;
+            } else if ( _hdrPos == 2 ) {
+                _remaining |= data;
+                _hdrPos++;
+                records++;
+                lastCode = _code;
+                if ( _code & CMD_RESPONSE_MORE )
+                    moreRecords++;
+                maxRecordLength = max(maxRecordLength, _remaining);
+                _statusPos = 0;
+                if ( _remaining == 0 )
+                    _hdrPos = 0;
+            } else {
+                if ( _code & CMD_RESPONSE_MORE ) {
+                    if ( data != streamFrameByte(dataBytes) )
+                        mismatches++;
+                    dataBytes++;
+                } else if ( _statusPos < (int)sizeof(status) ) {
+                    status[_statusPos++] = data;
+                }
+                if ( --_remaining == 0 )
+                    _hdrPos = 0;
+            }
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        int     _hdrPos;
+        int     _code;
+        int     _remaining;
+        int     _statusPos;
+};
+
+static StreamCheckSerial streamSerial;
+static ReceiveEngine * streamEngine;
+static volatile int streamFeedIdx;
+
+// Stands in for the bit banger interrupt routine, a whole byte at a time.
+static void streamFeedByte(void) {
+    if ( streamFeedIdx >= streamLineLength() )
+        return;
+    streamEngine->setBitBuffer(streamLineByte(streamFeedIdx++));
+    streamEngine->processBit();
+}
+
+void test_CommandProcessor_process_read_stream(void) {
+    SendEngine sendEng(9);
+    ReceiveEngine recvEng(3, 8);
+    CommandProcessorBinary cmdproc(&sendEng, &recvEng, NULL);
+    cmdproc.enableDebug(false);
+
+    streamSerial.reset();
+    cmdproc.injectSerial(&streamSerial);
+
+    setStreamBcc();
+    streamEngine = &recvEng;
+    streamFeedIdx = 0;
+    Timer1.initialize(200);
+    Timer1.attachInterrupt(streamFeedByte);
+
+    cmdproc.putCommand(CMD_READ_STREAM, 0);
+    recvEng.startReceiving();
+    cmdproc.streamReceivedFrame(CMD_READ_STREAM);
+
+    Timer1.detachInterrupt();
+    Timer1.stop();
+
+    int frameLength = STREAM_DATA_LEN + 6;
+    TEST_ASSERT_TRUE(frameLength > DATABUFF_MAX_DATA);
+
+    // Several chunks, the whole frame in order, then the status record.
+    TEST_ASSERT_TRUE(streamSerial.moreRecords > 1);
+    TEST_ASSERT_TRUE(streamSerial.maxRecordLength <= STREAM_CHUNK_SIZE);
+    TEST_ASSERT_EQUAL(0, streamSerial.mismatches);
+    TEST_ASSERT_EQUAL(frameLength, streamSerial.dataBytes);
+    TEST_ASSERT_EQUAL(streamSerial.moreRecords + 1, streamSerial.records);
+
+    TEST_ASSERT_EQUAL(CMD_READ_STREAM | CMD_RESPONSE_MASK, streamSerial.lastCode);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, streamSerial.status[0]);
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, streamSerial.status[1]);
+    TEST_ASSERT_EQUAL(frameLength, (streamSerial.status[2] << 8) | streamSerial.status[3]);
+}
+
+void test_CommandProcessor_process_read_stream_timeout(void) {
+    SendEngine sendEng(9);
+    ReceiveEngine recvEng(3, 8);
+    CommandProcessorBinary cmdproc(&sendEng, &recvEng, NULL);
+    cmdproc.enableDebug(false);
+
+    streamSerial.reset();
+    cmdproc.injectSerial(&streamSerial);
+
+    recvEng.startReceiving();
+    cmdproc.streamReceivedFrame(CMD_READ_STREAM);
+
+    TEST_ASSERT_EQUAL(1, streamSerial.records);
+    TEST_ASSERT_EQUAL(CMD_READ_STREAM | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT, streamSerial.lastCode);
+    TEST_ASSERT_EQUAL(0, streamSerial.status[0]);
+    TEST_ASSERT_EQUAL(0, (streamSerial.status[2] << 8) | streamSerial.status[3]);
+}
+
+void test_CommandProcessorStream() {
+    RUN_TEST(test_CommandProcessor_process_read_stream);
+    RUN_TEST(test_CommandProcessor_process_read_stream_timeout);
+}
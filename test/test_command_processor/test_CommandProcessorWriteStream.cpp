@@ -0,0 +1,232 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <TimerOne.h>
+
+#include "CommandProcessor.h"
+
+/*
+ * Streaming write (CMD_WRITE_STREAM). A transparent block several times the
+ * size of the send buffer is fed in by a simulated host, which only sends what
+ * it has been given credit for and no faster than a USB full speed bulk
+ * endpoint, while Timer1 clocks the SendEngine out at the line bit rate.
+ *
+ * The bits on the line are put back together and checked as they go, so the
+ * test fits in the Leonardo's RAM.
+ */
+
+#define WSTREAM_DATA_LEN        4096
+#define WSTREAM_BIT_RATE        19200
+#define WSTREAM_HOST_BYTES_MS   64      // One 64 byte USB packet per 1ms frame
+
+// The command data: DLE STX text... DLE ETX BCC1 BCC2
+static uint8_t wstreamDataByte(int idx) {
+    const uint8_t leader[] = { BSC_CONTROL_DLE, BSC_CONTROL_STX };
+    const uint8_t trailer[] = { BSC_CONTROL_DLE, BSC_CONTROL_ETX, 0x12, 0x34 };
+
+    if ( idx < 2 )
+        return leader[idx];
+    if ( idx >= WSTREAM_DATA_LEN - 4 )
+        return trailer[idx - (WSTREAM_DATA_LEN - 4)];
+    return (idx * 31 + 7) & 0xff;
+}
+
+// The bytes on the line: PAD LEADING_PAD LEADING_PAD SYN data... PAD
+static int wstreamLineLength(int dataLen) {
+    return dataLen + 5;
+}
+
+static uint8_t wstreamLineByte(int idx, int dataLen) {
+    const uint8_t leader[] = {
+        BSC_CONTROL_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_SYN
+    };
+
+    if ( idx < 4 )
+        return leader[idx];
+    if ( idx - 4 < dataLen )
+        return wstreamDataByte(idx - 4);
+    return BSC_CONTROL_PAD;
+}
+
+class HostSimSerial : public Serial_ {
+    public:
+        int             dataLen;        // Bytes the host will send
+        bool            stall;          // Stop sending half way
+        int             sent;
+        unsigned int    credit;
+        unsigned int    maxCredit;
+        int             creditRecords;
+        int             overruns;       // Bytes read beyond the credit given
+        int             lastCode;
+        unsigned int    lastValue;
+
+        HostSimSerial() {
+            reset(0, false);
+        }
+        void reset(int len, bool stallHalfWay) {
+            dataLen = len;
+            stall = stallHalfWay;
+            sent = 0;
+            credit = 0;
+            maxCredit = 0;
+            creditRecords = 0;
+            overruns = 0;
+            lastCode = -1;
+            lastValue = 0;
+            _hdrPos = 0;
+            _frameMs = 0;
+            _frameBytes = 0;
+        }
+        virtual int available(void) {
+            int len = ( stall ? dataLen / 2 : dataLen ) - sent;
+            if ( millis() != _frameMs ) {
+                _frameMs = millis();
+                _frameBytes = 0;
+            }
+            len = min(len, (int)credit);
+            len = min(len, WSTREAM_HOST_BYTES_MS - _frameBytes);
+            return max(len, 0);
+        }
+        virtual int read(void) {
+            if ( available() <= 0 )
+                return -1;
+            credit--;
+            _frameBytes++;
+            return wstreamDataByte(sent++);
+        }
+        virtual size_t write(uint8_t data) {
+            switch ( _hdrPos++ ) {
+                case 0:
+                    _code = data;
+                    break;
+                case 1:
+                case 2:
+                    break;
+                case 3:
+                    _value = data << 8;
+                    break;
+                default:
+                    _value |= data;
+                    _hdrPos = 0;
+                    lastCode = _code;
+                    lastValue = _value;
+                    if ( _code & CMD_RESPONSE_MORE ) {
+                        credit += _value;
+                        creditRecords++;
+                        maxCredit = max(maxCredit, credit);
+                    }
+                    break;
+            }
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        int             _hdrPos;
+        int             _code;
+        unsigned int    _value;
+        unsigned long   _frameMs;
+        int             _frameBytes;
+};
+
+static HostSimSerial hostSerial;
+static SendEngine * wstreamEngine;
+static int wstreamDataLen;
+static volatile int lineBytes;
+static volatile int lineMismatches;
+static volatile uint8_t lineBits;
+static volatile uint8_t lineBitCount;
+
+// Stands in for the bit banger interrupt routine, collecting the bits sent.
+static void wstreamClockBit(void) {
+    bool wasOff = ( wstreamEngine->xmitState == SEND_STATE_OFF );
+
+    wstreamEngine->sendBit();
+    if ( wasOff || wstreamEngine->xmitState == SEND_STATE_OFF )
+        return;
+
+    lineBits = ( lineBits >> 1 ) | ( wstreamEngine->lastBitSent ? 0x80 : 0 );
+    if ( ++lineBitCount == 8 ) {
+        if ( lineBits != wstreamLineByte(lineBytes, wstreamDataLen) )
+            lineMismatches++;
+        lineBytes++;
+        lineBitCount = 0;
+    }
+}
+
+static void runWriteStream(CommandProcessorBinary *cmdproc, SendEngine *eng, int len, bool stall) {
+    hostSerial.reset(len, stall);
+    cmdproc->injectSerial(&hostSerial);
+
+    wstreamEngine = eng;
+    wstreamDataLen = len;
+    lineBytes = 0;
+    lineMismatches = 0;
+    lineBits = 0;
+    lineBitCount = 0;
+    Timer1.initialize(1000000L / WSTREAM_BIT_RATE);
+    Timer1.attachInterrupt(wstreamClockBit);
+
+    cmdproc->putCommand(CMD_WRITE_STREAM, len);
+    cmdproc->streamCommandDataToSender();
+
+    Timer1.detachInterrupt();
+    Timer1.stop();
+}
+
+void test_CommandProcessor_process_write_stream(void) {
+    SendEngine sendEng(9);
+    ReceiveEngine recvEng(3, 8);
+    CommandProcessorBinary cmdproc(&sendEng, &recvEng, NULL);
+    cmdproc.enableDebug(false);
+
+    runWriteStream(&cmdproc, &sendEng, WSTREAM_DATA_LEN, false);
+
+    TEST_ASSERT_TRUE(WSTREAM_DATA_LEN > DATABUFF_MAX_DATA);
+    TEST_ASSERT_EQUAL(WSTREAM_DATA_LEN, hostSerial.sent);
+    TEST_ASSERT_TRUE(hostSerial.creditRecords > 1);
+    TEST_ASSERT_TRUE(hostSerial.maxCredit < SEND_STREAM_RING_SIZE);
+
+    // Everything on the line, in order, with no idle fill mid block.
+    TEST_ASSERT_EQUAL(0, sendEng.getStreamUnderruns());
+    TEST_ASSERT_EQUAL(0, lineMismatches);
+    TEST_ASSERT_EQUAL(wstreamLineLength(WSTREAM_DATA_LEN), lineBytes);
+
+    TEST_ASSERT_EQUAL(CMD_WRITE_STREAM | CMD_RESPONSE_MASK, hostSerial.lastCode);
+    TEST_ASSERT_EQUAL(0, hostSerial.lastValue);
+}
+
+void test_CommandProcessor_process_write_stream_short(void) {
+    SendEngine sendEng(9);
+    ReceiveEngine recvEng(3, 8);
+    CommandProcessorBinary cmdproc(&sendEng, &recvEng, NULL);
+    cmdproc.enableDebug(false);
+
+    // Less than the start threshold ... sent once it has all arrived.
+    runWriteStream(&cmdproc, &sendEng, 20, false);
+
+    TEST_ASSERT_EQUAL(1, hostSerial.creditRecords);
+    TEST_ASSERT_EQUAL(0, lineMismatches);
+    TEST_ASSERT_EQUAL(wstreamLineLength(20), lineBytes);
+    TEST_ASSERT_EQUAL(CMD_WRITE_STREAM | CMD_RESPONSE_MASK, hostSerial.lastCode);
+}
+
+void test_CommandProcessor_process_write_stream_host_stalls(void) {
+    SendEngine sendEng(9);
+    ReceiveEngine recvEng(3, 8);
+    CommandProcessorBinary cmdproc(&sendEng, &recvEng, NULL);
+    cmdproc.enableDebug(false);
+
+    runWriteStream(&cmdproc, &sendEng, 1000, true);
+
+    // The line ran dry mid block, then the command timed out.
+    TEST_ASSERT_TRUE(sendEng.getStreamUnderruns() > 0);
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, sendEng.xmitState);
+    TEST_ASSERT_EQUAL(CMD_WRITE_STREAM | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT | ERROR_BIT,
+                      hostSerial.lastCode);
+}
+
+void test_CommandProcessorWriteStream() {
+    RUN_TEST(test_CommandProcessor_process_write_stream);
+    RUN_TEST(test_CommandProcessor_process_write_stream_short);
+    RUN_TEST(test_CommandProcessor_process_write_stream_host_stalls);
+}
@@ -0,0 +1,860 @@
+#include <Arduino.h>
+#include <unity.h>
+
+/*
+ * Whole sessions against an emulated 3274 with a 3270 display on the simulated
+ * line (lib/native-shim). Station 0 is the dongle, station 1 the control unit.
+ * Only built on the host.
+ */
+
+#ifdef ARDUINO_SHIM
+
+#include "CommandProcessor.h"
+#include "ControlUnitEmulator.h"
+
+#define CUEMU_TEST_BIT_RATE     9600
+#define CUEMU_BENCH_CYCLES      1000
+#define CUEMU_REPLY_BITS        4000
+#define CUEMU_OUTPUT_MAX        2048
+#define CUEMU_PIPE_POLLS        200
+#define CUEMU_USB_ROUND_TRIP    1000    // Microseconds, one full speed USB frame
+#define CUEMU_POLL_LIST_MICROS  3000000
+#define CUEMU_READ_BIT_RATE     19200
+#define CUEMU_READ_FIELD        999     // Bytes typed, four blocks with the rest
+
+static const long cuBenchRates[] = { 300, 1200, 2400, 4800, 9600, 19200 };
+
+// Feeds the command processor a script of text commands and keeps what it prints.
+class ScriptSerial_ : public Serial_ {
+    public:
+        char    output[CUEMU_OUTPUT_MAX];
+        int     outputLen;
+
+        ScriptSerial_() {
+            setScript("");
+        }
+        void setScript(const char *script) {
+            _script = script;
+            _scriptPos = 0;
+            outputLen = 0;
+            output[0] = '\0';
+        }
+        bool hasScript(void) {
+            return _script[_scriptPos] != '\0';
+        }
+        virtual int available(void) {
+            return strlen(_script + _scriptPos);
+        }
+        virtual int peek(void) {
+            return hasScript() ? (uint8_t)_script[_scriptPos] : -1;
+        }
+        virtual int read(void) {
+            return hasScript() ? (uint8_t)_script[_scriptPos++] : -1;
+        }
+        virtual size_t write(uint8_t data) {
+            if ( outputLen < CUEMU_OUTPUT_MAX - 1 ) {
+                output[outputLen++] = data;
+                output[outputLen] = '\0';
+            }
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        const char *    _script;
+        int             _scriptPos;
+};
+
+// The dongle's side of the line, driven through the text command processor.
+struct Dongle {
+    LineSimulator           sim;
+    ControlUnitEmulator     cu;
+    SyncControl             syncControl;
+    CommandProcessorText    cmdproc;
+    ScriptSerial_           serial;
+
+    Dongle(long bitRate) :
+        sim(bitRate),
+        cu(&sim, 1),
+        syncControl(&sim.getStation(0)),
+        cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl) {
+        cmdproc.injectSerial(&serial);
+        sim.start();
+        run("DEBUG 0\nADDR 40,60,40\n");
+    }
+
+    void run(const char *script) {
+        serial.setScript(script);
+        while ( serial.hasScript() )
+            cmdproc.getAndProcessCommand();
+    }
+    DataBuffer * lastReply(void) {
+        return sim.getReceiveEngine(0)->getSavedFrame();
+    }
+};
+
+// PAD LEADING_PAD LEADING_PAD SYN SYN data... PAD from the dongle's engines, and
+// the reply, if any comes within CUEMU_REPLY_BITS.
+static DataBuffer * exchange(LineSimulator *sim, const uint8_t *data, int len, bool autoBcc) {
+    SendEngine *send = sim->getSendEngine(0);
+    ReceiveEngine *recv = sim->getReceiveEngine(0);
+
+    recv->startReceiving();
+    send->clearBuffer();
+    send->setAutoBcc(autoBcc);
+    send->addByte(BSC_CONTROL_PAD);
+    send->addByte(BSC_CONTROL_LEADING_PAD);
+    send->addByte(BSC_CONTROL_LEADING_PAD);
+    send->addByte(BSC_CONTROL_SYN);
+    send->addByte(BSC_CONTROL_SYN);
+    for ( int x = 0; x < len; x++ )
+        send->addByte(data[x]);
+    send->addByte(BSC_CONTROL_PAD);
+    send->setAutoBcc(false);
+    send->startSending();
+    send->stopSendingOnIdle();
+
+    for ( int bits = 0; bits < CUEMU_REPLY_BITS; bits += 8 ) {
+        sim->runBits(8);
+        if ( recv->isFrameComplete() )
+            return recv->getSavedFrame();
+    }
+    return NULL;
+}
+
+// The reply is SYN, then the control character (or DLE and one), then PAD.
+static void checkControlReply(DataBuffer *reply, uint8_t ch, bool dle) {
+    TEST_ASSERT_NOT_NULL(reply);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, reply->get(0));
+    if ( dle ) {
+        TEST_ASSERT_EQUAL(BSC_CONTROL_DLE, reply->get(1));
+        TEST_ASSERT_EQUAL(ch, reply->get(2));
+    } else {
+        TEST_ASSERT_EQUAL(ch, reply->get(1));
+    }
+}
+
+static const uint8_t cuPoll[] = { 0x40, 0x40, 0x40, 0x40, BSC_CONTROL_ENQ };
+static const uint8_t cuSelect[] = { 0x60, 0x60, 0x40, 0x40, BSC_CONTROL_ENQ };
+static const uint8_t cuEot[] = { BSC_CONTROL_EOT };
+static const uint8_t cuEnq[] = { BSC_CONTROL_ENQ };
+static const uint8_t cuAck1[] = { BSC_CONTROL_DLE, BSC_CONTROL_ACK1 };
+
+// EW, an unprotected field at 0 with "ABC" in it, cursor at 1.
+static const uint8_t cuWriteForm[] = {
+    BSC_CONTROL_STX, CU_ESC, CU_CMD_EW, 0x42,
+    CU_ORDER_SF, 0x40, 0xC1, 0xC2, 0xC3,
+    CU_ORDER_SF, 0x60,
+    CU_ORDER_SBA, 0x40, 0xC1, CU_ORDER_IC,
+    BSC_CONTROL_ETX
+};
+
+void test_ControlUnitEmulator_poll(void) {
+    Dongle dongle(CUEMU_TEST_BIT_RATE);
+
+    dongle.run("POLL\n");
+    TEST_ASSERT_NULL(strstr(dongle.serial.output, "Timeout"));
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_EOT, false);
+    TEST_ASSERT_EQUAL(1, dongle.cu.getStats().polls);
+}
+
+void test_ControlUnitEmulator_bit_rate(void) {
+    Dongle dongle(CUEMU_TEST_BIT_RATE);
+
+    // Both ends of the line move to the new rate, and the poll still works.
+    dongle.run("RATE 19200\n");
+    TEST_ASSERT_NOT_NULL(strstr(dongle.serial.output, "Bit rate 19231 bps, bit period 52000 ns"));
+    TEST_ASSERT_EQUAL(19200, dongle.sim.getBitRate());
+
+    dongle.run("POLL\n");
+    TEST_ASSERT_NULL(strstr(dongle.serial.output, "Timeout"));
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_EOT, false);
+
+    dongle.run("RATE 1234\n");
+    TEST_ASSERT_NOT_NULL(strstr(dongle.serial.output, "ERROR: Rate must be one of"));
+    TEST_ASSERT_EQUAL(19200, dongle.sim.getBitRate());
+}
+
+void test_ControlUnitEmulator_reply_timeout(void) {
+    Dongle dongle(CUEMU_TEST_BIT_RATE);
+    char msg[160];
+
+    // Device 41 is not there. The wait is worked out from the bit rate rather
+    // than RECEIVE_TIMEOUT.
+    dongle.run("ADDR 40,60,41\n");
+    unsigned long startTime = millis();
+    dongle.run("POLL\n");
+    unsigned long waited = millis() - startTime;
+
+    TEST_ASSERT_NOT_NULL(strstr(dongle.serial.output, "Response timeout"));
+    TEST_ASSERT_TRUE(waited < 100);
+
+    // The display still answers in time.
+    dongle.run("ADDR 40,60,40\nPOLL\n");
+    TEST_ASSERT_NULL(strstr(dongle.serial.output, "Timeout"));
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_EOT, false);
+
+    snprintf(msg, sizeof(msg), "Poll of a missing device at %d bps timed out in %lu ms",
+             CUEMU_TEST_BIT_RATE, waited);
+    TEST_MESSAGE(msg);
+}
+
+void test_ControlUnitEmulator_read_stream_timeout(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    SyncControl syncControl(&sim.getStation(0));
+    CommandProcessorBinary cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl);
+    ScriptSerial_ serial;
+    char msg[120];
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&serial);
+    sim.start();
+
+    // Nothing on the line. A streamed read gives up as a whole one does, on
+    // the wait worked out from the bit rate.
+    sim.getReceiveEngine(0)->startReceiving();
+    unsigned long startTime = millis();
+    cmdproc.streamReceivedFrame(CMD_READ_STREAM);
+    unsigned long waited = millis() - startTime;
+
+    TEST_ASSERT_EQUAL(7, serial.outputLen);
+    TEST_ASSERT_EQUAL(CMD_READ_STREAM | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT,
+                      (uint8_t)serial.output[0]);
+    TEST_ASSERT_TRUE(waited < 100);
+
+    snprintf(msg, sizeof(msg), "Streamed read of a silent line at %d bps timed out in %lu ms",
+             CUEMU_TEST_BIT_RATE, waited);
+    TEST_MESSAGE(msg);
+}
+
+void test_ControlUnitEmulator_write(void) {
+    Dongle dongle(CUEMU_TEST_BIT_RATE);
+    static const uint8_t hello[] = { 0xC8, 0xC5, 0xD3, 0xD3, 0xD6, 0x40,
+                                     0xE6, 0xD6, 0xD9, 0xD3, 0xC4 };
+
+    dongle.run("WRITE\n");
+    TEST_ASSERT_NULL(strstr(dongle.serial.output, "Timeout"));
+    TEST_ASSERT_NULL(strstr(dongle.serial.output, "BCC check failed"));
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_ACK1, true);
+
+    const ControlUnitStats & stats = dongle.cu.getStats();
+    TEST_ASSERT_EQUAL(1, stats.selects);
+    TEST_ASSERT_EQUAL(1, stats.texts);
+    TEST_ASSERT_EQUAL(0, stats.naksSent);
+
+    // SF at 0, HELLO WORLD after it, the cursor after that.
+    TEST_ASSERT_TRUE(dongle.cu.isFieldAttribute(0));
+    TEST_ASSERT_EQUAL(0x60, dongle.cu.getScreen(0));
+    for ( int x = 0; x < (int)sizeof(hello); x++ )
+        TEST_ASSERT_EQUAL(hello[x], dongle.cu.getScreen(x + 1));
+    TEST_ASSERT_EQUAL(14, dongle.cu.getCursor());
+
+    // The next session starts with EOT, and the poll gets EOT.
+    dongle.run("POLL\n");
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_EOT, false);
+    TEST_ASSERT_EQUAL(CU_STATE_CONTROL, dongle.cu.getState());
+
+    // Auto BCC is left as the host set it.
+    SendEngine *send = dongle.sim.getSendEngine(0);
+    TEST_ASSERT_FALSE(send->getAutoBcc());
+    send->setAutoBcc(true);
+    dongle.run("WRITE\n");
+    checkControlReply(dongle.lastReply(), BSC_CONTROL_ACK1, true);
+    TEST_ASSERT_TRUE(send->getAutoBcc());
+    send->setAutoBcc(false);
+}
+
+void test_ControlUnitEmulator_nak(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    uint8_t bad[sizeof(cuWriteForm) + 2];
+
+    checkControlReply(exchange(&sim, cuSelect, sizeof(cuSelect), false), BSC_CONTROL_ACK0, true);
+
+    // Wrong BCC ... NAK, then the same text with the right one is acknowledged.
+    memcpy(bad, cuWriteForm, sizeof(cuWriteForm));
+    bad[sizeof(cuWriteForm)] = 0x12;
+    bad[sizeof(cuWriteForm) + 1] = 0x34;
+    checkControlReply(exchange(&sim, bad, sizeof(bad), false), BSC_CONTROL_NAK, false);
+    TEST_ASSERT_EQUAL(1, cu.getStats().naksSent);
+    TEST_ASSERT_FALSE(cu.isFieldAttribute(0));
+
+    checkControlReply(exchange(&sim, cuWriteForm, sizeof(cuWriteForm), true), BSC_CONTROL_ACK1, true);
+    TEST_ASSERT_TRUE(cu.isFieldAttribute(0));
+    TEST_ASSERT_EQUAL(0xC1, cu.getScreen(1));
+
+    // ACKs alternate.
+    checkControlReply(exchange(&sim, cuWriteForm, sizeof(cuWriteForm), true), BSC_CONTROL_ACK0, true);
+}
+
+void test_ControlUnitEmulator_wack_rvi(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    DataBuffer *reply;
+
+    cu.setBusy(1);
+    checkControlReply(exchange(&sim, cuSelect, sizeof(cuSelect), false), BSC_CONTROL_WACK, true);
+    TEST_ASSERT_EQUAL(CU_STATE_CONTROL, cu.getState());
+
+    // Status pending ... selects get RVI until a poll has collected it.
+    cu.queueStatus(0x40, 0x50);
+    checkControlReply(exchange(&sim, cuSelect, sizeof(cuSelect), false), BSC_CONTROL_RVI, true);
+
+    reply = exchange(&sim, cuPoll, sizeof(cuPoll), false);
+    TEST_ASSERT_NOT_NULL(reply);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SOH, reply->get(1));
+    TEST_ASSERT_EQUAL(0x6C, reply->get(2));
+    TEST_ASSERT_EQUAL(0xD9, reply->get(3));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_STX, reply->get(4));
+    TEST_ASSERT_EQUAL(0x40, reply->get(7));
+    TEST_ASSERT_EQUAL(0x50, reply->get(8));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, reply->get(9));
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, reply->getBccStatus());
+
+    // ENQ for the reply again ... the same again.
+    reply = exchange(&sim, cuEnq, sizeof(cuEnq), false);
+    TEST_ASSERT_NOT_NULL(reply);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SOH, reply->get(1));
+    TEST_ASSERT_EQUAL(1, cu.getStats().resends);
+    checkControlReply(exchange(&sim, cuAck1, sizeof(cuAck1), false), BSC_CONTROL_EOT, false);
+    checkControlReply(exchange(&sim, cuSelect, sizeof(cuSelect), false), BSC_CONTROL_ACK0, true);
+}
+
+void test_ControlUnitEmulator_read_modified(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    static const uint8_t typed[] = { 0xE7, 0xE8 };
+    DataBuffer *reply;
+
+    exchange(&sim, cuSelect, sizeof(cuSelect), false);
+    exchange(&sim, cuWriteForm, sizeof(cuWriteForm), true);
+    exchange(&sim, cuEot, sizeof(cuEot), false);
+
+    cu.typeText(1, typed, sizeof(typed));
+    cu.pressKey(CU_AID_ENTER);
+
+    // STX cu dev AID cursor SBA field "XYC" ETX
+    reply = exchange(&sim, cuPoll, sizeof(cuPoll), false);
+    TEST_ASSERT_NOT_NULL(reply);
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, reply->getBccStatus());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_STX, reply->get(1));
+    TEST_ASSERT_EQUAL(0x40, reply->get(2));
+    TEST_ASSERT_EQUAL(0x40, reply->get(3));
+    TEST_ASSERT_EQUAL(CU_AID_ENTER, reply->get(4));
+    TEST_ASSERT_EQUAL(0x40, reply->get(5));
+    TEST_ASSERT_EQUAL(0xC3, reply->get(6));
+    TEST_ASSERT_EQUAL(CU_ORDER_SBA, reply->get(7));
+    TEST_ASSERT_EQUAL(0x40, reply->get(8));
+    TEST_ASSERT_EQUAL(0xC1, reply->get(9));
+    TEST_ASSERT_EQUAL(0xE7, reply->get(10));
+    TEST_ASSERT_EQUAL(0xE8, reply->get(11));
+    TEST_ASSERT_EQUAL(0xC3, reply->get(12));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, reply->get(13));
+
+    // Once acknowledged, the key has been dealt with.
+    checkControlReply(exchange(&sim, cuAck1, sizeof(cuAck1), false), BSC_CONTROL_EOT, false);
+    checkControlReply(exchange(&sim, cuPoll, sizeof(cuPoll), false), BSC_CONTROL_EOT, false);
+}
+
+// POLL and WRITE sessions through the text command processor, back to back at
+// each bit rate, reporting transactions per simulated second. WRITE waits 50ms
+// twice, as on the board, so the slower rates are where the line shows.
+void test_ControlUnitEmulator_benchmark(void) {
+    char msg[160];
+
+    for ( int r = 0; r < (int)(sizeof(cuBenchRates) / sizeof(cuBenchRates[0])); r++ ) {
+        Dongle dongle(cuBenchRates[r]);
+        unsigned long long startMicros = shimNowMicros();
+        int timeouts = 0;
+
+        for ( int c = 0; c < CUEMU_BENCH_CYCLES; c++ ) {
+            dongle.run("POLL\n");
+            if ( strstr(dongle.serial.output, "Timeout") )
+                timeouts++;
+            dongle.run("WRITE\n");
+            if ( strstr(dongle.serial.output, "Timeout") )
+                timeouts++;
+        }
+
+        double seconds = (shimNowMicros() - startMicros) / 1e6;
+        const ControlUnitStats & stats = dongle.cu.getStats();
+
+        TEST_ASSERT_EQUAL(0, timeouts);
+        TEST_ASSERT_EQUAL(CUEMU_BENCH_CYCLES, stats.polls);
+        TEST_ASSERT_EQUAL(CUEMU_BENCH_CYCLES, stats.texts);
+        TEST_ASSERT_EQUAL(0, stats.naksSent);
+
+        snprintf(msg, sizeof(msg),
+                 "%ld bps: %d poll + %d write in %.1f s simulated, %.2f transactions/s",
+                 cuBenchRates[r], CUEMU_BENCH_CYCLES, CUEMU_BENCH_CYCLES, seconds,
+                 2 * CUEMU_BENCH_CYCLES / seconds);
+        TEST_MESSAGE(msg);
+    }
+}
+
+// SYN cu cu dv dv ENQ as a sequenced CMD_WRITE_READ.
+static const uint8_t pipePoll[] = {
+    CMD_SEQUENCED, 0x00, 0x0A, 0x00, CMD_WRITE_READ, 0x00, 0x06,
+    BSC_CONTROL_SYN, 0x40, 0x40, 0x40, 0x40, BSC_CONTROL_ENQ
+};
+#define PIPE_POLL_SEQ   3       // Where the sequence number goes
+
+// A host polling through the binary command processor, with up to window polls
+// sent and not yet answered. Each poll is sent a USB round trip after the
+// response that let it go, so with a window of one the line waits for the host
+// every time.
+class PollHost_ : public Serial_ {
+    public:
+        int     commands;
+        int     window;
+        int     completed;
+        int     outOfOrder;
+        int     badReplies;
+
+        void start(int count, int maxOutstanding) {
+            commands = count;
+            window = maxOutstanding;
+            completed = 0;
+            outOfOrder = 0;
+            badReplies = 0;
+            _readPos = 0;
+            _hdrPos = 0;
+            _dataPos = 0;
+            _lastSeq = -1;
+            for ( int x = 0; x < CUEMU_PIPE_POLLS; x++ )
+                _releaseAt[x] = x < window ? 0 : ~0ULL;
+        }
+        virtual int available(void) {
+            int cmd = _readPos / sizeof(pipePoll);
+            int len = 0;
+
+            for ( ; cmd < commands && shimNowMicros() >= _releaseAt[cmd]; cmd++ )
+                len += sizeof(pipePoll);
+            return len > 0 ? len - _readPos % sizeof(pipePoll) : 0;
+        }
+        virtual int peek(void) {
+            return available() > 0 ? pollByte(_readPos) : -1;
+        }
+        virtual int read(void) {
+            return available() > 0 ? pollByte(_readPos++) : -1;
+        }
+        // Response records ... the tag, then the response to the poll.
+        virtual size_t write(uint8_t data) {
+            if ( _hdrPos < 3 ) {
+                _hdr[_hdrPos++] = data;
+                if ( _hdrPos == 3 && (_hdr[1] << 8 | _hdr[2]) == 0 )
+                    record();
+                return 1;
+            }
+            if ( _dataPos < (int)sizeof(_data) )
+                _data[_dataPos] = data;
+            if ( ++_dataPos == (_hdr[1] << 8 | _hdr[2]) )
+                record();
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        int                 _readPos;
+        uint8_t             _hdr[3];
+        int                 _hdrPos;
+        uint8_t             _data[16];
+        int                 _dataPos;
+        int                 _lastSeq;
+        unsigned long long  _releaseAt[CUEMU_PIPE_POLLS];
+
+        uint8_t pollByte(int pos) {
+            int idx = pos % sizeof(pipePoll);
+            return idx == PIPE_POLL_SEQ ? (pos / sizeof(pipePoll)) & 0xff : pipePoll[idx];
+        }
+        void record(void) {
+            if ( _hdr[0] == (CMD_SEQUENCED | CMD_RESPONSE_MASK) ) {
+                if ( _data[0] != ((_lastSeq + 1) & 0xff) )
+                    outOfOrder++;
+                _lastSeq = _data[0];
+            } else if ( (_hdr[0] & 0x8F) == (CMD_WRITE_READ | CMD_RESPONSE_MASK) ) {
+                if ( _hdr[0] != (CMD_WRITE_READ | CMD_RESPONSE_MASK) || _data[1] != BSC_CONTROL_EOT )
+                    badReplies++;
+                int next = completed++ + window;
+                if ( next < commands )
+                    _releaseAt[next] = shimNowMicros() + CUEMU_USB_ROUND_TRIP;
+            }
+            _hdrPos = 0;
+            _dataPos = 0;
+        }
+};
+
+// Polls per simulated second with up to window polls on their way.
+static double runPipelinedPolls(int window) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    SyncControl syncControl(&sim.getStation(0));
+    CommandProcessorBinary cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl);
+    PollHost_ host;
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&host);
+    sim.start();
+
+    host.start(CUEMU_PIPE_POLLS, window);
+    unsigned long long startMicros = shimNowMicros();
+    while ( host.completed < CUEMU_PIPE_POLLS )
+        cmdproc.process();
+    double seconds = (shimNowMicros() - startMicros) / 1e6;
+
+    TEST_ASSERT_EQUAL(CUEMU_PIPE_POLLS, host.completed);
+    TEST_ASSERT_EQUAL(0, host.outOfOrder);
+    TEST_ASSERT_EQUAL(0, host.badReplies);
+    TEST_ASSERT_EQUAL(CUEMU_PIPE_POLLS, cu.getStats().polls);
+    return CUEMU_PIPE_POLLS / seconds;
+}
+
+void test_ControlUnitEmulator_pipelined_polls(void) {
+    char msg[160];
+    double waiting = runPipelinedPolls(1);
+    double pipelined = runPipelinedPolls(3);
+
+    TEST_ASSERT_TRUE(pipelined > waiting);
+    snprintf(msg, sizeof(msg),
+             "%d polls at %d bps: %.1f polls/s waiting for each response, %.1f polls/s with 3 on their way",
+             CUEMU_PIPE_POLLS, CUEMU_TEST_BIT_RATE, waiting, pipelined);
+    TEST_MESSAGE(msg);
+}
+
+// CU poll address 40, devices 40 (the display) and 41 (nothing there).
+static const uint8_t pollListLoad[] = { CMD_POLL_LIST, 0x00, 0x03, 0x40, 0x40, 0x41 };
+static const uint8_t pollListStop[] = { CMD_POLL_LIST, 0x00, 0x00 };
+
+// A host that loads the poll list, then stops it once the virtual clock has
+// reached stopAt, and keeps everything the dongle sends it.
+class PollListHost_ : public Serial_ {
+    public:
+        uint8_t                 output[CUEMU_OUTPUT_MAX];
+        int                     outputLen;
+        unsigned long long      stopAt;
+
+        PollListHost_() {
+            outputLen = 0;
+            _readPos = 0;
+            stopAt = 0;
+        }
+        virtual int available(void) {
+            int len = sizeof(pollListLoad);
+
+            if ( shimNowMicros() >= stopAt )
+                len += sizeof(pollListStop);
+            return len - _readPos;
+        }
+        virtual int peek(void) {
+            return available() > 0 ? script(_readPos) : -1;
+        }
+        virtual int read(void) {
+            return available() > 0 ? script(_readPos++) : -1;
+        }
+        virtual size_t write(uint8_t data) {
+            if ( outputLen < CUEMU_OUTPUT_MAX )
+                output[outputLen++] = data;
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        int     _readPos;
+
+        uint8_t script(int pos) {
+            if ( pos < (int)sizeof(pollListLoad) )
+                return pollListLoad[pos];
+            return pollListStop[pos - sizeof(pollListLoad)];
+        }
+};
+
+// Status from the display while the list is worked through ... it is reported
+// once, with the address, and acknowledged, then the display only answers EOT.
+// The empty device answers nothing.
+void test_ControlUnitEmulator_poll_list(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    SyncControl syncControl(&sim.getStation(0));
+    CommandProcessorBinary cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl);
+    PollListHost_ host;
+    int statusReports = 0;
+    int timeouts = 0;
+    int others = 0;
+    char msg[160];
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&host);
+    sim.start();
+    cu.queueStatus(0x40, 0x50);
+
+    host.stopAt = shimNowMicros() + CUEMU_POLL_LIST_MICROS;
+    cmdproc.process();      // Load
+    cmdproc.process();      // Polls until the stop arrives
+
+    // Load and stop responses first and last, the reports in between.
+    TEST_ASSERT_EQUAL(CMD_POLL_LIST | CMD_RESPONSE_MASK, host.output[0]);
+    TEST_ASSERT_EQUAL(0, host.output[1] << 8 | host.output[2]);
+    TEST_ASSERT_EQUAL(CMD_POLL_LIST | CMD_RESPONSE_MASK, host.output[host.outputLen - 3]);
+
+    for ( int pos = 3; pos < host.outputLen - 3; ) {
+        uint8_t code = host.output[pos];
+        int len = host.output[pos + 1] << 8 | host.output[pos + 2];
+        uint8_t *data = host.output + pos + 3;
+
+        if ( code == (CMD_POLL_LIST | CMD_RESPONSE_MASK) && len >= 11 && data[0] == 0x40 ) {
+            // dev, then SYN SOH % R STX cu dv ss0 ss1 ETX BCC
+            TEST_ASSERT_EQUAL(BSC_CONTROL_SOH, data[2]);
+            TEST_ASSERT_EQUAL(0x40, data[8]);
+            TEST_ASSERT_EQUAL(0x50, data[9]);
+            TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, data[10]);
+            statusReports++;
+        } else if ( code == (CMD_POLL_LIST | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT) &&
+                    len == 1 && data[0] == 0x41 ) {
+            timeouts++;
+        } else {
+            others++;
+        }
+        pos += 3 + len;
+    }
+
+    const ControlUnitStats & stats = cu.getStats();
+    TEST_ASSERT_EQUAL(1, statusReports);
+    TEST_ASSERT_EQUAL(0, others);
+    TEST_ASSERT_TRUE(timeouts > 0);
+    TEST_ASSERT_EQUAL(0, stats.resends);
+    // The devices take turns.
+    TEST_ASSERT_TRUE(stats.polls > 1);
+    TEST_ASSERT_TRUE(stats.polls >= (unsigned long)timeouts);
+    TEST_ASSERT_EQUAL(CU_STATE_CONTROL, cu.getState());
+
+    snprintf(msg, sizeof(msg),
+             "Poll list: %lu polls of the display in %d s simulated, %d bytes to the host",
+             stats.polls, CUEMU_POLL_LIST_MICROS / 1000000, host.outputLen);
+    TEST_MESSAGE(msg);
+}
+
+// A display slow enough that the dongle has given up on it (27 ms at 9600 bps)
+// just before its EOT starts. The EOT is in before the next poll has gone.
+#define CUEMU_LATE_TURNAROUND   275     // Bit times
+#define CUEMU_LATE_MICROS       500000
+
+// The late EOT must not be taken as the reply to the poll of the empty device
+// after it. Both devices time out every time round.
+void test_ControlUnitEmulator_poll_list_late_reply(void) {
+    LineSimulator sim(CUEMU_TEST_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    SyncControl syncControl(&sim.getStation(0));
+    CommandProcessorBinary cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl);
+    PollListHost_ host;
+    int timeouts[2] = { 0, 0 };
+    int others = 0;
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&host);
+    sim.start();
+    cu.setTurnaroundBits(CUEMU_LATE_TURNAROUND);
+
+    host.stopAt = shimNowMicros() + CUEMU_LATE_MICROS;
+    cmdproc.process();      // Load
+    cmdproc.process();      // Polls until the stop arrives
+
+    for ( int pos = 3; pos < host.outputLen - 3; ) {
+        uint8_t code = host.output[pos];
+        int len = host.output[pos + 1] << 8 | host.output[pos + 2];
+        uint8_t *data = host.output + pos + 3;
+
+        if ( code == (CMD_POLL_LIST | CMD_RESPONSE_MASK | CMD_RESPONSE_TIMEOUT) &&
+             len == 1 && ( data[0] == 0x40 || data[0] == 0x41 ) )
+            timeouts[data[0] - 0x40]++;
+        else
+            others++;
+        pos += 3 + len;
+    }
+
+    TEST_ASSERT_EQUAL(0, others);
+    TEST_ASSERT_TRUE(cu.getStats().polls > 2);
+    TEST_ASSERT_TRUE(timeouts[0] > 2);
+    TEST_ASSERT_TRUE(timeouts[0] - timeouts[1] <= 1);
+    TEST_ASSERT_TRUE(timeouts[1] - timeouts[0] <= 1);
+}
+
+static const uint8_t readPoll[] = { BSC_CONTROL_SYN, 0x40, 0x40, 0x40, 0x40, BSC_CONTROL_ENQ };
+
+// A host reading what a poll brings, either a block at a time with
+// CMD_WRITE_READ, sending each ACK itself a USB round trip after the block came
+// in, or all of it with one CMD_READ_MULTI. The text of the blocks is kept.
+class ReadHost_ : public Serial_ {
+    public:
+        uint8_t     text[CU_TEXT_MAX];
+        int         textLen;
+        int         blocks;
+        int         badRecords;
+        bool        done;
+        bool        gotEot;
+
+        void start(bool multi) {
+            _multi = multi;
+            _nextAck = BSC_CONTROL_ACK1;
+            _hdrPos = 0;
+            _dataPos = 0;
+            textLen = 0;
+            blocks = 0;
+            badRecords = 0;
+            done = false;
+            gotEot = false;
+            command(multi ? CMD_READ_MULTI : CMD_WRITE_READ, readPoll, sizeof(readPoll), 0);
+        }
+        virtual int available(void) {
+            return shimNowMicros() >= _releaseAt ? _commandLen - _readPos : 0;
+        }
+        virtual int peek(void) {
+            return available() > 0 ? _command[_readPos] : -1;
+        }
+        virtual int read(void) {
+            return available() > 0 ? _command[_readPos++] : -1;
+        }
+        virtual size_t write(uint8_t data) {
+            if ( _hdrPos < 3 ) {
+                _hdr[_hdrPos++] = data;
+                if ( _hdrPos == 3 && (_hdr[1] << 8 | _hdr[2]) == 0 )
+                    record();
+                return 1;
+            }
+            if ( _dataPos < (int)sizeof(_data) )
+                _data[_dataPos] = data;
+            if ( ++_dataPos == (_hdr[1] << 8 | _hdr[2]) )
+                record();
+            return 1;
+        }
+        using Print::write;
+
+    private:
+        bool                _multi;
+        uint8_t             _nextAck;
+        uint8_t             _command[16];
+        int                 _commandLen;
+        int                 _readPos;
+        unsigned long long  _releaseAt;
+        uint8_t             _hdr[3];
+        int                 _hdrPos;
+        uint8_t             _data[DATABUFF_MAX_DATA];
+        int                 _dataPos;
+
+        void command(uint8_t code, const uint8_t *data, int len, unsigned long long at) {
+            _command[0] = code;
+            _command[1] = 0;
+            _command[2] = len;
+            memcpy(_command + 3, data, len);
+            _commandLen = 3 + len;
+            _readPos = 0;
+            _releaseAt = at;
+        }
+        // SYN STX text... ETB/ETX BCC1 BCC2 PAD, or SYN EOT PAD at the end.
+        void record(void) {
+            uint8_t expected = ( _multi ? CMD_READ_MULTI : CMD_WRITE_READ ) | CMD_RESPONSE_MASK;
+            int len = _hdr[1] << 8 | _hdr[2];
+
+            if ( (_hdr[0] & ~CMD_RESPONSE_MORE) != expected ) {
+                badRecords++;
+                done = true;
+            } else if ( len > 6 && _data[1] == BSC_CONTROL_STX ) {
+                memcpy(text + textLen, _data + 2, len - 6);
+                textLen += len - 6;
+                blocks++;
+                if ( !_multi ) {
+                    uint8_t ack[] = { BSC_CONTROL_SYN, BSC_CONTROL_DLE, _nextAck };
+                    _nextAck = ( _nextAck == BSC_CONTROL_ACK1 ) ? BSC_CONTROL_ACK0 : BSC_CONTROL_ACK1;
+                    command(CMD_WRITE_READ, ack, sizeof(ack), shimNowMicros() + CUEMU_USB_ROUND_TRIP);
+                }
+            } else {
+                gotEot = ( len >= 2 && _data[1] == BSC_CONTROL_EOT );
+                done = true;
+            }
+            _hdrPos = 0;
+            _dataPos = 0;
+        }
+};
+
+// Seconds to read a modified field of CUEMU_READ_FIELD bytes, which the CU
+// sends in blocks, with the host or the dongle acknowledging them.
+static double runReadMulti(bool multi) {
+    LineSimulator sim(CUEMU_READ_BIT_RATE);
+    ControlUnitEmulator cu(&sim, 1);
+    SyncControl syncControl(&sim.getStation(0));
+    CommandProcessorBinary cmdproc(sim.getSendEngine(0), sim.getReceiveEngine(0), &syncControl);
+    ReadHost_ host;
+    // An unprotected field at 0, up to a protected one at CUEMU_READ_FIELD + 1.
+    uint8_t form[] = {
+        BSC_CONTROL_STX, CU_ESC, CU_CMD_EW, 0x42,
+        CU_ORDER_SF, 0x40,
+        CU_ORDER_SBA, ControlUnitEmulator::addressCode((CUEMU_READ_FIELD + 1) >> 6),
+                      ControlUnitEmulator::addressCode(CUEMU_READ_FIELD + 1),
+        CU_ORDER_SF, 0x60,
+        BSC_CONTROL_ETX
+    };
+    uint8_t typed[CUEMU_READ_FIELD];
+
+    exchange(&sim, cuSelect, sizeof(cuSelect), false);
+    exchange(&sim, form, sizeof(form), true);
+    exchange(&sim, cuEot, sizeof(cuEot), false);
+    for ( int x = 0; x < CUEMU_READ_FIELD; x++ )
+        typed[x] = 0xC1 + x % 9;
+    cu.typeText(1, typed, sizeof(typed));
+    cu.pressKey(CU_AID_ENTER);
+
+    cmdproc.enableDebug(false);
+    cmdproc.injectSerial(&host);
+    host.start(multi);
+    unsigned long long startMicros = shimNowMicros();
+    while ( !host.done )
+        cmdproc.process();
+    double seconds = (shimNowMicros() - startMicros) / 1e6;
+
+    // cu dv AID cursor SBA addr, then the field
+    TEST_ASSERT_EQUAL(0, host.badRecords);
+    TEST_ASSERT_TRUE(host.gotEot);
+    TEST_ASSERT_EQUAL(4, host.blocks);
+    TEST_ASSERT_EQUAL(CUEMU_READ_FIELD + 8, host.textLen);
+    TEST_ASSERT_EQUAL(CU_AID_ENTER, host.text[2]);
+    TEST_ASSERT_EQUAL(CU_ORDER_SBA, host.text[5]);
+    TEST_ASSERT_EQUAL_MEMORY(typed, host.text + 8, CUEMU_READ_FIELD);
+    TEST_ASSERT_EQUAL(0, cu.getStats().ackErrors);
+    TEST_ASSERT_EQUAL(0, cu.getStats().resends);
+    TEST_ASSERT_EQUAL(CU_STATE_CONTROL, cu.getState());
+    return seconds;
+}
+
+void test_ControlUnitEmulator_read_multi(void) {
+    char msg[160];
+    double hostAcks = runReadMulti(false);
+    double dongleAcks = runReadMulti(true);
+
+    TEST_ASSERT_TRUE(dongleAcks < hostAcks);
+    snprintf(msg, sizeof(msg),
+             "%d byte read in 4 blocks at %d bps: %.1f ms with host ACKs, %.1f ms with CMD_READ_MULTI",
+             CUEMU_READ_FIELD + 8, CUEMU_READ_BIT_RATE, hostAcks * 1000, dongleAcks * 1000);
+    TEST_MESSAGE(msg);
+}
+
+void test_ControlUnitEmulator() {
+    RUN_TEST(test_ControlUnitEmulator_poll);
+    RUN_TEST(test_ControlUnitEmulator_bit_rate);
+    RUN_TEST(test_ControlUnitEmulator_reply_timeout);
+    RUN_TEST(test_ControlUnitEmulator_read_stream_timeout);
+    RUN_TEST(test_ControlUnitEmulator_write);
+    RUN_TEST(test_ControlUnitEmulator_nak);
+    RUN_TEST(test_ControlUnitEmulator_wack_rvi);
+    RUN_TEST(test_ControlUnitEmulator_read_modified);
+    RUN_TEST(test_ControlUnitEmulator_pipelined_polls);
+    RUN_TEST(test_ControlUnitEmulator_poll_list);
+    RUN_TEST(test_ControlUnitEmulator_poll_list_late_reply);
+    RUN_TEST(test_ControlUnitEmulator_read_multi);
+    RUN_TEST(test_ControlUnitEmulator_benchmark);
+}
+
+#else
+
+void test_ControlUnitEmulator() {
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef mock_LineBackend_h
+#define mock_LineBackend_h
+
+#include <Arduino.h>
+
+#include "LineBackend.h"
+
+/*
+ * A byte clocked line backend with no hardware behind it. Each clock() does what
+ * the USART interrupts do for one byte time: take the next byte from the send
+ * engine and hand a received byte to the receive engine.
+ *
+ * The line is looped back, delayed by bitOffset bits, so the receive side sees
+ * the characters at any alignment to the byte boundaries, as it would from a
+ * real DTE.
+ */
+class MockLineBackend : public LineBackend {
+    public:
+        uint8_t sent[256];
+        int     sentLen;
+
+        MockLineBackend(uint8_t bitOffset) : LineBackend() {
+            _bitOffset = bitOffset;
+            _line = 0xFFFF;     // Mark
+            sentLen = 0;
+        }
+
+        virtual void init() {
+            sendEngine = new SendEngine(rxdPin);
+            receiveEngine = new ReceiveEngine(txdPin, ctsPin);
+        }
+
+        void clock(void) {
+            uint8_t out = nextLineByte();
+            if ( sentLen < (int)sizeof(sent) )
+                sent[sentLen++] = out;
+
+            _line = (_line >> 8) | ((uint16_t)out << 8);
+            lineByteReceived((uint8_t)(_line >> (8 - _bitOffset)));
+
+            // What the main loop would be doing.
+            receiveEngine->drain();
+        }
+
+    private:
+        uint8_t  _bitOffset;
+        uint16_t _line;
+};
+
+#endif
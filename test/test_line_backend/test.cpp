@@ -0,0 +1,39 @@
+#include <Arduino.h>
+#include <unity.h>
+
+extern void test_LineBackend();
+extern void test_LineSimulator();
+
+void setUp(void) {
+
+}
+
+void tearDown(void) {
+
+}
+
+
+
+void setup() {
+    delay(4000);
+
+    UNITY_BEGIN();
+}
+
+void loop() {
+    test_LineBackend();
+    test_LineSimulator();
+    UNITY_END();
+#ifdef ARDUINO
+    while(1);
+#endif
+}
+
+#ifndef ARDUINO
+// Native build ... there is no Arduino core to call setup() and loop().
+int main(int argc, char **argv) {
+    setup();
+    loop();
+    return 0;
+}
+#endif
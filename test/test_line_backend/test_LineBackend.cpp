@@ -0,0 +1,223 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "LineBackend.h"
+#include "SyncBitBanger.h"
+#include "mock_LineBackend.h"
+
+#define RXD_PIN 9
+
+static const uint8_t testFrame[] = {
+    BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_SYN, BSC_CONTROL_SYN,
+    BSC_CONTROL_STX, 0xC1, 0xC2, BSC_CONTROL_ETX, 0x44, 0x55, BSC_CONTROL_PAD
+};
+
+static void loadFrame(SendEngine *eng, const uint8_t *data, int len) {
+    eng->clearBuffer();
+    for ( int x = 0; x < len; x++ )
+        eng->addByte(data[x]);
+}
+
+void test_LineBackend_nextByte(void) {
+    SendEngine eng(RXD_PIN);
+
+    // Off ... nothing to send.
+    TEST_ASSERT_EQUAL(-1, eng.nextByte());
+
+    loadFrame(&eng, testFrame, sizeof(testFrame));
+    eng.startSending();
+    for ( unsigned int x = 0; x < sizeof(testFrame); x++ ) {
+        TEST_ASSERT_EQUAL(testFrame[x], eng.nextByte());
+        TEST_ASSERT_EQUAL(SEND_STATE_XMIT, eng.xmitState);
+    }
+
+    // Idle fill until told to stop.
+    TEST_ASSERT_EQUAL(BSC_CONTROL_IDLE, eng.nextByte());
+    TEST_ASSERT_EQUAL(SEND_STATE_IDLE, eng.xmitState);
+    eng.stopSendingOnIdle();
+    TEST_ASSERT_EQUAL(-1, eng.nextByte());
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, eng.xmitState);
+}
+
+void test_LineBackend_nextByte_matches_sendBit(void) {
+    SendEngine bitEng(RXD_PIN);
+    SendEngine byteEng(RXD_PIN);
+
+    loadFrame(&bitEng, testFrame, sizeof(testFrame));
+    loadFrame(&byteEng, testFrame, sizeof(testFrame));
+    bitEng.startSending();
+    bitEng.stopSendingOnIdle();
+    byteEng.startSending();
+    byteEng.stopSendingOnIdle();
+
+    // The bits sendBit() puts on the line are the bytes from nextByte(), LSB first.
+    for ( unsigned int x = 0; x < sizeof(testFrame); x++ ) {
+        int data = byteEng.nextByte();
+        for ( int b = 0; b < 8; b++ ) {
+            bitEng.sendBit();
+            TEST_ASSERT_EQUAL((data >> b) & 0x01, bitEng.lastBitSent);
+        }
+    }
+    TEST_ASSERT_EQUAL(-1, byteEng.nextByte());
+    bitEng.sendBit();
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, bitEng.xmitState);
+}
+
+void test_LineBackend_mark_when_off(void) {
+    MockLineBackend line(0);
+    line.init();
+
+    line.clock();
+    line.clock();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_PAD, line.sent[0]);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_PAD, line.sent[1]);
+    TEST_ASSERT_FALSE(line.receiveEngine->getInCharSync());
+}
+
+void test_LineBackend_loopback(void) {
+    char msg[40];
+
+    // The receiver must find the SYN whatever the alignment to the byte clock.
+    for ( uint8_t offset = 0; offset < 8; offset++ ) {
+        MockLineBackend line(offset);
+        line.init();
+        sprintf(msg, "Bit offset %d", offset);
+
+        line.receiveEngine->startReceiving();
+        loadFrame(line.sendEngine, testFrame, sizeof(testFrame));
+        line.sendEngine->startSending();
+        line.sendEngine->stopSendingOnIdle();
+
+        for ( int x = 0; x < 20 && !line.receiveEngine->isFrameComplete(); x++ )
+            line.clock();
+
+        TEST_ASSERT_TRUE_MESSAGE(line.receiveEngine->isFrameComplete(), msg);
+        DataBuffer * frame = line.receiveEngine->getSavedFrame();
+        // Received from the first SYN on.
+        TEST_ASSERT_EQUAL_MESSAGE(sizeof(testFrame) - 3, frame->getLength(), msg);
+        for ( int x = 0; x < frame->getLength(); x++ )
+            TEST_ASSERT_EQUAL_MESSAGE(testFrame[x + 3], frame->get(x), msg);
+    }
+}
+
+void test_LineBackend_bit_rate(void) {
+    SyncBitBanger line;
+    LineRateInfo info;
+
+    line.sendEngine = new SendEngine(RXD_PIN);
+    line.receiveEngine = new ReceiveEngine(3, 8);
+
+    // Quarter bit periods of whole microseconds ... 26us for 9600 bps.
+    TEST_ASSERT_EQUAL(LINE_RATE_OK, line.setBitRate(9600, &info));
+    TEST_ASSERT_EQUAL(9600, line.bitRate);
+    TEST_ASSERT_EQUAL(26, Timer1.getPeriod());
+    TEST_ASSERT_EQUAL(9615, info.bitRate);
+    TEST_ASSERT_EQUAL(104000, info.bitPeriodNs);
+    TEST_ASSERT_EQUAL(1602, info.errorPpm);
+
+    TEST_ASSERT_EQUAL(LINE_RATE_OK, line.setBitRate(300, &info));
+    TEST_ASSERT_EQUAL(833, Timer1.getPeriod());
+    TEST_ASSERT_EQUAL(300, info.bitRate);
+    TEST_ASSERT_EQUAL(400, info.errorPpm);
+
+    // Only rates from the table, and only while the line is idle.
+    TEST_ASSERT_EQUAL(LINE_RATE_UNSUPPORTED, line.setBitRate(1234, &info));
+    line.sendEngine->startSending();
+    TEST_ASSERT_EQUAL(LINE_RATE_BUSY, line.setBitRate(19200, &info));
+    TEST_ASSERT_EQUAL(300, line.bitRate);
+    line.sendEngine->stopSending();
+    line.receiveEngine->receiveState = RECEIVE_STATE_DATA;
+    TEST_ASSERT_EQUAL(LINE_RATE_BUSY, line.setBitRate(19200, &info));
+    line.receiveEngine->receiveState = RECEIVE_STATE_OUT_OF_SYNC;
+    TEST_ASSERT_EQUAL(LINE_RATE_OK, line.setBitRate(19200, &info));
+    TEST_ASSERT_EQUAL(13, Timer1.getPeriod());
+
+    // After a reply the receiver waits in IDLE on the marking line. That is
+    // idle, but not once the next frame has started with DLE.
+    line.receiveEngine->processByteChain(BSC_CONTROL_SYN);
+    line.receiveEngine->processByteChain(BSC_CONTROL_SYN);
+    line.receiveEngine->processByteChain(BSC_CONTROL_DLE);
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_IDLE, line.receiveEngine->receiveState);
+    TEST_ASSERT_EQUAL(LINE_RATE_BUSY, line.setBitRate(9600, &info));
+    line.receiveEngine->processByteChain(BSC_CONTROL_ACK0);
+    line.receiveEngine->processByteChain(BSC_CONTROL_PAD);
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_IDLE, line.receiveEngine->receiveState);
+    TEST_ASSERT_EQUAL(1, line.receiveEngine->getQueuedFrames());
+    TEST_ASSERT_EQUAL(LINE_RATE_OK, line.setBitRate(9600, &info));
+    TEST_ASSERT_EQUAL(26, Timer1.getPeriod());
+
+    // A backend that cannot change its clock.
+    MockLineBackend mock(0);
+    mock.init();
+    TEST_ASSERT_EQUAL(LINE_RATE_UNSUPPORTED, mock.setBitRate(9600, &info));
+
+    Timer1.reset();
+}
+
+void test_LineBackend_stats(void) {
+    SyncBitBanger line;
+    LineStats stats;
+
+    // A second of interrupts at 300 bps, each finishing 100 cycles in.
+    TCNT1 = 100;
+    line.init();
+    TEST_ASSERT_TRUE(line.getStats(&stats, false));
+    TEST_ASSERT_EQUAL(1200, stats.interrupts);
+    TEST_ASSERT_EQUAL(0, stats.lateInterrupts);
+    TEST_ASSERT_EQUAL(0, stats.missedInterrupts);
+    TEST_ASSERT_EQUAL(833 * 16, stats.periodCycles);
+    for ( int x = 0; x < LINE_STATS_PHASES; x++ ) {
+        TEST_ASSERT_EQUAL(100, stats.phaseCyclesMin[x]);
+        TEST_ASSERT_EQUAL(100, stats.phaseCyclesAvg[x]);
+        TEST_ASSERT_EQUAL(100, stats.phaseCyclesMax[x]);
+    }
+    TEST_ASSERT_EQUAL(0, stats.bitsSentPerSecond);
+
+    // Sending, with every interrupt still running when the next is due.
+    TCNT1 = 10;
+    TIFR1.set(_BV(TOV1));
+    for ( int x = 0; x < 40; x++ )
+        line.sendEngine->addByte(BSC_CONTROL_SYN);
+    line.sendEngine->startSending();
+    delay(1000);
+    TIFR1 = _BV(TOV1);
+    TEST_ASSERT_TRUE(line.getStats(&stats, true));
+    TEST_ASSERT_EQUAL(2400, stats.interrupts);
+    TEST_ASSERT_EQUAL(1200, stats.lateInterrupts);
+    TEST_ASSERT_EQUAL(10, stats.phaseCyclesMin[0]);
+    TEST_ASSERT_EQUAL(10, stats.phaseCyclesAvg[0]);
+    TEST_ASSERT_EQUAL(100, stats.phaseCyclesMax[0]);
+    TEST_ASSERT_EQUAL(300, stats.bitsSentPerSecond);
+
+    // Cleared, then 10ms in which the timer is held off.
+    line.getStats(&stats, false);
+    TEST_ASSERT_EQUAL(0, stats.interrupts);
+    TEST_ASSERT_EQUAL(0, stats.phaseCyclesMax[0]);
+    Timer1.stop();
+    delay(10);
+    Timer1.resume();
+    delay(1000);
+    line.getStats(&stats, false);
+    TEST_ASSERT_EQUAL(10000 / 833, stats.missedInterrupts);
+
+    // A phase seen taking 1000 cycles (62.5us) rules out rates it would not fit.
+    LineRateInfo info;
+    TCNT1 = 1000;
+    delay(10);
+    line.sendEngine->stopSending();
+    TEST_ASSERT_EQUAL(LINE_RATE_TOO_FAST, line.setBitRate(4800, &info));
+    TEST_ASSERT_EQUAL(LINE_RATE_OK, line.setBitRate(2400, &info));
+
+    Timer1.reset();
+    SyncBitBanger::syncBitBangerInstance = NULL;
+    TCNT1 = 0;
+}
+
+void test_LineBackend() {
+    RUN_TEST(test_LineBackend_nextByte);
+    RUN_TEST(test_LineBackend_nextByte_matches_sendBit);
+    RUN_TEST(test_LineBackend_mark_when_off);
+    RUN_TEST(test_LineBackend_loopback);
+    RUN_TEST(test_LineBackend_bit_rate);
+    RUN_TEST(test_LineBackend_stats);
+}
@@ -0,0 +1,355 @@
+#include <Arduino.h>
+#include <unity.h>
+
+/*
+ * Two engine pairs back to back on the simulated line (lib/native-shim). Only
+ * built on the host ... there is no line simulator on the board.
+ */
+
+#ifdef ARDUINO_SHIM
+
+#include "LineSimulator.h"
+
+#define LINESIM_TEST_BIT_RATE       9600
+#define LINESIM_BENCH_FRAMES        200
+#define LINESIM_BENCH_TEXT          80
+#define LINESIM_LATENCY_FRAMES      20
+#define LINESIM_POLL_SEQUENCES      50
+#define LINESIM_FRAME_PREP_MICROS   150     // Main loop time to get a frame ready
+
+static const uint8_t textA[] = { 0xC1, 0xC2, 0xC3, 0x40, 0xF1, 0xF2, 0xF3 };
+static const uint8_t textB[] = { 0x11, 0x40, 0x40, 0xE6, 0xD6, 0xD9, 0xD3, 0xC4 };
+
+// PAD LEADING_PAD LEADING_PAD SYN SYN STX text... ETX BCC1 BCC2 PAD
+static void queueFrame(SendEngine *eng, const uint8_t *text, int len) {
+    eng->clearBuffer();
+    eng->setAutoBcc(true);
+    eng->addByte(BSC_CONTROL_PAD);
+    eng->addByte(BSC_CONTROL_LEADING_PAD);
+    eng->addByte(BSC_CONTROL_LEADING_PAD);
+    eng->addByte(BSC_CONTROL_SYN);
+    eng->addByte(BSC_CONTROL_SYN);
+    eng->addByte(BSC_CONTROL_STX);
+    for ( int x = 0; x < len; x++ )
+        eng->addByte(text[x]);
+    eng->addByte(BSC_CONTROL_ETX);
+    eng->addByte(BSC_CONTROL_PAD);
+    eng->startSending();
+    eng->stopSendingOnIdle();
+}
+
+// Run the line until the station has a frame, or for at most maxBits.
+static bool runUntilFrame(LineSimulator *sim, uint8_t station, unsigned long maxBits) {
+    ReceiveEngine *eng = sim->getReceiveEngine(station);
+
+    for ( unsigned long bits = 0; bits < maxBits; bits += 8 ) {
+        sim->runBits(8);
+        if ( eng->isFrameComplete() )
+            return true;
+    }
+    return false;
+}
+
+// The frame as received: SYN STX text... ETX BCC1 BCC2 PAD, BCC status as given.
+static void checkFrame(DataBuffer *frame, const uint8_t *text, int len, uint8_t bccStatus) {
+    TEST_ASSERT_EQUAL(len + 6, frame->getLength());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, frame->get(0));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_STX, frame->get(1));
+    for ( int x = 0; x < len; x++ )
+        TEST_ASSERT_EQUAL(text[x], frame->get(x + 2));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, frame->get(len + 2));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_PAD, frame->get(len + 5));
+    TEST_ASSERT_EQUAL(bccStatus, frame->getBccStatus());
+}
+
+void test_LineSimulator_loopback(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+
+    sim.getReceiveEngine(0)->startReceiving();
+    sim.getReceiveEngine(1)->startReceiving();
+    sim.runBits(64);        // Mark ... nothing to receive yet.
+
+    // Both directions at once.
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    queueFrame(sim.getSendEngine(1), textB, sizeof(textB));
+
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 400));
+    checkFrame(sim.getReceiveEngine(1)->getSavedFrame(), textA, sizeof(textA), FRAME_BCC_GOOD);
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 0, 400));
+    checkFrame(sim.getReceiveEngine(0)->getSavedFrame(), textB, sizeof(textB), FRAME_BCC_GOOD);
+
+    TEST_ASSERT_EQUAL(1, sim.getFrames(0));
+    TEST_ASSERT_EQUAL(1, sim.getFrames(1));
+
+    // The bits went out through the real port registers.
+    TEST_ASSERT_EQUAL(sim.getSendEngine(0)->lastBitSent,
+                      shimGetOutputPin(sim.getStation(0).rxdPin));
+}
+
+void test_LineSimulator_bit_error(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+
+    sim.getReceiveEngine(1)->startReceiving();
+    sim.runBits(64);
+
+    // Bit 3 of the third text character.
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    sim.getWireFrom(0).scheduleBitError(64 + 8 * 8 + 3);
+
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 400));
+    DataBuffer *frame = sim.getReceiveEngine(1)->getSavedFrame();
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, frame->getBccStatus());
+    TEST_ASSERT_EQUAL(textA[2] ^ 0x08, frame->get(4));
+    TEST_ASSERT_EQUAL(1, sim.getWireFrom(0).getBitErrors());
+}
+
+void test_LineSimulator_slip(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+    ReceiveEngine *recv = sim.getReceiveEngine(1);
+
+    recv->startReceiving();
+    sim.runBits(64);
+
+    // An extra bit mid text ... the receiver is a bit out and never sees the ETX
+    // where it should, so no good frame.
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    sim.getWireFrom(0).scheduleSlip(64 + 8 * 7 + 5, 1);
+    if ( runUntilFrame(&sim, 1, 400) )
+        TEST_ASSERT_TRUE(recv->getSavedFrame()->getBccStatus() != FRAME_BCC_GOOD);
+    TEST_ASSERT_EQUAL(1, sim.getWireFrom(0).getSlips());
+
+    // Hunting for SYN again finds the next frame.
+    recv->startReceiving();
+    sim.runBits(64);
+    queueFrame(sim.getSendEngine(0), textB, sizeof(textB));
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 400));
+    checkFrame(recv->getSavedFrame(), textB, sizeof(textB), FRAME_BCC_GOOD);
+
+    // A lost bit does the same.
+    recv->startReceiving();
+    sim.runBits(64);
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    sim.getWireFrom(0).scheduleSlip(sim.getBits() + 8 * 8 + 2, -1);
+    if ( runUntilFrame(&sim, 1, 400) )
+        TEST_ASSERT_TRUE(recv->getSavedFrame()->getBccStatus() != FRAME_BCC_GOOD);
+    TEST_ASSERT_EQUAL(2, sim.getWireFrom(0).getSlips());
+}
+
+void test_LineSimulator_idle_gap(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+    ReceiveEngine *recv = sim.getReceiveEngine(1);
+
+    recv->startReceiving();
+    sim.runBits(64);
+
+    // Mark between the leading pad and the SYNs is harmless, only slower.
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    sim.getWireFrom(0).scheduleIdleGap(64 + 16, 200);
+    TEST_ASSERT_FALSE(runUntilFrame(&sim, 1, 200));
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 400));
+    checkFrame(recv->getSavedFrame(), textA, sizeof(textA), FRAME_BCC_GOOD);
+    TEST_ASSERT_EQUAL(200, sim.getWireFrom(0).getGapBits());
+
+    // Mark in the middle of the text is not.
+    recv->startReceiving();
+    sim.runBits(64);
+    queueFrame(sim.getSendEngine(0), textB, sizeof(textB));
+    sim.getWireFrom(0).scheduleIdleGap(sim.getBits() + 8 * 8, 16);
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 600));
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, recv->getSavedFrame()->getBccStatus());
+
+    // Nor is a station that stops part way. The frame is given up a few byte
+    // times into the mark, not at the end of the gap.
+    recv->startReceiving();
+    sim.runBits(64);
+    queueFrame(sim.getSendEngine(0), textB, sizeof(textB));
+    sim.getWireFrom(0).scheduleIdleGap(sim.getBits() + 8 * 8, 2000);
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 8 * 8 + 8 * (RECEIVE_ABORT_MARK_BYTES + 2)));
+    TEST_ASSERT_EQUAL(FRAME_ABORTED, recv->getSavedFrame()->getBccStatus());
+    TEST_ASSERT_EQUAL(1, recv->getFrameAborts());
+
+    // Back hunting for SYN, the rest of the text is ignored when the line comes
+    // back, and the next frame is found.
+    sim.runBits(2000 + 8 * 16);
+    TEST_ASSERT_FALSE(recv->isFrameComplete());
+    queueFrame(sim.getSendEngine(0), textA, sizeof(textA));
+    TEST_ASSERT_TRUE(runUntilFrame(&sim, 1, 400));
+    checkFrame(recv->getSavedFrame(), textA, sizeof(textA), FRAME_BCC_GOOD);
+}
+
+// Frames back to back through the engines, reporting simulated frames per second
+// and host time per bit. The host figure only means something relative to
+// another run: a build known to keep up at some bit rate on the board can be
+// scaled by the ratio of the two.
+void test_LineSimulator_benchmark(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+    ReceiveEngine *recv = sim.getReceiveEngine(1);
+    uint8_t text[LINESIM_BENCH_TEXT];
+    LineSimReport report;
+    char msg[160];
+    int good = 0;
+
+    for ( int x = 0; x < LINESIM_BENCH_TEXT; x++ )
+        text[x] = 0x40 + (x % 0x3F);
+
+    recv->startReceiving();
+    sim.runBits(64);
+    sim.resetCounters();
+
+    for ( int f = 0; f < LINESIM_BENCH_FRAMES; f++ ) {
+        recv->startReceiving();
+        queueFrame(sim.getSendEngine(0), text, sizeof(text));
+        if ( runUntilFrame(&sim, 1, 2000) &&
+             recv->getSavedFrame()->getBccStatus() == FRAME_BCC_GOOD )
+            good++;
+    }
+
+    sim.getReport(&report);
+    TEST_ASSERT_EQUAL(LINESIM_BENCH_FRAMES, good);
+    TEST_ASSERT_EQUAL(LINESIM_BENCH_FRAMES, report.frames);
+    TEST_ASSERT_EQUAL(0, report.frameOverruns);
+    TEST_ASSERT_TRUE(report.framesPerSecond > 0);
+
+    snprintf(msg, sizeof(msg),
+             "%lu bits, %lu frames, %.1f frames/s at %ld bps, %.1f ns/bit on host, keeps up to %ld bps on host",
+             report.bits, report.frames, report.framesPerSecond, sim.getBitRate(),
+             report.hostNsPerBit, report.maxHostBitRate);
+    TEST_MESSAGE(msg);
+}
+
+static void noteFrameTime(void *context) {
+    *(unsigned long *)context = micros();
+}
+
+// From the frame completing to the wait for it returning, the longest over a
+// run of frames, either with waitReceivedFrameComplete() or by checking every
+// millisecond as it used to.
+static unsigned long frameWaitLatency(LineSimulator *sim, bool polled) {
+    ReceiveEngine *recv = sim->getReceiveEngine(1);
+    unsigned long completed = 0;
+    unsigned long longest = 0;
+
+    recv->setFrameCompleteHook(noteFrameTime, &completed);
+    for ( int f = 0; f < LINESIM_LATENCY_FRAMES; f++ ) {
+        recv->startReceiving();
+        // Start each frame at a different point in the millisecond.
+        delayMicroseconds(37 * f);
+        queueFrame(sim->getSendEngine(0), textA, sizeof(textA));
+        if ( polled ) {
+            while ( !recv->isFrameComplete() ) {
+                delay(1);
+                recv->drain();
+            }
+        } else {
+            TEST_ASSERT_TRUE(recv->waitReceivedFrameComplete(100) >= 0);
+        }
+        longest = max(longest, micros() - completed);
+        checkFrame(recv->getSavedFrame(), textA, sizeof(textA), FRAME_BCC_GOOD);
+    }
+    recv->setFrameCompleteHook(NULL, NULL);
+    return longest;
+}
+
+void test_LineSimulator_wait_latency(void) {
+    LineSimulator sim(LINESIM_TEST_BIT_RATE);
+    char msg[160];
+
+    sim.start();
+    unsigned long polled = frameWaitLatency(&sim, true);
+    unsigned long waited = frameWaitLatency(&sim, false);
+
+    // Back by the next interrupt, a quarter of a bit time.
+    TEST_ASSERT_TRUE(waited <= Timer1.getPeriod());
+    TEST_ASSERT_TRUE(waited < polled);
+
+    snprintf(msg, sizeof(msg),
+             "Frame complete to wait returning at %ld bps, at most %lu us polled every 1ms, %lu us waiting",
+             sim.getBitRate(), polled, waited);
+    TEST_MESSAGE(msg);
+    sim.stop();
+}
+
+static const uint8_t eotFrame[] = {
+    BSC_CONTROL_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD,
+    BSC_CONTROL_SYN, BSC_CONTROL_SYN, BSC_CONTROL_EOT, BSC_CONTROL_PAD
+};
+static const uint8_t pollFrame[] = {
+    BSC_CONTROL_PAD, BSC_CONTROL_LEADING_PAD, BSC_CONTROL_LEADING_PAD,
+    BSC_CONTROL_SYN, BSC_CONTROL_SYN, 0x40, 0x40, 0x40, 0x40, BSC_CONTROL_ENQ,
+    BSC_CONTROL_PAD
+};
+
+// Share of the bit times carrying frames while sending EOT, poll, EOT, poll
+// ... Each frame takes LINESIM_FRAME_PREP_MICROS to get ready, either once
+// the one before has gone (loaded into the data buffer and waited for), or
+// while it is going (queued).
+static double pollSequenceUtilization(long bitRate, bool queued) {
+    LineSimulator sim(bitRate);
+    SendEngine *send = sim.getSendEngine(0);
+    unsigned long bytes = 0;
+
+    sim.getReceiveEngine(1)->startReceiving();
+    sim.runBits(64);
+    unsigned long startBits = sim.getBits();
+
+    for ( int f = 0; f < LINESIM_POLL_SEQUENCES * 2; f++ ) {
+        const uint8_t *frame = ( f & 1 ) ? pollFrame : eotFrame;
+        uint8_t len = ( f & 1 ) ? sizeof(pollFrame) : sizeof(eotFrame);
+
+        delayMicroseconds(LINESIM_FRAME_PREP_MICROS);
+        if ( queued ) {
+            while ( send->getSendQueueFree() == 0 )
+                yield();
+            TEST_ASSERT_TRUE(send->queueFrame(frame, len));
+        } else {
+            send->clearBuffer();
+            for ( int x = 0; x < len; x++ )
+                send->addByte(frame[x]);
+            send->startSending();
+            send->stopSendingOnIdle();
+            send->waitForSendIdle();
+        }
+        bytes += len;
+    }
+    send->waitForSendIdle();
+
+    // Queued, the frames follow on a byte at a time, so the receiver keeps
+    // character sync from one to the next and sees every EOT.
+    if ( queued )
+        TEST_ASSERT_EQUAL(LINESIM_POLL_SEQUENCES, sim.getFrames(1));
+    return bytes * 8.0 / (sim.getBits() - startBits);
+}
+
+void test_LineSimulator_send_queue(void) {
+    static const long rates[] = { 9600, 56000 };
+    char msg[160];
+
+    for ( uint8_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++ ) {
+        double waited = pollSequenceUtilization(rates[r], false);
+        double queued = pollSequenceUtilization(rates[r], true);
+
+        TEST_ASSERT_TRUE(queued > waited);
+        TEST_ASSERT_TRUE(queued > 0.98);
+        snprintf(msg, sizeof(msg),
+                 "%d EOT/poll sequences at %ld bps: line %.1f%% used a frame at a time, %.1f%% queued",
+                 LINESIM_POLL_SEQUENCES, rates[r], waited * 100, queued * 100);
+        TEST_MESSAGE(msg);
+    }
+}
+
+void test_LineSimulator() {
+    RUN_TEST(test_LineSimulator_loopback);
+    RUN_TEST(test_LineSimulator_bit_error);
+    RUN_TEST(test_LineSimulator_slip);
+    RUN_TEST(test_LineSimulator_idle_gap);
+    RUN_TEST(test_LineSimulator_benchmark);
+    RUN_TEST(test_LineSimulator_wait_latency);
+    RUN_TEST(test_LineSimulator_send_queue);
+}
+
+#else
+
+void test_LineSimulator() {
+}
+
+#endif
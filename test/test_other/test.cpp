@@ -3,7 +3,11 @@
 #include "DataBuffer.h"
 
 extern void test_DataBuffer();
+extern void test_DataBufferPool();
 extern void test_SendEngine();
+extern void test_PinPolicy();
+extern void test_BscCrc();
+extern void test_PinAccess();
 
 void setUp(void) {
 
@@ -23,7 +27,22 @@ void setup() {
 
 void loop() {
     test_DataBuffer();
+    test_DataBufferPool();
     test_SendEngine();
+    test_PinPolicy();
+    test_BscCrc();
+    test_PinAccess();
     UNITY_END();
+#ifdef ARDUINO
     while(1);
-}
\ No newline at end of file
+#endif
+}
+
+#ifndef ARDUINO
+// Native build ... there is no Arduino core to call setup() and loop().
+int main(int argc, char **argv) {
+    setup();
+    loop();
+    return 0;
+}
+#endif
@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "BscCrc.h"
+#include "SendEngine.h"
+#include "bsc_protocol.h"
+
+#define RXD_PIN 9
+
+// Bit at a time CRC-16 to check the table against.
+static uint16_t crcBitwise(uint16_t crc, uint8_t data) {
+    crc ^= data;
+    for ( int b = 0; b < 8; b++ )
+        crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xA001 : crc >> 1;
+    return crc;
+}
+
+// Feed a frame through BscCrc, returning the index of the byte that ended the block.
+static int feedFrame(BscCrc *crc, const uint8_t *data, int len) {
+    for ( int x = 0; x < len; x++ )
+        if ( crc->update(data[x]) )
+            return x;
+    return -1;
+}
+
+void test_BscCrc_table(void) {
+    for ( int x = 0; x < 256; x++ )
+        TEST_ASSERT_EQUAL_HEX16(crcBitwise(0, x), pgm_read_word(&bscCrcTable[x]));
+}
+
+// The read command from README.md ... STX ESC READ ETX, BCC B7 AA
+void test_BscCrc_readme_read(void) {
+    const uint8_t frame[] = { BSC_CONTROL_STX, 0x27, 0xF6, BSC_CONTROL_ETX };
+    BscCrc crc;
+
+    TEST_ASSERT_EQUAL(3, feedFrame(&crc, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_HEX8(0xB7, crc.getBcc1());
+    TEST_ASSERT_EQUAL_HEX8(0xAA, crc.getBcc2());
+}
+
+// The transparent EW / HELLO WORLD write (CommandProcessorText::execWrite), BCC 6C 16
+static const uint8_t helloFrame[] = {
+    BSC_CONTROL_SYN, BSC_CONTROL_SYN, BSC_CONTROL_DLE, BSC_CONTROL_STX,
+    0x27, 0xF5, 0x42, 0x11, 0x40, 0x40, 0x1D, 0x60,
+    0xC8, 0xC5, 0xD3, 0xD3, 0xD6, 0x40, 0xE6, 0xD6, 0xD9, 0xD3, 0xC4, 0x40, 0x40,
+    0x13, BSC_CONTROL_DLE, BSC_CONTROL_ETX
+};
+
+void test_BscCrc_transparent_write(void) {
+    BscCrc crc;
+
+    TEST_ASSERT_EQUAL(sizeof(helloFrame) - 1, feedFrame(&crc, helloFrame, sizeof(helloFrame)));
+    TEST_ASSERT_EQUAL_HEX8(0x6C, crc.getBcc1());
+    TEST_ASSERT_EQUAL_HEX8(0x16, crc.getBcc2());
+}
+
+void test_BscCrc_transparency_rules(void) {
+    // DLE DLE counts once, DLE SYN not at all, the ETX in data does not end the block.
+    const uint8_t frame[] = {
+        BSC_CONTROL_DLE, BSC_CONTROL_STX, 0x41, BSC_CONTROL_DLE, BSC_CONTROL_DLE,
+        BSC_CONTROL_ETX, BSC_CONTROL_DLE, BSC_CONTROL_SYN, 0x42, BSC_CONTROL_DLE, BSC_CONTROL_ETB
+    };
+    const uint8_t covered[] = { 0x41, BSC_CONTROL_DLE, BSC_CONTROL_ETX, 0x42, BSC_CONTROL_ETB };
+    uint16_t expected = 0;
+    BscCrc crc;
+
+    for ( unsigned int x = 0; x < sizeof(covered); x++ )
+        expected = crcBitwise(expected, covered[x]);
+
+    TEST_ASSERT_EQUAL(sizeof(frame) - 1, feedFrame(&crc, frame, sizeof(frame)));
+    TEST_ASSERT_EQUAL_HEX16(expected, crc.getCrc());
+}
+
+void test_BscCrc_header_and_itb(void) {
+    // SOH hdr STX text ITB ... text ETX ... the STX after the header is covered, and
+    // the BCC starts again after the ITB.
+    const uint8_t frame[] = {
+        BSC_CONTROL_SOH, 0x6C, 0xD9, BSC_CONTROL_STX, 0xC1, BSC_CONTROL_SYN, BSC_CONTROL_ITB,
+        0xC2, BSC_CONTROL_ETX
+    };
+    uint16_t first = 0;
+    BscCrc crc;
+
+    first = crcBitwise(first, 0x6C);
+    first = crcBitwise(first, 0xD9);
+    first = crcBitwise(first, BSC_CONTROL_STX);
+    first = crcBitwise(first, 0xC1);
+    first = crcBitwise(first, BSC_CONTROL_ITB);
+
+    TEST_ASSERT_EQUAL(6, feedFrame(&crc, frame, 7));
+    TEST_ASSERT_EQUAL_HEX16(first, crc.getCrc());
+
+    TEST_ASSERT_EQUAL(1, feedFrame(&crc, frame + 7, 2));
+    TEST_ASSERT_EQUAL_HEX16(crcBitwise(crcBitwise(0, 0xC2), BSC_CONTROL_ETX), crc.getCrc());
+}
+
+void test_BscCrc_no_block(void) {
+    // Control sequences and aborted blocks get no BCC.
+    const uint8_t frame[] = {
+        BSC_CONTROL_SYN, BSC_CONTROL_SYN, BSC_CONTROL_DLE, BSC_CONTROL_ACK0,
+        BSC_CONTROL_EOT, BSC_CONTROL_ETX, BSC_CONTROL_STX, 0xC1, BSC_CONTROL_ENQ, BSC_CONTROL_ETX
+    };
+    BscCrc crc;
+
+    TEST_ASSERT_EQUAL(-1, feedFrame(&crc, frame, sizeof(frame)));
+}
+
+void test_SendEngine_auto_bcc(void) {
+    SendEngine eng(RXD_PIN);
+    DataBuffer & db = eng.getDataBuffer();
+
+    // Off by default ... the bytes are queued as given.
+    for ( unsigned int x = 0; x < sizeof(helloFrame); x++ )
+        eng.addByte(helloFrame[x]);
+    TEST_ASSERT_EQUAL(sizeof(helloFrame), db.getLength());
+
+    eng.clearBuffer();
+    eng.setAutoBcc(true);
+    for ( unsigned int x = 0; x < sizeof(helloFrame); x++ )
+        eng.addByte(helloFrame[x]);
+    eng.addByte(BSC_CONTROL_PAD);
+
+    TEST_ASSERT_EQUAL(sizeof(helloFrame) + 3, db.getLength());
+    for ( unsigned int x = 0; x < sizeof(helloFrame); x++ )
+        TEST_ASSERT_EQUAL(helloFrame[x], db.get(x));
+    TEST_ASSERT_EQUAL_HEX8(0x6C, db.get(sizeof(helloFrame)));
+    TEST_ASSERT_EQUAL_HEX8(0x16, db.get(sizeof(helloFrame) + 1));
+    TEST_ASSERT_EQUAL_HEX8(BSC_CONTROL_PAD, db.get(sizeof(helloFrame) + 2));
+}
+
+void test_BscCrc() {
+    RUN_TEST(test_BscCrc_table);
+    RUN_TEST(test_BscCrc_readme_read);
+    RUN_TEST(test_BscCrc_transparent_write);
+    RUN_TEST(test_BscCrc_transparency_rules);
+    RUN_TEST(test_BscCrc_header_and_itb);
+    RUN_TEST(test_BscCrc_no_block);
+    RUN_TEST(test_SendEngine_auto_bcc);
+}
@@ -191,6 +191,30 @@ void test_DataBuffer_max_length(void) {
 
 }
 
+void test_DataBuffer_take(void) {
+    DataBuffer buff;
+    uint8_t out[8];
+
+    TEST_ASSERT_EQUAL(0, buff.take(out, sizeof(out)));
+
+    for ( int x = 0; x < 5; x++ )
+        buff.write(0x10 + x);
+
+    // Part of it ... the rest moves down to the start.
+    TEST_ASSERT_EQUAL(3, buff.take(out, 3));
+    TEST_ASSERT_EQUAL(0x10, out[0]);
+    TEST_ASSERT_EQUAL(0x12, out[2]);
+    TEST_ASSERT_EQUAL(2, buff.getLength());
+    TEST_ASSERT_EQUAL(0x13, buff.get(0));
+
+    buff.write(0x20);
+    TEST_ASSERT_EQUAL(3, buff.take(out, sizeof(out)));
+    TEST_ASSERT_EQUAL(0x13, out[0]);
+    TEST_ASSERT_EQUAL(0x14, out[1]);
+    TEST_ASSERT_EQUAL(0x20, out[2]);
+    TEST_ASSERT_EQUAL(0, buff.getLength());
+}
+
 void test_DataBuffer() {
     RUN_TEST(test_DataBufferReadOnly_constructor);
     RUN_TEST(test_DataBufferReadOnly_copy_constructor);
@@ -201,4 +225,5 @@ void test_DataBuffer() {
     RUN_TEST(test_DataBuffer_clear);
     RUN_TEST(test_DataBuffer_makeReadOnlyCopy);
     RUN_TEST(test_DataBuffer_max_length);
+    RUN_TEST(test_DataBuffer_take);
 }
\ No newline at end of file
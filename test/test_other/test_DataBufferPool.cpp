@@ -0,0 +1,105 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "DataBuffer.h"
+#include "DataBufferPool.h"
+
+#define CHURN_SLOTS         4
+#define CHURN_ITERATIONS    5000
+
+static unsigned long churnSeed;
+
+static int churnRandom(int limit) {
+    churnSeed = churnSeed * 1103515245UL + 12345UL;
+    return (churnSeed >> 16) % limit;
+}
+
+// Acquire and release blocks of random sizes in random order, checking that no
+// block is handed out twice and that nothing overwrites a block while it is held.
+void test_DataBufferPool_churn(void) {
+    uint8_t * blocks[CHURN_SLOTS];
+    int sizes[CHURN_SLOTS];
+    uint8_t largeBase = dataBufferPool.getLargeInUse();
+    uint8_t smallBase = dataBufferPool.getSmallInUse();
+    unsigned int failuresBase = dataBufferPool.getFailures();
+    // Leaving room for the DataBuffer and copy made along the way.
+    int slots = min(CHURN_SLOTS, DATABUFF_POOL_LARGE_BLOCKS - largeBase - 2);
+
+    TEST_ASSERT_TRUE(slots > 1);
+    memset(blocks, 0, sizeof(blocks));
+    churnSeed = 1;
+
+    for ( int x = 0; x < CHURN_ITERATIONS; x++ ) {
+        int slot = churnRandom(slots);
+
+        if ( blocks[slot] ) {
+            for ( int y = 0; y < sizes[slot]; y++ )
+                TEST_ASSERT_EQUAL(slot, blocks[slot][y]);
+            dataBufferPool.release(blocks[slot]);
+            blocks[slot] = NULL;
+        } else {
+            sizes[slot] = churnRandom(DATABUFF_MAX_DATA) + 1;
+            blocks[slot] = dataBufferPool.acquire(sizes[slot]);
+            TEST_ASSERT_NOT_NULL(blocks[slot]);
+            for ( int y = 0; y < slots; y++ )
+                if ( y != slot )
+                    TEST_ASSERT_TRUE(blocks[y] != blocks[slot]);
+            memset(blocks[slot], slot, sizes[slot]);
+        }
+
+        // The same through DataBuffer construction and destruction.
+        if ( x % 10 == 0 ) {
+            DataBuffer buff;
+            DataBufferReadOnly copy(churnRandom(DATABUFF_MAX_DATA) + 1);
+            TEST_ASSERT_EQUAL(DATABUFF_MAX_DATA, buff.getAllocSize());
+            TEST_ASSERT_TRUE(copy.getAllocSize() > 0);
+        }
+    }
+
+    for ( int x = 0; x < slots; x++ )
+        dataBufferPool.release(blocks[x]);
+
+    TEST_ASSERT_EQUAL(largeBase, dataBufferPool.getLargeInUse());
+    TEST_ASSERT_EQUAL(smallBase, dataBufferPool.getSmallInUse());
+    TEST_ASSERT_EQUAL(failuresBase, dataBufferPool.getFailures());
+    TEST_ASSERT_TRUE(dataBufferPool.getLargeHighWater() >= largeBase + 2);
+
+    // No fragmentation ... every free large block can still be had at once.
+    int freeLarge = DATABUFF_POOL_LARGE_BLOCKS - largeBase;
+    for ( int x = 0; x < freeLarge && x < CHURN_SLOTS; x++ ) {
+        blocks[x] = dataBufferPool.acquire(DATABUFF_MAX_DATA);
+        TEST_ASSERT_NOT_NULL(blocks[x]);
+    }
+    for ( int x = 0; x < freeLarge && x < CHURN_SLOTS; x++ )
+        dataBufferPool.release(blocks[x]);
+    TEST_ASSERT_EQUAL(largeBase, dataBufferPool.getLargeInUse());
+}
+
+void test_DataBufferPool_exhausted(void) {
+    uint8_t * blocks[DATABUFF_POOL_LARGE_BLOCKS];
+    int held = 0;
+    unsigned int failuresBase = dataBufferPool.getFailures();
+
+    while ( held < DATABUFF_POOL_LARGE_BLOCKS &&
+            (blocks[held] = dataBufferPool.acquire(DATABUFF_MAX_DATA)) != NULL )
+        held++;
+    TEST_ASSERT_EQUAL(DATABUFF_POOL_LARGE_BLOCKS, dataBufferPool.getLargeInUse());
+
+    // Reported, not a crash ... the buffer has no storage and writes fail.
+    {
+        DataBuffer buff;
+        TEST_ASSERT_EQUAL(failuresBase + 1, dataBufferPool.getFailures());
+        TEST_ASSERT_EQUAL(0, buff.getAllocSize());
+        TEST_ASSERT_EQUAL(-1, buff.write('A'));
+        TEST_ASSERT_EQUAL(0, buff.getLength());
+        TEST_ASSERT_EQUAL(-1, buff.get(0));
+    }
+
+    while ( held > 0 )
+        dataBufferPool.release(blocks[--held]);
+}
+
+void test_DataBufferPool() {
+    RUN_TEST(test_DataBufferPool_churn);
+    RUN_TEST(test_DataBufferPool_exhausted);
+}
@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "SendEngine.h"
+#include "ReceiveEngine.h"
+
+/*
+ * sendBit() and getBit() through the real port registers rather than the
+ * testing overloads. On the host the registers are the shim's virtual ports,
+ * so the input side can be driven from here as well.
+ */
+
+#define RXD_PIN 9
+#define TXD_PIN 3
+#define CTS_PIN 8
+
+void test_PinAccess_sendBit(void) {
+    SendEngine eng(RXD_PIN);
+    volatile uint8_t *port = portOutputRegister(digitalPinToPort(RXD_PIN));
+    uint8_t mask = digitalPinToBitMask(RXD_PIN);
+    const uint8_t data = 0xA6;  // 10100110
+
+    eng.addByte(data);
+    eng.startSending();
+
+    // Least significant bit first, each one left on the RXD pin.
+    for ( int b = 0; b < 8; b++ ) {
+        eng.sendBit();
+        TEST_ASSERT_EQUAL((data >> b) & 1, eng.lastBitSent);
+        TEST_ASSERT_EQUAL((data >> b) & 1, (*port & mask) ? 1 : 0);
+    }
+}
+
+void test_PinAccess_getBit(void) {
+#ifdef ARDUINO_SHIM
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    const uint8_t data = 0x3C;  // 00111100
+
+    for ( int b = 0; b < 8; b++ ) {
+        shimSetInputPin(TXD_PIN, (data >> b) & 1);
+        eng.getBit();
+    }
+    TEST_ASSERT_EQUAL_HEX8(data, eng.getBitBuffer());
+
+    // Only the TXD pin's bit in the port counts.
+    *portInputRegister(digitalPinToPort(TXD_PIN)) = ~digitalPinToBitMask(TXD_PIN);
+    eng.getBit();
+    TEST_ASSERT_EQUAL_HEX8(data >> 1, eng.getBitBuffer());
+#else
+    TEST_IGNORE_MESSAGE("Needs the virtual port registers of the native build");
+#endif
+}
+
+void test_PinAccess() {
+    RUN_TEST(test_PinAccess_sendBit);
+    RUN_TEST(test_PinAccess_getBit);
+}
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "PinPolicy.h"
+#include "SendEngine.h"
+#include "ReceiveEngine.h"
+
+#define RXD_PIN 9
+#define TXD_PIN 3
+#define CTS_PIN 8
+
+// Stand in for a port register so the tests do not depend on the pin wiring.
+volatile uint8_t testPort;
+
+void test_PinPolicy_RuntimePin(void) {
+    RuntimePin pin(&testPort, 0x20);
+
+    testPort = 0x01;
+    pin.high();
+    TEST_ASSERT_EQUAL(0x21, testPort);
+    TEST_ASSERT_TRUE(pin.read());
+    pin.low();
+    TEST_ASSERT_EQUAL(0x01, testPort);
+    TEST_ASSERT_FALSE(pin.read());
+}
+
+void test_PinPolicy_sendBitOn(void) {
+    SendEngine eng(RXD_PIN);
+    RuntimePin pin(&testPort, 0x20);
+
+    testPort = 0;
+    eng.addByte(0x69);  // 01101001
+    eng.startSending();
+    eng.stopSendingOnIdle();
+
+    const uint8_t bits[] = { 1, 0, 0, 1, 0, 1, 1, 0 };
+    for ( int x = 0; x < 8; x++ ) {
+        eng.sendBitOn(pin);
+        TEST_ASSERT_EQUAL(bits[x], eng.lastBitSent);
+        TEST_ASSERT_EQUAL(bits[x] ? 0x20 : 0x00, testPort);
+    }
+
+    // Stopped on idle ... line left at mark.
+    testPort = 0;
+    eng.sendBitOn(pin);
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, eng.xmitState);
+    TEST_ASSERT_EQUAL(0x20, testPort);
+}
+
+void test_PinPolicy_getBitFrom(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    RuntimePin pin(&testPort, 0x01);
+
+    testPort = 0x01;
+    eng.getBitFrom(pin);
+    TEST_ASSERT_EQUAL(0b10000000, eng.getBitBuffer());
+    testPort = 0xFE;
+    eng.getBitFrom(pin);
+    TEST_ASSERT_EQUAL(0b01000000, eng.getBitBuffer());
+    testPort = 0x01;
+    eng.getBitFrom(pin);
+    TEST_ASSERT_EQUAL(0b10100000, eng.getBitBuffer());
+}
+
+void test_PinPolicy() {
+    RUN_TEST(test_PinPolicy_RuntimePin);
+    RUN_TEST(test_PinPolicy_sendBitOn);
+    RUN_TEST(test_PinPolicy_getBitFrom);
+}
@@ -2,6 +2,7 @@
 #include <unity.h>
 
 #include "SendEngine.h"
+#include "bsc_protocol.h"
 
 #define RXD_PIN 9
 
@@ -260,6 +261,108 @@ void test_SendEngine_clearBuffer(void) {
  }
 
 
+static void countSent(void *context) {
+    (*(int *)context)++;
+}
+
+void test_SendEngine_queueFrame(void) {
+    SendEngine eng(RXD_PIN);
+    uint8_t first[] = { 0x32, 0x37 };
+    uint8_t second[] = { 0x32, 0x2D };
+    uint8_t tooLong[SEND_QUEUE_FRAME_MAX + 1];
+    int sent = 0;
+
+    eng.setSendCompleteHook(countSent, &sent);
+    eng.clearBuffer();
+    eng.addByte(0xFF);
+
+    // Queueing starts the engine: the data buffer, then the frames in turn
+    // with nothing in between, then off.
+    TEST_ASSERT_TRUE(eng.queueFrame(first, sizeof(first)));
+    TEST_ASSERT_EQUAL(SEND_STATE_XMIT, eng.xmitState);
+    TEST_ASSERT_TRUE(eng.queueFrame(second, sizeof(second)));
+    TEST_ASSERT_EQUAL(SEND_QUEUE_DEPTH - 2, eng.getSendQueueFree());
+    TEST_ASSERT_FALSE(eng.queueFrame(tooLong, sizeof(tooLong)));
+
+    TEST_ASSERT_EQUAL(0xFF, eng.nextByte());
+    TEST_ASSERT_EQUAL(0x32, eng.nextByte());
+    TEST_ASSERT_EQUAL(0x37, eng.nextByte());
+    TEST_ASSERT_EQUAL(1, sent);
+    TEST_ASSERT_EQUAL(0x32, eng.nextByte());
+    TEST_ASSERT_EQUAL(0x2D, eng.nextByte());
+    TEST_ASSERT_EQUAL(2, sent);
+    TEST_ASSERT_EQUAL(2, eng.getFramesSent());
+    TEST_ASSERT_EQUAL(SEND_QUEUE_DEPTH, eng.getSendQueueFree());
+    TEST_ASSERT_EQUAL(-1, eng.nextByte());
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, eng.xmitState);
+
+    // A frame queued while one goes out follows it.
+    eng.clearBuffer();
+    eng.queueFrame(first, sizeof(first));
+    TEST_ASSERT_EQUAL(0x32, eng.nextByte());
+    eng.queueFrame(second, sizeof(second));
+    TEST_ASSERT_EQUAL(0x37, eng.nextByte());
+    TEST_ASSERT_EQUAL(0x32, eng.nextByte());
+
+    // clearBuffer() drops what is queued.
+    eng.clearBuffer();
+    TEST_ASSERT_EQUAL(SEND_QUEUE_DEPTH, eng.getSendQueueFree());
+    TEST_ASSERT_EQUAL(-1, eng.nextByte());
+    eng.setSendCompleteHook(NULL, NULL);
+}
+
+void test_SendEngine_streamUnderrun(void) {
+    SendEngine eng(RXD_PIN);
+
+    eng.clearBuffer();
+    eng.startStream();
+    eng.startSending();
+
+    // Outside transparent text the fill is a plain SYN.
+    eng.putStream(0xC1);
+    TEST_ASSERT_EQUAL(0xC1, eng.nextByte());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, eng.nextByte());
+    TEST_ASSERT_EQUAL(1, eng.getStreamUnderruns());
+
+    // Inside it, DLE SYN.
+    eng.putStream(BSC_CONTROL_DLE);
+    eng.putStream(BSC_CONTROL_STX);
+    eng.putStream(0x32);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_DLE, eng.nextByte());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_STX, eng.nextByte());
+    TEST_ASSERT_EQUAL(0x32, eng.nextByte());
+    TEST_ASSERT_EQUAL(BSC_CONTROL_DLE, eng.nextByte());
+    eng.putStream(0xC2);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, eng.nextByte());
+    TEST_ASSERT_EQUAL(0xC2, eng.nextByte());
+    TEST_ASSERT_EQUAL(2, eng.getStreamUnderruns());
+
+    // DLE DLE is data and DLE ETX ends it.
+    eng.putStream(BSC_CONTROL_DLE);
+    eng.putStream(BSC_CONTROL_DLE);
+    eng.putStream(BSC_CONTROL_DLE);
+    eng.putStream(BSC_CONTROL_ETX);
+    for ( int x = 0; x < 4; x++ )
+        eng.nextByte();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, eng.nextByte());
+
+    // Running dry between a DLE and its partner ends the block with DLE ENQ
+    // and the rest of the stream goes nowhere.
+    eng.putStream(BSC_CONTROL_DLE);
+    eng.putStream(BSC_CONTROL_STX);
+    eng.putStream(BSC_CONTROL_DLE);
+    for ( int x = 0; x < 3; x++ )
+        eng.nextByte();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ENQ, eng.nextByte());
+    eng.putStream(BSC_CONTROL_ETX);
+    eng.putStream(0xFF);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_SYN, eng.nextByte());
+    eng.endStream();
+    eng.stopSendingOnIdle();
+    TEST_ASSERT_EQUAL(-1, eng.nextByte());
+    TEST_ASSERT_EQUAL(SEND_STATE_OFF, eng.xmitState);
+}
+
 void test_SendEngine() {
     RUN_TEST(test_SendEngine_constructor);
     RUN_TEST(test_SendEngine_sendBit);
@@ -268,4 +371,6 @@ void test_SendEngine() {
     RUN_TEST(test_SendEngine_stopSendingOnIdle1);
     RUN_TEST(test_SendEngine_stopSendingOnIdle2);
     RUN_TEST(test_SendEngine_clearBuffer);
+    RUN_TEST(test_SendEngine_queueFrame);
+    RUN_TEST(test_SendEngine_streamUnderrun);
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef cycle_timer_h
+#define cycle_timer_h
+
+#include <Arduino.h>
+#ifdef ARDUINO_SHIM
+#include <chrono>
+#else
+#include <avr/io.h>
+#endif
+
+/*
+ * Times single calls in CPU cycles from Timer1, as SyncBitBanger's interrupt
+ * statistics do. Between begin() and end() the timer runs in normal mode with no
+ * prescale so TCNT1 counts every cycle, and interrupts are masked around each
+ * timed call. The shim's TCNT1 never moves, so the host clock in nanoseconds
+ * stands in for it there (CYCLE_TIMER_UNITS says which).
+ */
+
+#ifdef ARDUINO_SHIM
+#define CYCLE_TIMER_UNITS   "ns"
+#else
+#define CYCLE_TIMER_UNITS   "cycles"
+#endif
+
+class CycleTimer {
+    public:
+        void begin(void) {
+#ifndef ARDUINO_SHIM
+            savedTCCR1A = TCCR1A;
+            savedTCCR1B = TCCR1B;
+            TCCR1A = 0;
+            TCCR1B = _BV(CS10);
+#endif
+        }
+
+        void end(void) {
+#ifndef ARDUINO_SHIM
+            TCCR1A = savedTCCR1A;
+            TCCR1B = savedTCCR1B;
+#endif
+        }
+
+        inline void start(void) {
+            noInterrupts();
+#ifdef ARDUINO_SHIM
+            startTime = std::chrono::steady_clock::now();
+#else
+            startCount = TCNT1;
+#endif
+        }
+
+        // Cycles (or ns) since start(). Calls must be shorter than the 16 bit
+        // timer wraps on the board.
+        inline unsigned long stop(void) {
+            unsigned long elapsed;
+#ifdef ARDUINO_SHIM
+            elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - startTime).count();
+#else
+            elapsed = (uint16_t)(TCNT1 - startCount);
+#endif
+            interrupts();
+            return elapsed;
+        }
+
+    private:
+#ifdef ARDUINO_SHIM
+        std::chrono::steady_clock::time_point startTime;
+#else
+        uint16_t startCount;
+        uint8_t  savedTCCR1A, savedTCCR1B;
+#endif
+};
+
+#endif
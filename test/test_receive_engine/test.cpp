@@ -5,6 +5,8 @@
 //extern void test_DataBuffer();
 //extern void test_SendEngine();
 extern void test_ReceiveEngine();
+extern void test_ReceiveEngineDeferred();
+extern void test_ReceiveStateTable();
 
 void setUp(void) {
 
@@ -25,6 +27,19 @@ void loop() {
     //test_DataBuffer();
     //test_SendEngine();
     test_ReceiveEngine();
+    test_ReceiveEngineDeferred();
+    test_ReceiveStateTable();
     UNITY_END();
+#ifdef ARDUINO
     while(1);
-}
\ No newline at end of file
+#endif
+}
+
+#ifndef ARDUINO
+// Native build ... there is no Arduino core to call setup() and loop().
+int main(int argc, char **argv) {
+    setup();
+    loop();
+    return 0;
+}
+#endif
@@ -663,7 +663,146 @@ void test_ReceiveEngine_processBit_Read_Partition1(void) {
 
 }
 
+static DataBuffer * feedFrame(ReceiveEngine &eng, const uint8_t *bytes, int len) {
+    eng.startReceiving();
+    for ( int x = 0; x < len; x++ ) {
+        eng.setBitBuffer(bytes[x]);
+        runProcessBit(eng);
+    }
+    TEST_ASSERT_TRUE(eng.isFrameComplete());
+    return eng.getSavedFrame();
+}
+
+void test_ReceiveEngine_processBit_BCC(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+
+    // The read command from README.md
+    uint8_t good[] = { 0x32, 0x32, 0x02, 0x27, 0xF6, 0x03, 0xB7, 0xAA, 0xFF };
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, feedFrame(eng, good, sizeof(good))->getBccStatus());
+
+    uint8_t badBcc2[] = { 0x32, 0x32, 0x02, 0x27, 0xF6, 0x03, 0xB7, 0xAB, 0xFF };
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, feedFrame(eng, badBcc2, sizeof(badBcc2))->getBccStatus());
+
+    uint8_t badData[] = { 0x32, 0x32, 0x02, 0x27, 0xF7, 0x03, 0xB7, 0xAA, 0xFF };
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, feedFrame(eng, badData, sizeof(badData))->getBccStatus());
+
+    // Transparent, with DLE DLE in the data ... the BCC covers 41 10 42 03.
+    uint8_t transparent[] = { 0x32, 0x32, 0x10, 0x02, 0x41, 0x10, 0x10, 0x42, 0x10, 0x03, 0x00, 0x00, 0xFF };
+    uint16_t crc = 0;
+    crc = bscCrcUpdate(crc, 0x41);
+    crc = bscCrcUpdate(crc, 0x10);
+    crc = bscCrcUpdate(crc, 0x42);
+    crc = bscCrcUpdate(crc, 0x03);
+    transparent[10] = crc & 0xff;
+    transparent[11] = crc >> 8;
+    DataBuffer * frame = feedFrame(eng, transparent, sizeof(transparent));
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, frame->getBccStatus());
+    TEST_ASSERT_EQUAL(11, frame->getLength());     // SYN DLE STX 41 10 42 DLE ETX BCC1 BCC2 PAD
+
+    // No text, nothing to check.
+    uint8_t ack0[] = { 0x32, 0x32, 0x10, 0x70, 0xFF };
+    TEST_ASSERT_EQUAL(FRAME_BCC_UNCHECKED, feedFrame(eng, ack0, sizeof(ack0))->getBccStatus());
+}
+
+static void feedBytes(ReceiveEngine &eng, const uint8_t *bytes, int len) {
+    for ( int x = 0; x < len; x++ ) {
+        eng.setBitBuffer(bytes[x]);
+        runProcessBit(eng);
+    }
+}
+
+void test_ReceiveEngine_frame_queue(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    uint8_t block1[] = { 0x32, 0x32, 0x02, 0x27, 0xF6, 0x26, 0x00, 0x00, 0xFF };
+    uint8_t block2[] = { 0x32, 0x32, 0x02, 0x27, 0xF6, 0x03, 0xB7, 0xAA, 0xFF };
+    uint8_t eot[] = { 0x32, 0x32, 0x37, 0xFF };
+    const ReceivedFrameInfo * info;
+    DataBuffer * frame;
+
+    eng.startReceiving();
+
+    // Blocks back to back, none taken yet.
+    feedBytes(eng, block1, sizeof(block1));
+    delay(5);
+    feedBytes(eng, block2, sizeof(block2));
+    TEST_ASSERT_EQUAL(RECEIVE_FRAME_QUEUE_DEPTH - 1, eng.getQueuedFrames());
+    TEST_ASSERT_EQUAL(0, eng.getFrameOverruns());
+
+    frame = eng.getSavedFrame();
+    info = eng.getSavedFrameInfo();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETB, frame->get(4));
+    TEST_ASSERT_EQUAL(frame->getLength(), info->length);
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETB, info->terminator);
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, info->bccStatus);
+    unsigned long firstTime = info->timestamp;
+
+    frame = eng.getSavedFrame();
+    info = eng.getSavedFrameInfo();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, eng.getSavedFrameTerminator());
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, info->bccStatus);
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, frame->getBccStatus());
+    TEST_ASSERT_TRUE(info->timestamp - firstTime >= 5);
+    TEST_ASSERT_FALSE(eng.isFrameComplete());
 
+    // One more than the queue holds ... the oldest is dropped.
+    feedBytes(eng, block1, sizeof(block1));
+    feedBytes(eng, block2, sizeof(block2));
+    feedBytes(eng, eot, sizeof(eot));
+    TEST_ASSERT_EQUAL(1, eng.getFrameOverruns());
+    TEST_ASSERT_EQUAL(RECEIVE_FRAME_QUEUE_DEPTH - 1, eng.getQueuedFrames());
+
+    eng.getSavedFrame();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, eng.getSavedFrameTerminator());
+    frame = eng.getSavedFrame();
+    TEST_ASSERT_EQUAL(BSC_CONTROL_EOT, eng.getSavedFrameTerminator());
+    TEST_ASSERT_EQUAL(3, frame->getLength());
+    TEST_ASSERT_EQUAL(0, eng.getQueuedFrames());
+}
+
+void test_ReceiveEngine_abort_on_mark(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    uint8_t cutShort[] = { 0x32, 0x32, 0x02, 0xC1, 0xC2, 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t block[] = { 0x32, 0x32, 0x02, 0x27, 0xF6, 0x03, 0xB7, 0xAA, 0xFF };
+    DataBuffer * frame;
+
+    TEST_ASSERT_EQUAL(RECEIVE_ABORT_MARK_BYTES, eng.getAbortMarkBytes());
+
+    // The text stops and the line goes to mark ... the frame is given up and
+    // the engine hunts for SYN again.
+    eng.startReceiving();
+    feedBytes(eng, cutShort, sizeof(cutShort));
+    TEST_ASSERT_TRUE(eng.isFrameComplete());
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_OUT_OF_SYNC, eng.receiveState);
+    TEST_ASSERT_FALSE(eng.getInCharSync());
+    TEST_ASSERT_EQUAL(1, eng.getFrameAborts());
+    frame = eng.getSavedFrame();
+    TEST_ASSERT_EQUAL(FRAME_ABORTED, frame->getBccStatus());
+    TEST_ASSERT_EQUAL(0, eng.getSavedFrameTerminator());
+    TEST_ASSERT_EQUAL(7, frame->getLength());    // SYN STX C1 C2 and three of the FFs
+
+    // The next frame is found.
+    feedBytes(eng, block, sizeof(block));
+    TEST_ASSERT_EQUAL(FRAME_BCC_GOOD, eng.getSavedFrame()->getBccStatus());
+
+    // Mark after a frame only loses sync, there is no frame to give up.
+    feedBytes(eng, cutShort + 5, 4);
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_OUT_OF_SYNC, eng.receiveState);
+    TEST_ASSERT_FALSE(eng.isFrameComplete());
+    TEST_ASSERT_EQUAL(1, eng.getFrameAborts());
+
+    // A BCC of FF FF is not taken for mark.
+    uint8_t ffBcc[] = { 0x32, 0x32, 0x02, 0xC1, 0x03, 0xFF, 0xFF, 0xFF };
+    frame = feedFrame(eng, ffBcc, sizeof(ffBcc));
+    TEST_ASSERT_EQUAL(BSC_CONTROL_ETX, eng.getSavedFrameTerminator());
+    TEST_ASSERT_EQUAL(FRAME_BCC_BAD, frame->getBccStatus());
+
+    // Turned off, the engine waits for the ETX.
+    eng.setAbortMarkBytes(0);
+    eng.startReceiving();
+    feedBytes(eng, cutShort, sizeof(cutShort));
+    TEST_ASSERT_FALSE(eng.isFrameComplete());
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_DATA, eng.receiveState);
+}
 
 void test_ReceiveEngine() {
     resetFunctionTime();
@@ -680,6 +819,9 @@ void test_ReceiveEngine() {
     RUN_TEST(test_ReceiveEngine_processBit_SYN_EOT);
     RUN_TEST(test_ReceiveEngine_processBit_Status_Msg);
     RUN_TEST(test_ReceiveEngine_processBit_Read_Partition1);
+    RUN_TEST(test_ReceiveEngine_processBit_BCC);
+    RUN_TEST(test_ReceiveEngine_frame_queue);
+    RUN_TEST(test_ReceiveEngine_abort_on_mark);
 
     reportFunctionTime((char *)"eng.processBit()");
 }
@@ -0,0 +1,285 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ReceiveEngine.h"
+#include "cycle_timer.h"
+
+#define TXD_PIN 3
+#define CTS_PIN 8
+
+/*
+ * Compares the deferred receive path (collectBit() in the interrupt routine,
+ * drain() from the main loop) with the original processBit() path. The same
+ * line bits are fed to both engines and the completed frames must be identical.
+ */
+
+#define MAX_LOGGED_FRAMES   8
+#define MAX_LOGGED_LENGTH   40
+
+struct FrameLog {
+    int count;
+    int peakQueued;     // Most completed frames waiting at once
+    int length[MAX_LOGGED_FRAMES];
+    uint8_t data[MAX_LOGGED_FRAMES][MAX_LOGGED_LENGTH];
+};
+
+static void logCompletedFrame(ReceiveEngine &eng, FrameLog &log) {
+    log.peakQueued = max(log.peakQueued, (int)eng.getQueuedFrames());
+
+    while ( eng.isFrameComplete() ) {
+        DataBuffer * frame = eng.getSavedFrame();
+        if ( log.count >= MAX_LOGGED_FRAMES )
+            continue;
+
+        log.length[log.count] = frame->getLength();
+        for ( int x = 0; x < frame->getLength() && x < MAX_LOGGED_LENGTH; x++ )
+            log.data[log.count][x] = frame->get(x);
+        log.count++;
+    }
+}
+
+/*
+ * Feed the bytes onto the "line" LSB first. The deferred engine is drained every
+ * drainIntervalUs microseconds of simulated line time, as the main loop would.
+ */
+static void feedLine(const uint8_t *bytes, int len, long bitRate, long drainIntervalUs,
+                     ReceiveEngine &direct, FrameLog &directLog,
+                     ReceiveEngine &deferred, FrameLog &deferredLog) {
+    long bitTimeUs = 1000000L / bitRate;
+    long sinceDrainUs = 0;
+
+    for ( int x = 0; x < len; x++ ) {
+        for ( int b = 0; b < 8; b++ ) {
+            uint8_t bit = (bytes[x] >> b) & 0x01;
+
+            direct.getBit(bit);
+            direct.processBit();
+            logCompletedFrame(direct, directLog);
+
+            deferred.getBit(bit);
+            deferred.collectBit();
+
+            sinceDrainUs += bitTimeUs;
+            if ( sinceDrainUs >= drainIntervalUs ) {
+                deferred.drain();
+                logCompletedFrame(deferred, deferredLog);
+                sinceDrainUs = 0;
+            }
+        }
+    }
+    deferred.drain();
+    logCompletedFrame(deferred, deferredLog);
+}
+
+// The frames from test_ReceiveEngine.cpp, back to back with some junk and idle
+// mark between them.
+static const uint8_t lineTraffic[] = {
+    0xFF, 0xFF, 0x11,
+    0x32, 0x02, 0xC1, 0xC2, 0x03, 0x44, 0x55, 0xFF,                 // STX ETX
+    0x32, 0x32, 0x01, 0xF1, 0x02, 0xC1, 0xC2, 0x26, 0x44, 0x55, 0xFF, // SOH STX ETB
+    0x32, 0x10, 0x70, 0xFF,                                         // ACK0
+    0x32, 0x10, 0x61, 0xFF,                                         // ACK1
+    0x32, 0x3D, 0xFF,                                               // NAK
+    0x32, 0x37, 0xFF,                                               // EOT
+    0x32, 0x32, 0x01, 0x6C, 0xD9, 0x02, 0xC1, 0xC1, 0x40, 0x40,     // Status message
+    0xC9, 0xC9, 0xC9, 0x03, 0xF1, 0xF2, 0xFF,
+    0x32, 0x32, 0x10, 0x02, 0xC1, 0xC1, 0x40, 0x40, 0xC1, 0x10,     // Read partition
+    0x10, 0xC3, 0x10, 0x03, 0xF1, 0xF2, 0xFF,
+    0x32, 0x32
+};
+
+static void compareAtRate(long bitRate, long drainIntervalUs, FrameLog &deferredLog) {
+    ReceiveEngine direct(TXD_PIN, CTS_PIN);
+    ReceiveEngine deferred(TXD_PIN, CTS_PIN);
+    FrameLog directLog;
+
+    memset(&directLog, 0, sizeof(directLog));
+    memset(&deferredLog, 0, sizeof(deferredLog));
+
+    direct.startReceiving();
+    deferred.startReceiving();
+
+    feedLine(lineTraffic, sizeof(lineTraffic), bitRate, drainIntervalUs,
+             direct, directLog, deferred, deferredLog);
+
+    TEST_ASSERT_EQUAL(0, deferred.getRingOverruns());
+    TEST_ASSERT_EQUAL(0, deferred.getFrameOverruns());
+    TEST_ASSERT_EQUAL(MAX_LOGGED_FRAMES, directLog.count);
+    TEST_ASSERT_EQUAL(directLog.count, deferredLog.count);
+    for ( int f = 0; f < directLog.count; f++ ) {
+        TEST_ASSERT_EQUAL(directLog.length[f], deferredLog.length[f]);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(directLog.data[f], deferredLog.data[f],
+                                      min(directLog.length[f], MAX_LOGGED_LENGTH));
+    }
+    TEST_ASSERT_EQUAL(direct.receiveState, deferred.receiveState);
+}
+
+void test_ReceiveEngineDeferred_collectBit_sync(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    eng.startReceiving();
+
+    // Mark, then the SYN pattern LSB first ... 0x32 = 0 1 0 0 1 1 0 0
+    for ( int x = 0; x < 8; x++ ) {
+        eng.getBit(1);
+        eng.collectBit();
+    }
+    TEST_ASSERT_FALSE(eng.getInCharSync());
+
+    const uint8_t synBits[] = { 0, 1, 0, 0, 1, 1, 0, 0 };
+    for ( int x = 0; x < 8; x++ ) {
+        eng.getBit(synBits[x]);
+        eng.collectBit();
+    }
+    TEST_ASSERT_TRUE(eng.getInCharSync());
+
+    // Nothing happens to the state machine until drain() is called.
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_OUT_OF_SYNC, eng.receiveState);
+    TEST_ASSERT_EQUAL(0, eng.getFrameLength());
+
+    eng.drain();
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_IDLE, eng.receiveState);
+    TEST_ASSERT_EQUAL(1, eng.getFrameLength());
+    TEST_ASSERT_EQUAL(0x32, eng.getFrameDataByte(0));
+}
+
+void test_ReceiveEngineDeferred_ring_overrun(void) {
+    ReceiveEngine eng(TXD_PIN, CTS_PIN);
+    eng.startReceiving();
+
+    // Get in sync, then never drain.
+    eng.setBitBuffer(0x32);
+    eng.collectBit();
+    for ( int x = 0; x < RECEIVE_RING_SIZE + 4; x++ ) {
+        eng.setBitBuffer(0xC1);
+        eng.collectBit();
+    }
+    TEST_ASSERT_TRUE(eng.getRingOverruns() > 0);
+
+    // startReceiving() throws away anything stale in the ring.
+    eng.startReceiving();
+    eng.drain();
+    TEST_ASSERT_EQUAL(RECEIVE_STATE_OUT_OF_SYNC, eng.receiveState);
+    TEST_ASSERT_EQUAL(0, eng.getFrameLength());
+}
+
+void test_ReceiveEngineDeferred_same_frames_300bps(void) {
+    FrameLog deferredLog;
+    compareAtRate(300, 1000, deferredLog);
+}
+
+void test_ReceiveEngineDeferred_same_frames_19200bps(void) {
+    FrameLog deferredLog;
+    compareAtRate(19200, 1000, deferredLog);
+}
+
+void test_ReceiveEngineDeferred_same_frames_56000bps(void) {
+    FrameLog deferredLog;
+    compareAtRate(56000, 250, deferredLog);
+}
+
+void test_ReceiveEngineDeferred_same_frames_queued(void) {
+    FrameLog deferredLog;
+
+    // Draining less often than the shortest frames arrive, so completed
+    // frames wait in the queue (RECEIVE_FRAME_QUEUE_DEPTH) for the loop.
+    compareAtRate(56000, 700, deferredLog);
+    TEST_ASSERT_TRUE(deferredLog.peakQueued > 1);
+}
+
+/*
+ * The ISR timing runs the traffic through both engines from the start once per
+ * window of ISR_TIMING_WINDOW bits, timing only the calls for the bits in that
+ * window. Each bit keeps the least time of ISR_TIMING_PASSES runs, so a host
+ * preemption landing on one run doesn't count as the call's cost. The board is
+ * cycle exact with interrupts masked and needs only the one run.
+ */
+#define ISR_TIMING_WINDOW   32
+#ifdef ARDUINO_SHIM
+#define ISR_TIMING_PASSES   8
+#else
+#define ISR_TIMING_PASSES   1
+#endif
+
+static void timeWindow(int first, CycleTimer &timer,
+                       unsigned long *directBest, unsigned long *deferredBest) {
+    ReceiveEngine direct(TXD_PIN, CTS_PIN);
+    ReceiveEngine deferred(TXD_PIN, CTS_PIN);
+    unsigned long callTime;
+    int bitIndex = 0;
+
+    direct.startReceiving();
+    deferred.startReceiving();
+
+    for ( unsigned int x = 0; x < sizeof(lineTraffic); x++ ) {
+        for ( int b = 0; b < 8; b++, bitIndex++ ) {
+            uint8_t bit = (lineTraffic[x] >> b) & 0x01;
+            int slot = bitIndex - first;
+            bool timed = slot >= 0 && slot < ISR_TIMING_WINDOW;
+
+            direct.getBit(bit);
+            timer.start();
+            direct.processBit();
+            callTime = timer.stop();
+            if ( timed )
+                directBest[slot] = min(directBest[slot], callTime);
+            if ( direct.isFrameComplete() )
+                direct.getSavedFrame();
+
+            deferred.getBit(bit);
+            timer.start();
+            deferred.collectBit();
+            callTime = timer.stop();
+            if ( timed )
+                deferredBest[slot] = min(deferredBest[slot], callTime);
+            deferred.drain();
+            if ( deferred.isFrameComplete() )
+                deferred.getSavedFrame();
+        }
+    }
+}
+
+void test_ReceiveEngineDeferred_isr_timing(void) {
+    unsigned long directBest[ISR_TIMING_WINDOW], deferredBest[ISR_TIMING_WINDOW];
+    unsigned long directMax = 0, deferredMax = 0;
+    unsigned long directTotal = 0, deferredTotal = 0;
+    CycleTimer timer;
+    char printbuff[200];
+    int bits = sizeof(lineTraffic) * 8;
+
+    timer.begin();
+    for ( int first = 0; first < bits; first += ISR_TIMING_WINDOW ) {
+        for ( int slot = 0; slot < ISR_TIMING_WINDOW; slot++ ) {
+            directBest[slot] = 0xFFFFFFFF;
+            deferredBest[slot] = 0xFFFFFFFF;
+        }
+        for ( int pass = 0; pass < ISR_TIMING_PASSES; pass++ )
+            timeWindow(first, timer, directBest, deferredBest);
+
+        for ( int slot = 0; slot < ISR_TIMING_WINDOW && first + slot < bits; slot++ ) {
+            directTotal += directBest[slot];
+            directMax = max(directMax, directBest[slot]);
+            deferredTotal += deferredBest[slot];
+            deferredMax = max(deferredMax, deferredBest[slot]);
+        }
+    }
+    timer.end();
+
+    sprintf(printbuff,
+        "Per bit in the ISR over %d bits: processBit() avg %lu max %lu " CYCLE_TIMER_UNITS
+        ", collectBit() avg %lu max %lu " CYCLE_TIMER_UNITS ".",
+        bits, directTotal / bits, directMax, deferredTotal / bits, deferredMax);
+    TEST_MESSAGE(printbuff);
+
+    // The point of deferring: the worst bit costs the ISR less.
+    TEST_ASSERT_TRUE_MESSAGE(deferredMax < directMax, printbuff);
+}
+
+void test_ReceiveEngineDeferred() {
+    RUN_TEST(test_ReceiveEngineDeferred_collectBit_sync);
+    RUN_TEST(test_ReceiveEngineDeferred_ring_overrun);
+    RUN_TEST(test_ReceiveEngineDeferred_same_frames_300bps);
+    RUN_TEST(test_ReceiveEngineDeferred_same_frames_19200bps);
+    RUN_TEST(test_ReceiveEngineDeferred_same_frames_56000bps);
+    RUN_TEST(test_ReceiveEngineDeferred_same_frames_queued);
+    RUN_TEST(test_ReceiveEngineDeferred_isr_timing);
+}